@@ -0,0 +1,40 @@
+#include "BandwidthLimiter.h"
+#include "EngineConfig.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
+void BandwidthLimiter::SetRate(int64_t bytesPerSecond) {
+  m_rate.store(std::max<int64_t>(0, bytesPerSecond), std::memory_order_relaxed);
+  // Debt accrued at the old rate does not carry over
+  m_paidUntil.store(0, std::memory_order_relaxed);
+}
+
+int BandwidthLimiter::Consume(size_t bytes) {
+  int64_t rate = m_rate.load(std::memory_order_relaxed);
+  if (rate <= 0 || bytes == 0) {
+    return 0;
+  }
+
+  int64_t now = NowNs();
+  int64_t cost = static_cast<int64_t>(bytes) * 1000000000 / rate;
+  int64_t burst = Config::SPEED_LIMIT_BURST_MS * 1000000;
+
+  // An idle bucket refills up to one burst; anything beyond that is paid
+  // for by waiting
+  int64_t paidUntil = m_paidUntil.load(std::memory_order_relaxed);
+  int64_t updated;
+  do {
+    updated = std::max(paidUntil, now - burst) + cost;
+  } while (!m_paidUntil.compare_exchange_weak(paidUntil, updated,
+                                              std::memory_order_relaxed));
+
+  return updated > now ? static_cast<int>((updated - now) / 1000000) : 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Token bucket shared by every connection it limits. Callers account for
+// the bytes they just received and wait for the returned delay; since
+// each delay includes everything reserved before it, the callers take
+// turns and together stay within the rate. Lock-free.
+class BandwidthLimiter {
+public:
+  BandwidthLimiter() = default;
+
+  // Disable copy
+  BandwidthLimiter(const BandwidthLimiter &) = delete;
+  BandwidthLimiter &operator=(const BandwidthLimiter &) = delete;
+
+  // bytesPerSecond <= 0 removes the limit
+  void SetRate(int64_t bytesPerSecond);
+  int64_t GetRate() const { return m_rate.load(std::memory_order_relaxed); }
+  bool IsLimited() const { return GetRate() > 0; }
+
+  // Takes bytes out of the bucket. Returns how many milliseconds to wait
+  // before receiving more, 0 if the bucket still had them.
+  int Consume(size_t bytes);
+
+private:
+  std::atomic<int64_t> m_rate{0};
+  // steady_clock time (ns) at which everything consumed so far is paid
+  // for. Up to one burst in the past while the bucket refills.
+  std::atomic<int64_t> m_paidUntil{0};
+};
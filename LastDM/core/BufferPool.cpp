@@ -0,0 +1,149 @@
+#include "BufferPool.h"
+#include "EngineConfig.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+void BufferPool::Deallocate::operator()(char *data) const {
+  ::operator delete[](data, std::align_val_t(ALIGNMENT));
+}
+
+BufferPool::Buffer::Buffer(Buffer &&other) noexcept
+    : m_pool(other.m_pool), m_data(std::move(other.m_data)),
+      m_size(other.m_size) {
+  other.m_pool = nullptr;
+  other.m_size = 0;
+}
+
+BufferPool::Buffer &BufferPool::Buffer::operator=(Buffer &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    m_pool = other.m_pool;
+    m_data = std::move(other.m_data);
+    m_size = other.m_size;
+    other.m_pool = nullptr;
+    other.m_size = 0;
+  }
+  return *this;
+}
+
+void BufferPool::Buffer::Reset() {
+  if (m_pool && m_data) {
+    m_pool->Release(std::move(m_data), m_size);
+  }
+  m_pool = nullptr;
+  m_data.reset();
+  m_size = 0;
+}
+
+BufferPool::BufferPool(size_t maxFreePerSize)
+    : m_maxFreePerSize(maxFreePerSize) {}
+
+BufferPool &BufferPool::Shared() {
+  // Enough free buffers to refill a write queue. Never destroyed, so
+  // buffers released during shutdown still have a pool to go back to.
+  static BufferPool *pool =
+      new BufferPool(Config::WRITE_QUEUE_SIZE / Config::MAX_READ_SIZE);
+  return *pool;
+}
+
+size_t BufferPool::RoundUp(size_t size) {
+  size_t rounded = 1;
+  while (rounded < size) {
+    rounded <<= 1;
+  }
+  return rounded;
+}
+
+BufferPool::Buffer BufferPool::Acquire(size_t size, bool withinLimit) {
+  Buffer buffer;
+  size = std::max(MIN_SIZE, RoundUp(size));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (withinLimit && m_limit > 0 && m_stats.inUse + size > m_limit) {
+      m_stats.deferred++;
+      return buffer;
+    }
+    for (auto &list : m_free) {
+      if (list.size == size && !list.buffers.empty()) {
+        buffer.m_data = std::move(list.buffers.back());
+        list.buffers.pop_back();
+        m_stats.cached -= size;
+        break;
+      }
+    }
+  }
+
+  bool allocated = !buffer.m_data;
+  if (allocated) {
+    buffer.m_data.reset(static_cast<char *>(::operator new[](
+        size, std::align_val_t(ALIGNMENT), std::nothrow)));
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!buffer.m_data) {
+    m_stats.failures++;
+    return buffer;
+  }
+  buffer.m_pool = this;
+  buffer.m_size = size;
+  m_stats.allocations += allocated ? 1 : 0;
+  m_stats.inUse += size;
+  m_stats.highWater = std::max(m_stats.highWater, m_stats.inUse);
+  return buffer;
+}
+
+BufferPool::Buffer BufferPool::AcquireWithin(size_t size, size_t minSize) {
+  Buffer buffer = Acquire(size, true);
+  if (!buffer.Data() && minSize < size) {
+    buffer = Acquire(minSize, true);
+  }
+  return buffer;
+}
+
+void BufferPool::SetLimit(size_t bytes) {
+  std::vector<Storage> dropped;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_limit = bytes;
+
+  // Free buffers past the limit are given back to the system
+  for (auto &list : m_free) {
+    while (m_limit > 0 && m_stats.inUse + m_stats.cached > m_limit &&
+           !list.buffers.empty()) {
+      dropped.push_back(std::move(list.buffers.back()));
+      list.buffers.pop_back();
+      m_stats.cached -= list.size;
+    }
+  }
+}
+
+BufferPool::Stats BufferPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void BufferPool::Release(Storage data, size_t size) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.inUse -= size;
+  if (m_maxFreePerSize == 0 ||
+      (m_limit > 0 && m_stats.inUse + m_stats.cached + size > m_limit)) {
+    return;
+  }
+
+  for (auto &list : m_free) {
+    if (list.size == size) {
+      if (list.buffers.size() < m_maxFreePerSize) {
+        list.buffers.push_back(std::move(data));
+        m_stats.cached += size;
+      }
+      return;
+    }
+  }
+
+  FreeList list;
+  list.size = size;
+  list.buffers.push_back(std::move(data));
+  m_free.push_back(std::move(list));
+  m_stats.cached += size;
+}
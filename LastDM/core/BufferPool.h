@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Reusable buffers for network reads, the write-behind queues and file
+// hashing. Sizes are rounded up to a power of two (at least MIN_SIZE) and
+// buffers are page aligned; each size keeps a few free buffers. One pool
+// is shared by the whole process, so memory use can be watched and tuned
+// in one place. Thread-safe.
+class BufferPool {
+  struct Deallocate {
+    void operator()(char *data) const;
+  };
+  using Storage = std::unique_ptr<char[], Deallocate>;
+
+public:
+  static constexpr size_t MIN_SIZE = 4096;
+  static constexpr size_t ALIGNMENT = 4096;
+
+  // Owns a buffer until destroyed or reassigned, then returns it to the
+  // pool it came from
+  class Buffer {
+  public:
+    Buffer() = default;
+    ~Buffer() { Reset(); }
+
+    Buffer(Buffer &&other) noexcept;
+    Buffer &operator=(Buffer &&other) noexcept;
+
+    // Disable copy
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    // Null if the allocation failed
+    char *Data() const { return m_data.get(); }
+    size_t Size() const { return m_size; }
+
+  private:
+    friend class BufferPool;
+
+    void Reset();
+
+    BufferPool *m_pool = nullptr;
+    Storage m_data;
+    size_t m_size = 0;
+  };
+
+  struct Stats {
+    size_t inUse = 0;         // Bytes held by Buffers
+    size_t highWater = 0;     // Most bytes ever in use at once
+    size_t cached = 0;        // Free bytes kept for reuse
+    uint64_t allocations = 0; // Buffers allocated rather than reused
+    uint64_t failures = 0;    // Acquires that got no memory
+    uint64_t deferred = 0;    // Acquires turned down by the limit
+  };
+
+  explicit BufferPool(size_t maxFreePerSize = 4);
+
+  // Disable copy
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // The process-wide pool
+  static BufferPool &Shared();
+
+  // Returns a buffer of at least size bytes, or one without data if memory
+  // ran out. With withinLimit, also without data if the buffer would take
+  // the bytes in use past the limit; callers that can wait (readers) ask
+  // that way, so the ones that cannot (writers) always get theirs. The
+  // pool must outlive the buffer.
+  Buffer Acquire(size_t size, bool withinLimit = false);
+  // Acquire within the limit that settles for minSize bytes when size does
+  // not fit, so a reader whose reads have grown past what is left of the
+  // limit is not held up for good
+  Buffer AcquireWithin(size_t size, size_t minSize);
+
+  // Caps the bytes in use for Acquire with withinLimit, and keeps the
+  // free buffers within what is left. 0 removes the cap.
+  void SetLimit(size_t bytes);
+
+  Stats GetStats() const;
+
+  // Size class of a request: the smallest power of two >= size
+  static size_t RoundUp(size_t size);
+
+private:
+  void Release(Storage data, size_t size);
+
+  struct FreeList {
+    size_t size = 0;
+    std::vector<Storage> buffers;
+  };
+
+  size_t m_maxFreePerSize;
+  size_t m_limit = 0;
+  mutable std::mutex m_mutex;
+  std::vector<FreeList> m_free;
+  Stats m_stats;
+};
@@ -0,0 +1,71 @@
+#include "ConnectRace.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ConnectRace::ConnectRace(std::vector<HostResolver::Address> addresses)
+    : m_addresses(std::move(addresses)), m_lastError(ECONNREFUSED) {}
+
+ConnectRace::~ConnectRace() {
+  for (const auto &attempt : m_pending) {
+    close(attempt.first);
+  }
+}
+
+int ConnectRace::StartNext() {
+  while (m_next < m_addresses.size()) {
+    size_t index = m_next++;
+    const HostResolver::Address &address = m_addresses[index];
+    int fd = socket(address.storage.ss_family,
+                    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      m_lastError = errno;
+      continue;
+    }
+    int rc = ::connect(fd, reinterpret_cast<const sockaddr *>(&address.storage),
+                       address.length);
+    if (rc != 0 && errno != EINPROGRESS) {
+      m_lastError = errno;
+      close(fd);
+      continue;
+    }
+    m_pending.emplace_back(fd, index);
+    return fd;
+  }
+  return -1;
+}
+
+std::vector<int> ConnectRace::GetPending() const {
+  std::vector<int> pending;
+  for (const auto &attempt : m_pending) {
+    pending.push_back(attempt.first);
+  }
+  return pending;
+}
+
+ConnectRace::Result ConnectRace::Finish(int fd,
+                                       HostResolver::Address &failed) {
+  auto attempt = std::find_if(
+      m_pending.begin(), m_pending.end(),
+      [fd](const std::pair<int, size_t> &item) { return item.first == fd; });
+  if (attempt == m_pending.end()) {
+    return Result::Unknown;
+  }
+  size_t index = attempt->second;
+  m_pending.erase(attempt);
+
+  int socketError = 0;
+  socklen_t length = sizeof(socketError);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &socketError, &length) != 0) {
+    socketError = errno;
+  }
+  if (socketError == 0) {
+    return Result::Connected;
+  }
+
+  m_lastError = socketError;
+  failed = m_addresses[index];
+  close(fd);
+  return Result::Failed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "HostResolver.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Connects to one of a host's addresses the happy eyeballs way (RFC 8305):
+// attempts start one after another, the next once the previous ones have
+// had ATTEMPT_DELAY_MS without an answer or have failed, and the first to
+// connect wins. The caller waits for the pending sockets to become
+// writable. All sockets are non-blocking.
+class ConnectRace {
+public:
+  static constexpr int ATTEMPT_DELAY_MS = 250;
+
+  explicit ConnectRace(std::vector<HostResolver::Address> addresses);
+  // Closes the attempts still pending
+  ~ConnectRace();
+
+  // Disable copy
+  ConnectRace(const ConnectRace &) = delete;
+  ConnectRace &operator=(const ConnectRace &) = delete;
+
+  // Starts a connect to the next address. Returns its socket, or -1 when
+  // every address has been tried; addresses failing at once are skipped.
+  int StartNext();
+  bool HasNext() const { return m_next < m_addresses.size(); }
+  std::vector<int> GetPending() const;
+
+  enum class Result { Connected, Failed, Unknown };
+
+  // Checks an attempt whose socket became writable or reported an error.
+  // If it connected, the socket now belongs to the caller. If it failed, it
+  // is closed and failed is the address it tried. Unknown if fd is not a
+  // pending attempt, e.g. a stale event for a socket already finished.
+  Result Finish(int fd, HostResolver::Address &failed);
+
+  // errno of the last attempt that failed
+  int GetLastError() const { return m_lastError; }
+
+private:
+  std::vector<HostResolver::Address> m_addresses;
+  size_t m_next = 0;
+  std::vector<std::pair<int, size_t>> m_pending; // Socket, address index
+  int m_lastError;
+};
@@ -0,0 +1,101 @@
+#include "ConnectionPool.h"
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+
+ConnectionPool::ConnectionPool(const Limits &limits) : m_limits(limits) {}
+
+ConnectionPool::~ConnectionPool() { Clear(); }
+
+bool ConnectionPool::IsAlive(int fd) {
+  // An idle HTTP connection has nothing to read. Readability means the peer
+  // closed it (EOF) or sent something we cannot use.
+  pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 0;
+}
+
+int ConnectionPool::Acquire(const std::string &key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto now = Clock::now();
+  ReapLocked(now);
+
+  auto it = m_idle.find(key);
+  while (it != m_idle.end() && !it->second.empty()) {
+    // Most recently used first; it is the least likely to have timed out
+    IdleSocket socket = it->second.back();
+    it->second.pop_back();
+    m_idleCount--;
+
+    if (IsAlive(socket.fd)) {
+      m_stats.reused++;
+      return socket.fd;
+    }
+    close(socket.fd);
+    m_stats.discarded++;
+  }
+
+  m_stats.missed++;
+  return -1;
+}
+
+void ConnectionPool::Release(const std::string &key, int fd) {
+  if (fd < 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto now = Clock::now();
+  ReapLocked(now);
+
+  auto &sockets = m_idle[key];
+  if (sockets.size() >= m_limits.maxIdlePerHost ||
+      m_idleCount >= m_limits.maxIdle) {
+    close(fd);
+    m_stats.discarded++;
+    return;
+  }
+
+  sockets.push_back({fd, now});
+  m_idleCount++;
+}
+
+void ConnectionPool::Reap() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ReapLocked(Clock::now());
+}
+
+void ConnectionPool::ReapLocked(Clock::time_point now) {
+  auto timeout = std::chrono::milliseconds(m_limits.idleTimeoutMs);
+
+  for (auto it = m_idle.begin(); it != m_idle.end();) {
+    auto &sockets = it->second;
+    // Oldest first, so expired sockets form a prefix
+    auto firstFresh =
+        std::find_if(sockets.begin(), sockets.end(),
+                     [&](const IdleSocket &s) { return now - s.since < timeout; });
+    for (auto s = sockets.begin(); s != firstFresh; ++s) {
+      close(s->fd);
+      m_stats.discarded++;
+      m_idleCount--;
+    }
+    sockets.erase(sockets.begin(), firstFresh);
+
+    it = sockets.empty() ? m_idle.erase(it) : std::next(it);
+  }
+}
+
+void ConnectionPool::Clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &entry : m_idle) {
+    for (auto &socket : entry.second) {
+      close(socket.fd);
+    }
+  }
+  m_idle.clear();
+  m_idleCount = 0;
+}
+
+ConnectionPool::Stats ConnectionPool::GetStats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
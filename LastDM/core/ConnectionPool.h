@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Idle keep-alive sockets of the socket based transports, keyed by the
+// "host:port" they are connected to. Shared by all downloads; thread-safe.
+class ConnectionPool {
+public:
+  struct Limits {
+    size_t maxIdlePerHost = 32;
+    size_t maxIdle = 128;
+    long idleTimeoutMs = 30000;
+  };
+
+  struct Stats {
+    uint64_t reused = 0;    // Acquire calls served from the pool
+    uint64_t missed = 0;    // Acquire calls that found nothing usable
+    uint64_t discarded = 0; // Sockets closed as stale, expired or surplus
+  };
+
+  explicit ConnectionPool(const Limits &limits);
+  ~ConnectionPool();
+
+  // Disable copy
+  ConnectionPool(const ConnectionPool &) = delete;
+  ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+  // Returns an idle socket for key, or -1. Sockets the peer has closed in
+  // the meantime are dropped rather than handed out.
+  int Acquire(const std::string &key);
+  // Takes ownership of a socket whose last response was fully read
+  void Release(const std::string &key, int fd);
+  // Closes sockets idle for longer than the timeout
+  void Reap();
+  void Clear();
+
+  Stats GetStats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct IdleSocket {
+    int fd;
+    Clock::time_point since;
+  };
+
+  Limits m_limits;
+  mutable std::mutex m_mutex;
+  std::map<std::string, std::vector<IdleSocket>> m_idle; // Newest last
+  size_t m_idleCount = 0;
+  Stats m_stats;
+
+  void ReapLocked(Clock::time_point now);
+  static bool IsAlive(int fd);
+};
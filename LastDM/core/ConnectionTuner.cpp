@@ -0,0 +1,50 @@
+#include "ConnectionTuner.h"
+#include <algorithm>
+
+ConnectionTuner::ConnectionTuner(int initial, int maximum)
+    : m_target(std::max(1, std::min(initial, maximum))),
+      m_maximum(std::max(1, maximum)), m_bestCount(m_target) {}
+
+int ConnectionTuner::GetTarget() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_target;
+}
+
+bool ConnectionTuner::IsSettled() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_settled;
+}
+
+int ConnectionTuner::Update(double speed) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_throttled = false;
+  if (m_settled) {
+    return m_target;
+  }
+
+  if (speed > m_bestSpeed * (1.0 + MIN_GAIN)) {
+    m_bestSpeed = speed;
+    m_bestCount = m_target;
+    if (m_target < m_maximum) {
+      ++m_target;
+    } else {
+      m_settled = true;
+    }
+  } else {
+    // The last step did not pay off
+    m_target = m_bestCount;
+    m_settled = true;
+  }
+  return m_target;
+}
+
+void ConnectionTuner::Throttle() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_throttled) {
+    return;
+  }
+  m_throttled = true;
+  m_target = std::max(1, m_target / 2);
+  m_bestCount = m_target;
+  m_settled = true;
+}
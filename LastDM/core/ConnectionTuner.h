@@ -0,0 +1,39 @@
+#pragma once
+
+#include <mutex>
+
+// Picks how many connections a segmented download uses. Starts low and
+// adds one while the combined speed keeps improving; once it levels off
+// the count goes back to the best one seen and stays there. A server that
+// turns requests away as overloaded halves it. Thread-safe.
+class ConnectionTuner {
+public:
+  ConnectionTuner(int initial, int maximum);
+
+  // Disable copy
+  ConnectionTuner(const ConnectionTuner &) = delete;
+  ConnectionTuner &operator=(const ConnectionTuner &) = delete;
+
+  int GetTarget() const;
+  // Whether the count stopped changing (apart from throttling)
+  bool IsSettled() const;
+
+  // Reports the combined speed reached with the current count since the
+  // last call; returns the new count
+  int Update(double speed);
+  // The server answered 429 or 503. Answers to requests sent together
+  // count once: the count is halved at most once between updates.
+  void Throttle();
+
+private:
+  // A step counts as an improvement above this gain
+  static constexpr double MIN_GAIN = 0.1;
+
+  mutable std::mutex m_mutex;
+  int m_target;
+  int m_maximum;
+  int m_bestCount;
+  double m_bestSpeed = 0.0;
+  bool m_settled = false;
+  bool m_throttled = false; // Since the last update
+};
@@ -2,11 +2,13 @@
 #include <algorithm>
 #include <ctime>
 #include <iomanip>
+#include <random>
 #include <sstream>
 
 Download::Download(int id, const std::string &url, const std::string &savePath)
     : m_id(id), m_url(url), m_savePath(savePath), m_totalSize(-1),
-      m_downloadedSize(0), m_status(DownloadStatus::Queued), m_speed(0.0) {
+      m_downloadedSize(0), m_status(DownloadStatus::Queued), m_speed(0.0),
+      m_resumable(false) {
   m_filename = ExtractFilenameFromUrl(url);
   m_category = DetermineCategory(m_filename);
   UpdateLastTryTime();
@@ -91,6 +93,16 @@ std::string Download::GetCalculatedChecksum() const {
   return m_calculatedChecksum;
 }
 
+std::string Download::GetETag() const {
+  std::lock_guard<std::mutex> lock(m_metadataMutex);
+  return m_etag;
+}
+
+std::string Download::GetLastModified() const {
+  std::lock_guard<std::mutex> lock(m_metadataMutex);
+  return m_lastModified;
+}
+
 void Download::SetFilename(const std::string &filename) {
   std::lock_guard<std::mutex> lock(m_metadataMutex);
   m_filename = filename;
@@ -111,6 +123,23 @@ void Download::SetErrorMessage(const std::string &msg) {
   m_errorMessage = msg;
 }
 
+void Download::SetValidators(const std::string &etag,
+                             const std::string &lastModified) {
+  std::lock_guard<std::mutex> lock(m_metadataMutex);
+  m_etag = etag;
+  m_lastModified = lastModified;
+}
+
+std::vector<std::string> Download::GetMirrors() const {
+  std::lock_guard<std::mutex> lock(m_metadataMutex);
+  return m_mirrors;
+}
+
+void Download::SetMirrors(const std::vector<std::string> &mirrors) {
+  std::lock_guard<std::mutex> lock(m_metadataMutex);
+  m_mirrors = mirrors;
+}
+
 void Download::SetSavePath(const std::string &path) {
   std::lock_guard<std::mutex> lock(m_metadataMutex);
   m_savePath = path;
@@ -120,7 +149,11 @@ void Download::UpdateLastTryTime() {
   auto now = std::chrono::system_clock::now();
   std::time_t time = std::chrono::system_clock::to_time_t(now);
   std::tm tm;
+#ifdef _WIN32
   localtime_s(&tm, &time);
+#else
+  localtime_r(&time, &tm);
+#endif
 
   std::stringstream ss;
   ss << std::put_time(&tm, "%Y-%m-%d %H:%M");
@@ -141,19 +174,34 @@ void Download::SetCalculatedChecksum(const std::string &hash) {
   m_calculatedChecksum = hash;
 }
 
-void Download::InitializeChunks(int numConnections) {
+void Download::InitializeChunks(int numConnections, int64_t completedBytes) {
   std::lock_guard<std::mutex> lock(m_chunksMutex);
   m_chunks.clear();
 
   int64_t totalSize = m_totalSize.load();
-  if (totalSize <= 0 || numConnections <= 1) {
+  if (completedBytes < 0 || (totalSize > 0 && completedBytes >= totalSize)) {
+    completedBytes = 0;
+  }
+
+  // Keep the already downloaded prefix as a finished chunk so progress and
+  // offsets stay relative to the start of the file
+  if (completedBytes > 0) {
+    m_chunks.emplace_back(0, completedBytes - 1);
+    m_chunks.back().currentByte = completedBytes;
+    m_chunks.back().completed = true;
+  }
+
+  int64_t remaining = totalSize - completedBytes;
+  if (totalSize <= 0 || numConnections <= 1 || remaining < numConnections) {
     // Single chunk for unknown size or single connection
-    m_chunks.emplace_back(0, totalSize > 0 ? totalSize - 1 : INT64_MAX);
+    m_chunks.emplace_back(completedBytes,
+                          totalSize > 0 ? totalSize - 1 : INT64_MAX);
+    RecalculateProgress();
     return;
   }
 
-  int64_t chunkSize = totalSize / numConnections;
-  int64_t startByte = 0;
+  int64_t chunkSize = remaining / numConnections;
+  int64_t startByte = completedBytes;
 
   for (int i = 0; i < numConnections; ++i) {
     int64_t endByte = (i == numConnections - 1)
@@ -162,21 +210,210 @@ void Download::InitializeChunks(int numConnections) {
     m_chunks.emplace_back(startByte, endByte);
     startByte = endByte + 1;
   }
+
+  RecalculateProgress();
+}
+
+void Download::RestoreChunks(const std::vector<DownloadChunk> &chunks) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  m_chunks.clear();
+  for (const DownloadChunk &saved : chunks) {
+    m_chunks.emplace_back(saved.startByte, saved.endByte);
+    DownloadChunk &chunk = m_chunks.back();
+    chunk.currentByte =
+        std::max(saved.startByte, std::min(saved.currentByte,
+                                           saved.endByte + 1));
+    chunk.completed = chunk.currentByte > chunk.endByte;
+  }
+
+  RecalculateProgress();
+}
+
+std::vector<DownloadChunk> Download::GetChunks() const {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  return m_chunks;
+}
+
+bool Download::GetChunk(int chunkIndex, DownloadChunk &chunk) const {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (chunkIndex < 0 || chunkIndex >= static_cast<int>(m_chunks.size())) {
+    return false;
+  }
+  chunk = m_chunks[chunkIndex];
+  return true;
+}
+
+int64_t Download::GetChunkEnd(int chunkIndex) const {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (chunkIndex < 0 || chunkIndex >= static_cast<int>(m_chunks.size())) {
+    return -1;
+  }
+  return m_chunks[chunkIndex].endByte;
 }
 
 void Download::UpdateChunkProgress(int chunkIndex, int64_t currentByte) {
   std::lock_guard<std::mutex> lock(m_chunksMutex);
 
   if (chunkIndex >= 0 && chunkIndex < static_cast<int>(m_chunks.size())) {
-    m_chunks[chunkIndex].currentByte = currentByte;
-    if (currentByte >= m_chunks[chunkIndex].endByte) {
-      m_chunks[chunkIndex].completed = true;
+    DownloadChunk &chunk = m_chunks[chunkIndex];
+    // A steal may have moved the end below a read already in flight; the
+    // bytes past it belong to the chunk that took them
+    if (!chunk.IsOpenEnded()) {
+      currentByte = std::min(currentByte, chunk.endByte + 1);
+    }
+    chunk.currentByte = currentByte;
+    if (currentByte > chunk.endByte) {
+      chunk.completed = true;
     }
   }
 
   RecalculateProgress();
 }
 
+void Download::SetChunkSpeed(int chunkIndex, double speed) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (chunkIndex >= 0 && chunkIndex < static_cast<int>(m_chunks.size())) {
+    m_chunks[chunkIndex].speed = speed;
+  }
+}
+
+int Download::RecordReconnect(int chunkIndex) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (chunkIndex < 0 || chunkIndex >= static_cast<int>(m_chunks.size())) {
+    return 0;
+  }
+
+  DownloadChunk &chunk = m_chunks[chunkIndex];
+  if (chunk.currentByte != chunk.reconnectByte) {
+    chunk.reconnects = 0;
+    chunk.reconnectByte = chunk.currentByte;
+  }
+  return ++chunk.reconnects;
+}
+
+void Download::CompleteChunk(int chunkIndex) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+
+  if (chunkIndex >= 0 && chunkIndex < static_cast<int>(m_chunks.size())) {
+    DownloadChunk &chunk = m_chunks[chunkIndex];
+    chunk.endByte = chunk.currentByte - 1;
+    chunk.completed = true;
+  }
+
+  RecalculateProgress();
+}
+
+void Download::RewindChunk(int64_t offset) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+
+  for (auto &chunk : m_chunks) {
+    if (offset >= chunk.startByte && offset <= chunk.endByte &&
+        offset < chunk.currentByte) {
+      chunk.currentByte = offset;
+      chunk.completed = false;
+    }
+  }
+
+  RecalculateProgress();
+}
+
+bool Download::AreAllChunksCompleted() const {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (m_chunks.empty()) {
+    return false;
+  }
+  return std::all_of(m_chunks.begin(), m_chunks.end(),
+                     [](const DownloadChunk &c) { return c.completed; });
+}
+
+bool Download::HasValidChunkMap() const {
+  return IsValidChunkMap(GetChunks(), m_totalSize.load());
+}
+
+bool Download::IsValidChunkMap(std::vector<DownloadChunk> chunks,
+                               int64_t totalSize) {
+  if (totalSize <= 0 || chunks.empty()) {
+    return false;
+  }
+
+  std::sort(chunks.begin(), chunks.end(),
+            [](const DownloadChunk &a, const DownloadChunk &b) {
+              return a.startByte < b.startByte;
+            });
+
+  int64_t expectedStart = 0;
+  for (const auto &chunk : chunks) {
+    if (chunk.startByte != expectedStart || chunk.endByte < chunk.startByte ||
+        chunk.currentByte < chunk.startByte ||
+        chunk.currentByte > chunk.endByte + 1) {
+      return false;
+    }
+    expectedStart = chunk.endByte + 1;
+  }
+
+  return expectedStart == totalSize;
+}
+
+int Download::AcquireChunk(int64_t minStealSize) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+
+  for (size_t i = 0; i < m_chunks.size(); ++i) {
+    if (!m_chunks[i].completed && !m_chunks[i].active) {
+      m_chunks[i].active = true;
+      return static_cast<int>(i);
+    }
+  }
+
+  if (minStealSize <= 0) {
+    return -1;
+  }
+
+  // Work stealing: pick the in-flight chunk with the longest estimated time
+  // to completion
+  int victim = -1;
+  double worstEta = 0.0;
+  for (size_t i = 0; i < m_chunks.size(); ++i) {
+    const DownloadChunk &chunk = m_chunks[i];
+    if (!chunk.active || chunk.completed || chunk.IsOpenEnded()) {
+      continue;
+    }
+
+    int64_t remaining = chunk.GetRemaining();
+    if (remaining < 2 * minStealSize) {
+      continue;
+    }
+
+    double eta = static_cast<double>(remaining) / std::max(chunk.speed, 1.0);
+    if (victim < 0 || eta > worstEta) {
+      victim = static_cast<int>(i);
+      worstEta = eta;
+    }
+  }
+
+  if (victim < 0) {
+    return -1;
+  }
+
+  // The victim keeps the lower half; its connection stops at the new end.
+  // New chunks are appended so indices held by other connections stay valid.
+  DownloadChunk &chunk = m_chunks[victim];
+  int64_t splitAt = chunk.currentByte + chunk.GetRemaining() / 2;
+  DownloadChunk stolen(splitAt, chunk.endByte);
+  stolen.active = true;
+  chunk.endByte = splitAt - 1;
+  m_chunks.push_back(stolen);
+
+  return static_cast<int>(m_chunks.size()) - 1;
+}
+
+void Download::ReleaseChunk(int chunkIndex) {
+  std::lock_guard<std::mutex> lock(m_chunksMutex);
+  if (chunkIndex >= 0 && chunkIndex < static_cast<int>(m_chunks.size())) {
+    m_chunks[chunkIndex].active = false;
+    m_chunks[chunkIndex].speed = 0.0;
+  }
+}
+
 void Download::RecalculateProgress() {
   int64_t totalDownloaded = 0;
 
@@ -283,7 +520,8 @@ int Download::GetRetryDelayMs() const {
   // Exponential backoff: 1s, 2s, 4s, 8s, 16s, ...
   // Formula: baseDelay * 2^retryCount
   constexpr int BASE_DELAY_MS = 1000;
-  int delay = BASE_DELAY_MS * (1 << m_retryCount); // 2^retryCount
+  // Broken reads count as retries too, so the count can outgrow the shift
+  int delay = BASE_DELAY_MS * (1 << std::min(m_retryCount.load(), 6));
 
   // Cap at 60 seconds maximum
   constexpr int MAX_DELAY_MS = 60000;
@@ -293,13 +531,39 @@ int Download::GetRetryDelayMs() const {
 void Download::IncrementRetry() {
   m_retryCount++;
 
-  // Calculate and set next retry time
+  // Calculate and set next retry time. Half the delay is random, so
+  // downloads that failed together do not all retry at the same moment.
   int delayMs = GetRetryDelayMs();
-  m_nextRetryTime =
+  thread_local std::mt19937 random{std::random_device{}()};
+  delayMs = delayMs / 2 +
+            std::uniform_int_distribution<int>(0, delayMs / 2)(random);
+  auto next =
       std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+  m_nextRetryTime = next.time_since_epoch().count();
+}
+
+bool Download::ConsumeRetry() {
+  int count = m_retryCount.load();
+  while (count < m_maxRetries) {
+    if (m_retryCount.compare_exchange_weak(count, count + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Download::PostponeRetry(int64_t delayMs) {
+  auto earliest =
+      (std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs))
+          .time_since_epoch()
+          .count();
+  auto next = m_nextRetryTime.load();
+  while (next < earliest &&
+         !m_nextRetryTime.compare_exchange_weak(next, earliest)) {
+  }
 }
 
 void Download::ResetRetry() {
   m_retryCount = 0;
-  m_nextRetryTime = std::chrono::steady_clock::time_point{};
+  m_nextRetryTime = 0;
 }
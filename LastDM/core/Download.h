@@ -1,7 +1,9 @@
 #pragma once
 
+#include "BandwidthLimiter.h"
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -20,19 +22,33 @@ enum class DownloadStatus {
 };
 
 struct DownloadChunk {
-  int64_t startByte;
-  int64_t endByte;
-  int64_t currentByte;
+  int64_t startByte;   // First byte of the range (inclusive)
+  int64_t endByte;     // Last byte of the range (inclusive)
+  int64_t currentByte; // Next byte to be written
   bool completed;
+  bool active;  // A connection is currently fetching this chunk
+  double speed; // Throughput of that connection in bytes per second
+  // Reads broken off in a row, and where the last one stopped
+  int reconnects;
+  int64_t reconnectByte;
 
   DownloadChunk(int64_t start, int64_t end)
-      : startByte(start), endByte(end), currentByte(start), completed(false) {}
+      : startByte(start), endByte(end), currentByte(start), completed(false),
+        active(false), speed(0.0), reconnects(0), reconnectByte(-1) {}
+
+  bool IsOpenEnded() const { return endByte == INT64_MAX; }
+
+  int64_t GetRemaining() const {
+    if (completed)
+      return 0;
+    return IsOpenEnded() ? INT64_MAX : endByte - currentByte + 1;
+  }
 
   double GetProgress() const {
-    if (endByte <= startByte)
+    if (endByte < startByte)
       return 100.0;
     return static_cast<double>(currentByte - startByte) /
-           (endByte - startByte) * 100.0;
+           (static_cast<double>(endByte) - startByte + 1) * 100.0;
   }
 };
 
@@ -59,11 +75,12 @@ public:
   std::string GetErrorMessage() const;
 
   // Retry support
-  int GetRetryCount() const { return m_retryCount; }
+  int GetRetryCount() const { return m_retryCount.load(); }
   int GetMaxRetries() const { return m_maxRetries; }
   bool ShouldRetry() const;
   std::chrono::steady_clock::time_point GetNextRetryTime() const {
-    return m_nextRetryTime;
+    return std::chrono::steady_clock::time_point(
+        std::chrono::steady_clock::duration(m_nextRetryTime.load()));
   }
   int GetRetryDelayMs() const; // Get current delay in milliseconds
 
@@ -90,6 +107,10 @@ public:
   // Retry support
   void SetMaxRetries(int maxRetries) { m_maxRetries = maxRetries; }
   void IncrementRetry(); // Increment retry count and calculate next retry time
+  // Takes one retry for a read that broke off mid-body, if any are left
+  bool ConsumeRetry();
+  // Moves the next retry to at least delayMs from now (e.g. Retry-After)
+  void PostponeRetry(int64_t delayMs);
   void ResetRetry();     // Reset retry count (on success or user restart)
 
   // Checksum support
@@ -97,10 +118,61 @@ public:
   void SetCalculatedChecksum(const std::string &hash);
   void SetChecksumVerified(bool verified) { m_checksumVerified = verified; }
 
+  // Resumability reported by the server (Accept-Ranges)
+  bool IsResumable() const { return m_resumable.load(); }
+  void SetResumable(bool resumable) { m_resumable = resumable; }
+
+  // Validators of the remote file (ETag and Last-Modified headers), empty
+  // if the server sent none
+  std::string GetETag() const;
+  std::string GetLastModified() const;
+  void SetValidators(const std::string &etag,
+                     const std::string &lastModified);
+
+  // Other URLs serving the same file; segments are spread across them and
+  // the main URL
+  std::vector<std::string> GetMirrors() const;
+  void SetMirrors(const std::vector<std::string> &mirrors);
+
+  // Own speed limit in bytes per second (0 = none), nested under the host,
+  // category and global limits
+  int64_t GetSpeedLimit() const { return m_bandwidthLimiter.GetRate(); }
+  void SetSpeedLimit(int64_t bytesPerSecond) {
+    m_bandwidthLimiter.SetRate(bytesPerSecond);
+  }
+  BandwidthLimiter &GetBandwidthLimiter() { return m_bandwidthLimiter; }
+
   // Chunk management
-  void InitializeChunks(int numConnections);
-  std::vector<DownloadChunk> &GetChunks() { return m_chunks; }
+  // Splits the remaining range into numConnections chunks. The first
+  // completedBytes are recorded as an already finished chunk.
+  void InitializeChunks(int numConnections, int64_t completedBytes = 0);
+  // Takes over a chunk map saved by an earlier run, none of it active
+  void RestoreChunks(const std::vector<DownloadChunk> &chunks);
+  std::vector<DownloadChunk> GetChunks() const;
+  bool GetChunk(int chunkIndex, DownloadChunk &chunk) const;
+  int64_t GetChunkEnd(int chunkIndex) const;
   void UpdateChunkProgress(int chunkIndex, int64_t currentByte);
+  void SetChunkSpeed(int chunkIndex, double speed);
+  void CompleteChunk(int chunkIndex); // Ends an open-ended chunk at EOF
+  // Counts a read of the chunk that broke off; returns how many did in a
+  // row, without any data arriving in between
+  int RecordReconnect(int chunkIndex);
+  // Moves the chunk holding offset back to it, e.g. when the data from
+  // there on never reached the disk
+  void RewindChunk(int64_t offset);
+  bool AreAllChunksCompleted() const;
+  // True if the chunks tile [0, totalSize) without gaps or overlaps
+  bool HasValidChunkMap() const;
+  static bool IsValidChunkMap(std::vector<DownloadChunk> chunks,
+                              int64_t totalSize);
+
+  // Connection assignment: returns the index of an unassigned, unfinished
+  // chunk and marks it active. When none is left and minStealSize > 0, the
+  // upper half of the active chunk expected to finish last is split off
+  // (both halves must keep at least minStealSize bytes). Returns -1 when
+  // there is nothing left to fetch.
+  int AcquireChunk(int64_t minStealSize = 0);
+  void ReleaseChunk(int chunkIndex);
 
   // Progress calculation
   void RecalculateProgress();
@@ -116,13 +188,20 @@ private:
   std::string m_category;
   std::string m_description;
   std::atomic<double> m_speed;
+  std::atomic<bool> m_resumable;
+  std::string m_etag;
+  std::string m_lastModified;
+  std::vector<std::string> m_mirrors;
+  BandwidthLimiter m_bandwidthLimiter;
   std::string m_lastTryTime;
   std::string m_errorMessage;
 
   // Retry tracking for exponential backoff
-  int m_retryCount = 0; // Current retry attempt (0 = first try)
+  std::atomic<int> m_retryCount{0}; // Current retry attempt (0 = first try)
   int m_maxRetries = 5; // Maximum retry attempts
-  std::chrono::steady_clock::time_point m_nextRetryTime; // When to retry next
+  // When to retry next, as steady_clock ticks: set by the workers, read by
+  // the retry scheduler and the UI
+  std::atomic<std::chrono::steady_clock::rep> m_nextRetryTime{0};
 
   // Checksum verification
   std::string m_expectedChecksum;   // User-provided expected hash
@@ -1,157 +1,82 @@
 #include "DownloadEngine.h"
+#include "EngineConfig.h"
+#include "HttpProtocol.h"
+#include "ResumeFile.h"
 #include <algorithm>
 #include <cctype>
 #include <chrono>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <future>
 #include <iostream>
 
-
-namespace Config {
-constexpr long CONNECT_TIMEOUT_MS = 30000;
-constexpr long RECEIVE_TIMEOUT_MS = 30000;
-} // namespace Config
-
-void DownloadEngine::ConfigureSessionTimeouts(HINTERNET session) {
-  if (!session) {
-    return;
-  }
-
-  DWORD timeout = Config::CONNECT_TIMEOUT_MS;
-  InternetSetOption(session, INTERNET_OPTION_CONNECT_TIMEOUT, &timeout,
-                    sizeof(DWORD));
-  timeout = Config::RECEIVE_TIMEOUT_MS;
-  InternetSetOption(session, INTERNET_OPTION_RECEIVE_TIMEOUT, &timeout,
-                    sizeof(DWORD));
-}
-
-HINTERNET DownloadEngine::OpenSession(const std::string &userAgent,
-                                      const std::string &proxyUrl) {
-  return InternetOpenA(
-      userAgent.c_str(),
-      proxyUrl.empty() ? INTERNET_OPEN_TYPE_PRECONFIG : INTERNET_OPEN_TYPE_PROXY,
-      proxyUrl.empty() ? NULL : proxyUrl.c_str(), NULL, 0);
-}
-
-void DownloadEngine::CloseSessionHandle(
-    const std::shared_ptr<SessionEntry> &entry) {
-  if (!entry) {
-    return;
-  }
-
-  std::lock_guard<std::mutex> lock(entry->handleMutex);
-  if (entry->handle) {
-    InternetCloseHandle(entry->handle);
-    entry->handle = nullptr;
-  }
-}
-
-void DownloadEngine::CloseSessionIfIdle(
-    const std::shared_ptr<SessionEntry> &entry) {
-  if (!entry) {
-    return;
-  }
-
-  if (entry->closing.load() && entry->activeCount.load() == 0) {
-    CloseSessionHandle(entry);
-  }
-}
-
-DownloadEngine::SessionUsage::SessionUsage(
-    std::shared_ptr<SessionEntry> entry)
-    : m_entry(std::move(entry)) {
-  if (m_entry) {
-    m_entry->activeCount.fetch_add(1);
-  }
-}
-
-DownloadEngine::SessionUsage::~SessionUsage() {
-  if (!m_entry) {
-    return;
-  }
-
-  int remaining = m_entry->activeCount.fetch_sub(1) - 1;
-  if (remaining == 0 && m_entry->closing.load()) {
-    CloseSessionHandle(m_entry);
-  }
-}
-
-HINTERNET DownloadEngine::SessionUsage::handle() const {
-  return m_entry ? m_entry->handle : nullptr;
-}
-
-bool DownloadEngine::ParseContentRangeStart(const std::string &value,
-                                            int64_t &startOut) {
-  size_t spacePos = value.find(' ');
-  if (spacePos == std::string::npos) {
-    return false;
-  }
-
-  size_t startPos = spacePos + 1;
-  while (startPos < value.size() &&
-         std::isspace(static_cast<unsigned char>(value[startPos]))) {
-    startPos++;
-  }
-
-  size_t dashPos = value.find('-', startPos);
-  if (dashPos == std::string::npos || dashPos == startPos) {
-    return false;
-  }
-
-  std::string startStr = value.substr(startPos, dashPos - startPos);
-  char *endPtr = nullptr;
-  int64_t parsed = _strtoi64(startStr.c_str(), &endPtr, 10);
-  if (!endPtr || endPtr == startStr.c_str() || *endPtr != '\0') {
-    return false;
-  }
-
-  startOut = parsed;
-  return true;
-}
+#ifndef _WIN32
+#include "ConnectionPool.h"
+#include "HostResolver.h"
+#endif
+#ifdef __linux__
+#include "EventLoop.h"
+#endif
 
 DownloadEngine::DownloadEngine()
-    : m_maxConnections(8), m_useNativeCAStore(true),
-      m_state(std::make_shared<EngineState>()) {
+    : m_useNativeCAStore(true), m_state(std::make_shared<EngineState>()) {
   m_state->userAgent = "LastDownloadManager/1.0";
   m_state->proxyUrl.clear();
   m_state->verifySSL.store(true);
-  m_state->speedLimitBytes.store(0);
-
-  auto entry = std::make_shared<SessionEntry>();
-  entry->handle = OpenSession(m_state->userAgent, m_state->proxyUrl);
-  if (entry->handle) {
-    ConfigureSessionTimeouts(entry->handle);
-  }
 
-  m_state->session = entry;
-  m_state->running.store(entry->handle != nullptr);
+#ifndef _WIN32
+  ConnectionPool::Limits limits;
+  limits.maxIdlePerHost = Config::POOL_MAX_IDLE_PER_HOST;
+  limits.maxIdle = Config::POOL_MAX_IDLE;
+  limits.idleTimeoutMs = Config::POOL_IDLE_TIMEOUT_MS;
+  m_state->connectionPool = std::make_shared<ConnectionPool>(limits);
+
+  HostResolver::Limits resolverLimits;
+  resolverLimits.ttlMs = Config::RESOLVER_TTL_MS;
+  resolverLimits.failureTtlMs = Config::RESOLVER_FAILURE_TTL_MS;
+  resolverLimits.maxEntries = Config::RESOLVER_MAX_HOSTS;
+  m_state->resolver = std::make_shared<HostResolver>(resolverLimits);
+#endif
+
+  HttpTransportOptions options;
+  options.userAgent = m_state->userAgent;
+  options.connectTimeoutMs = Config::CONNECT_TIMEOUT_MS;
+  options.receiveTimeoutMs = Config::RECEIVE_TIMEOUT_MS;
+  options.maxConnectionsPerHost = Config::MAX_CONNECTIONS_PER_HOST;
+  options.connectionPool = m_state->connectionPool;
+  options.resolver = m_state->resolver;
+  m_state->transport = HttpTransport::Create(options);
+  m_state->running.store(m_state->transport != nullptr);
+
+  // A download still waiting in Error is started again; one the user
+  // paused, cancelled or restarted in the meantime is left alone
+  m_state->retryScheduler = std::make_unique<RetryScheduler>(
+      [this](const std::shared_ptr<Download> &download) {
+        if (download->GetStatus() == DownloadStatus::Error) {
+          StartDownload(download);
+        }
+      },
+      Config::RETRY_TICK_MS, Config::RETRY_WHEEL_SLOTS);
 }
 
 DownloadEngine::~DownloadEngine() {
   if (m_state) {
     m_state->running.store(false);
+    m_state->retryScheduler->Stop();
 
-    std::shared_ptr<SessionEntry> currentSession;
-    std::vector<std::shared_ptr<SessionEntry>> retiredSessions;
+#ifdef __linux__
+    // Transfers still on a loop are dropped with it; they report nothing
+    // once the engine stopped running
+    std::vector<std::shared_ptr<EventLoop>> loops;
     {
-      std::lock_guard<std::mutex> lock(m_state->sessionMutex);
-      currentSession = m_state->session;
-      retiredSessions = m_state->retiredSessions;
+      std::lock_guard<std::mutex> lock(m_state->loopMutex);
+      loops.swap(m_state->loops);
     }
-
-    if (currentSession) {
-      currentSession->closing.store(true);
-      CloseSessionIfIdle(currentSession);
-    }
-
-    for (const auto &entry : retiredSessions) {
-      if (!entry) {
-        continue;
-      }
-      entry->closing.store(true);
-      CloseSessionIfIdle(entry);
+    for (auto &loop : loops) {
+      loop->Stop();
     }
+#endif
   }
 
   std::vector<std::future<bool>> activeDownloads;
@@ -171,11 +96,8 @@ DownloadEngine::~DownloadEngine() {
   }
 
   if (m_state) {
-    std::lock_guard<std::mutex> lock(m_state->sessionMutex);
-    for (const auto &entry : m_state->retiredSessions) {
-      CloseSessionIfIdle(entry);
-    }
-    CloseSessionIfIdle(m_state->session);
+    std::lock_guard<std::mutex> lock(m_state->transportMutex);
+    m_state->transport.reset();
   }
 }
 
@@ -197,12 +119,60 @@ void DownloadEngine::SetCompletionCallback(CompletionCallback callback) {
   m_state->completionCallback = callback;
 }
 
+void DownloadEngine::SetMetadataCallback(MetadataCallback callback) {
+  if (!m_state) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_state->callbackMutex);
+  m_state->metadataCallback = callback;
+}
+
+void DownloadEngine::SetMaxConnections(int connections) {
+  if (!m_state) {
+    return;
+  }
+
+  m_state->maxConnections.store(
+      std::max(1, std::min(connections, Config::MAX_CONNECTIONS)));
+  ApplyMemoryBudget(*m_state);
+}
+
+void DownloadEngine::SetAdaptiveConnections(bool enabled) {
+  if (!m_state) {
+    return;
+  }
+
+  m_state->adaptiveConnections.store(enabled);
+}
+
 void DownloadEngine::SetSpeedLimit(int64_t bytesPerSecond) {
   if (!m_state) {
     return;
   }
 
-  m_state->speedLimitBytes.store(bytesPerSecond);
+  m_state->bandwidthLimiter.SetRate(bytesPerSecond);
+}
+
+void DownloadEngine::SetHostSpeedLimit(const std::string &host,
+                                       int64_t bytesPerSecond) {
+  if (!m_state) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_state->limiterMutex);
+  AcquireLimiter(m_state->hostLimiters, HttpProtocol::ToLower(host))
+      ->SetRate(bytesPerSecond);
+}
+
+void DownloadEngine::SetCategorySpeedLimit(const std::string &category,
+                                           int64_t bytesPerSecond) {
+  if (!m_state) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_state->limiterMutex);
+  AcquireLimiter(m_state->categoryLimiters, category)->SetRate(bytesPerSecond);
 }
 
 void DownloadEngine::SetUserAgent(const std::string &userAgent) {
@@ -210,7 +180,7 @@ void DownloadEngine::SetUserAgent(const std::string &userAgent) {
     return;
   }
 
-  std::lock_guard<std::mutex> lock(m_state->sessionMutex);
+  std::lock_guard<std::mutex> lock(m_state->transportMutex);
   m_state->userAgent = userAgent;
 }
 
@@ -230,90 +200,142 @@ bool DownloadEngine::GetSSLVerification() const {
   return m_state->verifySSL.load();
 }
 
-void DownloadEngine::CleanupRetiredSessions(
-    const std::shared_ptr<EngineState> &state) {
-  if (!state) {
+void DownloadEngine::SetZeroCopy(bool enabled) {
+  if (!m_state) {
     return;
   }
 
-  std::lock_guard<std::mutex> lock(state->sessionMutex);
-  auto &retired = state->retiredSessions;
-  retired.erase(
-      std::remove_if(retired.begin(), retired.end(),
-                     [](const std::shared_ptr<SessionEntry> &entry) {
-                       if (!entry) {
-                         return true;
-                       }
-                       if (entry->closing.load() &&
-                           entry->activeCount.load() == 0) {
-                         CloseSessionHandle(entry);
-                       }
-                       return entry->activeCount.load() == 0 &&
-                              entry->handle == nullptr;
-                     }),
-      retired.end());
+  m_state->zeroCopy.store(enabled);
 }
 
-bool DownloadEngine::GetFileInfo(const std::string &url, int64_t &fileSize,
-                                 bool &resumable) {
-  if (!m_state || !m_state->running.load())
-    return false;
+void DownloadEngine::SetAsyncFileIo(bool enabled) {
+  if (!m_state) {
+    return;
+  }
 
-  std::shared_ptr<SessionEntry> sessionEntry;
-  {
-    std::lock_guard<std::mutex> lock(m_state->sessionMutex);
-    sessionEntry = m_state->session;
+  m_state->asyncFileIo.store(enabled);
+}
+
+void DownloadEngine::SetMemoryBudget(int64_t bytes) {
+  if (!m_state) {
+    return;
   }
 
-  if (!sessionEntry || !sessionEntry->handle)
-    return false;
+  m_state->memoryBudget.store(std::max<int64_t>(bytes, 0));
+  ApplyMemoryBudget(*m_state);
+}
 
-  SessionUsage sessionUsage(sessionEntry);
-  HINTERNET hSession = sessionUsage.handle();
-  if (!hSession)
-    return false;
+int64_t DownloadEngine::MinMemoryBudget(int connections) {
+  return static_cast<int64_t>(Config::MAX_READ_SIZE) *
+         std::max(1, connections);
+}
+
+void DownloadEngine::ApplyMemoryBudget(EngineState &state) {
+  // Every connection of a download must be able to hold its largest read
+  // at once, or they could wait on each other for good
+  int64_t budget = state.memoryBudget.load();
+  if (budget > 0) {
+    budget = std::max(budget, MinMemoryBudget(state.maxConnections.load()));
+  }
+  state.bufferPool.SetLimit(static_cast<size_t>(budget));
+}
 
-  DWORD flags = INTERNET_FLAG_NO_UI | INTERNET_FLAG_RELOAD;
-  if (!m_state->verifySSL.load()) {
-    flags |= (INTERNET_FLAG_IGNORE_CERT_CN_INVALID |
-              INTERNET_FLAG_IGNORE_CERT_DATE_INVALID);
+void DownloadEngine::SetSlowConnectionPolicy(int percent, int windowMs) {
+  if (!m_state) {
+    return;
   }
 
-  HINTERNET hFile =
-      InternetOpenUrlA(hSession, url.c_str(), "Head: Trigger", -1, flags, 0);
+  m_state->slowPercent.store(percent);
+  m_state->slowWindowMs.store(std::max(Config::SPEED_UPDATE_INTERVAL_MS,
+                                       windowMs));
+}
 
-  if (!hFile)
-    return false;
+void DownloadEngine::SetWriteMode(WriteMode mode) {
+  if (!m_state) {
+    return;
+  }
 
-  // Content Length
-  DWORD size = 0;
-  DWORD bufferSize = sizeof(size);
-  // Try to get 64-bit size first (Content-Length)
-  char clBuffer[64] = {0};
-  bufferSize = sizeof(clBuffer);
+  m_state->writeMode.store(mode);
+}
 
-  if (HttpQueryInfoA(hFile, HTTP_QUERY_CONTENT_LENGTH, clBuffer, &bufferSize,
-                     NULL)) {
-    fileSize = _strtoi64(clBuffer, NULL, 10);
-  } else {
-    fileSize = -1;
+bool DownloadEngine::SetEngineMode(EngineMode mode, int loopThreads) {
+  if (!m_state) {
+    return false;
   }
 
-  // Accept-Ranges
-  char rangesBuffer[64] = {0};
-  bufferSize = sizeof(rangesBuffer);
-  if (HttpQueryInfoA(hFile, HTTP_QUERY_ACCEPT_RANGES, rangesBuffer, &bufferSize,
-                     NULL)) {
-    std::string ranges(rangesBuffer);
-    resumable = (ranges.find("bytes") != std::string::npos);
-  } else {
-    resumable = false;
+  if (mode == EngineMode::EventLoop) {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(m_state->loopMutex);
+    // The loops are started once and kept for the engine's lifetime
+    if (m_state->loops.empty()) {
+      if (loopThreads <= 0) {
+        loopThreads = static_cast<int>(
+            std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+      }
+      loopThreads = std::min(loopThreads, Config::MAX_EVENT_LOOPS);
+
+      for (int i = 0; i < loopThreads; ++i) {
+        auto loop = std::make_shared<EventLoop>();
+        if (!loop->Start()) {
+          for (auto &started : m_state->loops) {
+            started->Stop();
+          }
+          m_state->loops.clear();
+          return false;
+        }
+        m_state->loops.push_back(loop);
+      }
+    }
+#else
+    (void)loopThreads;
+    return false;
+#endif
   }
 
-  InternetCloseHandle(hFile);
+  m_state->mode.store(mode);
   return true;
 }
 
+DownloadEngine::EngineMode DownloadEngine::GetEngineMode() const {
+  if (!m_state) {
+    return EngineMode::Threaded;
+  }
+
+  return m_state->mode.load();
+}
+
+std::shared_ptr<EventLoop>
+DownloadEngine::PickEventLoop(const std::shared_ptr<EngineState> &state) {
+  std::lock_guard<std::mutex> lock(state->loopMutex);
+  if (state->loops.empty()) {
+    return nullptr;
+  }
+
+  // Round robin; downloads stay on the loop they started on
+  return state->loops[state->nextLoop++ % state->loops.size()];
+}
+
+std::shared_ptr<HttpTransport>
+DownloadEngine::AcquireTransport(const std::shared_ptr<EngineState> &state) {
+  std::lock_guard<std::mutex> lock(state->transportMutex);
+  return state->transport;
+}
+
+std::shared_ptr<BandwidthLimiter> DownloadEngine::AcquireLimiter(
+    std::map<std::string, std::shared_ptr<BandwidthLimiter>> &limiters,
+    const std::string &key) {
+  for (auto it = limiters.begin(); it != limiters.end();) {
+    bool unused = it->second.use_count() == 1 && !it->second->IsLimited();
+    it = unused && it->first != key ? limiters.erase(it) : std::next(it);
+  }
+
+  auto &limiter = limiters[key];
+  if (!limiter) {
+    limiter = std::make_shared<BandwidthLimiter>();
+  }
+  return limiter;
+}
+
 bool DownloadEngine::StartDownload(std::shared_ptr<Download> download) {
   if (!download)
     return false;
@@ -322,23 +344,20 @@ bool DownloadEngine::StartDownload(std::shared_ptr<Download> download) {
   if (!state || !state->running.load())
     return false;
 
-  int64_t fileSize;
-  bool resumable;
-
-  if (GetFileInfo(download->GetUrl(), fileSize, resumable)) {
-    download->SetTotalSize(fileSize);
-  }
-
-  // For this simple WinINet implementation, we stick to 1 connection per
-  // download for simplicity unless we implement complex range merging which is
-  // complex with raw WinINet API. The original code had multi-chunk logic but
-  // was complex. We will preserve the single-stream logic for stability in this
-  // migration.
-
-  download->InitializeChunks(1);
+  // Size and range support are learned from the first data request; the
+  // chunk layout is planned once its response headers arrive
   download->SetStatus(DownloadStatus::Downloading);
   download->UpdateLastTryTime();
 
+#ifdef __linux__
+  if (state->mode.load() == EngineMode::EventLoop) {
+    if (auto loop = PickEventLoop(state)) {
+      StartEventLoopTransfer(state, download, loop);
+      return true;
+    }
+  }
+#endif
+
   CleanupCompletedDownloads();
 
   {
@@ -402,83 +421,162 @@ void DownloadEngine::SetProxy(const std::string &proxyHost, int proxyPort) {
     }
   }
 
-  if (!ReinitializeSession(newProxyUrl)) {
+  if (!ReinitializeTransport(newProxyUrl)) {
     std::cerr << "Failed to apply proxy settings" << std::endl;
   }
 }
 
-bool DownloadEngine::ReinitializeSession(const std::string &proxyUrl) {
+bool DownloadEngine::ReinitializeTransport(const std::string &proxyUrl) {
   if (!m_state) {
     return false;
   }
 
-  std::string userAgent;
+  HttpTransportOptions options;
   {
-    std::lock_guard<std::mutex> lock(m_state->sessionMutex);
-    userAgent = m_state->userAgent;
+    std::lock_guard<std::mutex> lock(m_state->transportMutex);
+    options.userAgent = m_state->userAgent;
   }
-
-  HINTERNET newSession = OpenSession(userAgent, proxyUrl);
-  if (!newSession) {
+  options.proxyUrl = proxyUrl;
+  options.connectTimeoutMs = Config::CONNECT_TIMEOUT_MS;
+  options.receiveTimeoutMs = Config::RECEIVE_TIMEOUT_MS;
+  options.maxConnectionsPerHost = Config::MAX_CONNECTIONS_PER_HOST;
+  options.connectionPool = m_state->connectionPool;
+  options.resolver = m_state->resolver;
+
+  auto transport = HttpTransport::Create(options);
+  if (!transport) {
     return false;
   }
 
-  ConfigureSessionTimeouts(newSession);
+  {
+    std::lock_guard<std::mutex> lock(m_state->transportMutex);
+    m_state->transport = transport;
+    m_state->proxyUrl = proxyUrl;
+  }
 
-  auto newEntry = std::make_shared<SessionEntry>();
-  newEntry->handle = newSession;
+  m_state->running.store(true);
+  return true;
+}
 
-  std::shared_ptr<SessionEntry> oldEntry;
+int DownloadEngine::PlanConnectionCount(int maxConnections,
+                                        int64_t remainingBytes,
+                                        bool resumable) {
+  if (!resumable || remainingBytes <= 0) {
+    return 1;
+  }
+
+  int64_t bySize = remainingBytes / Config::MIN_SEGMENT_SIZE;
+  return static_cast<int>(
+      std::max<int64_t>(1, std::min<int64_t>(maxConnections, bySize)));
+}
+
+int DownloadEngine::StartTuning(const std::shared_ptr<EngineState> &state,
+                                const std::shared_ptr<Download> &download,
+                                SegmentContext &context, int workerCount) {
+  if (!state->adaptiveConnections.load() || workerCount <= 1) {
+    return workerCount;
+  }
+
+  HttpProtocol::Url url;
+  if (HttpProtocol::ParseUrl(download->GetUrl(), url)) {
+    context.host = HttpProtocol::ToLower(url.host);
+  }
+
+  int initial = Config::ADAPTIVE_INITIAL_CONNECTIONS;
   {
-    std::lock_guard<std::mutex> lock(m_state->sessionMutex);
-    oldEntry = m_state->session;
-    m_state->session = newEntry;
-    m_state->proxyUrl = proxyUrl;
-    if (oldEntry) {
-      oldEntry->closing.store(true);
-      m_state->retiredSessions.push_back(oldEntry);
+    std::lock_guard<std::mutex> lock(state->tuningMutex);
+    auto known = state->hostConnections.find(context.host);
+    if (known != state->hostConnections.end()) {
+      initial = known->second;
     }
   }
 
-  if (oldEntry) {
-    CloseSessionIfIdle(oldEntry);
+  // The chunks are laid out for workerCount; connections added later take
+  // the ones nobody started
+  context.tuner = std::make_unique<ConnectionTuner>(initial, workerCount);
+  context.lastTune = std::chrono::steady_clock::now();
+  context.lastTuneBytes = download->GetDownloadedSize();
+  return context.tuner->GetTarget();
+}
+
+int DownloadEngine::TuneConnections(const std::shared_ptr<Download> &download,
+                                    SegmentContext &context) {
+  if (!context.tuner) {
+    return 0;
   }
-  CleanupRetiredSessions(m_state);
 
-  m_state->running.store(true);
-  return true;
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = now - context.lastTune;
+  if (elapsed < std::chrono::milliseconds(Config::TUNE_INTERVAL_MS)) {
+    return context.tuner->GetTarget();
+  }
+
+  int64_t bytes = download->GetDownloadedSize();
+  double speed = (bytes - context.lastTuneBytes) /
+                 std::chrono::duration<double>(elapsed).count();
+  context.lastTune = now;
+  context.lastTuneBytes = bytes;
+  return context.tuner->Update(speed);
 }
 
-bool DownloadEngine::PerformDownload(std::shared_ptr<EngineState> state,
-                                     std::shared_ptr<Download> download) {
-  if (!state || !download || !state->running.load())
-    return false;
+void DownloadEngine::RememberConnections(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, SegmentContext &context) {
+  if (!context.tuner) {
+    return;
+  }
 
-  std::shared_ptr<SessionEntry> sessionEntry;
-  {
-    std::lock_guard<std::mutex> lock(state->sessionMutex);
-    sessionEntry = state->session;
+  // Under a speed limit more connections cannot help, whatever the host
+  // could serve
+  bool limited = state->bandwidthLimiter.IsLimited() ||
+                 download->GetBandwidthLimiter().IsLimited();
+  for (auto &limiter : context.limiters) {
+    limited = limited || limiter->IsLimited();
+  }
+  if (limited) {
+    return;
   }
-  if (!sessionEntry || !sessionEntry->handle)
-    return false;
 
-  SessionUsage sessionUsage(sessionEntry);
-  HINTERNET hSession = sessionUsage.handle();
-  if (!hSession)
-    return false;
+  // A download that ended before its count settled only tells that at
+  // least that many worked
+  int count = context.tuner->GetTarget();
+  std::lock_guard<std::mutex> lock(state->tuningMutex);
+  int &known = state->hostConnections[context.host];
+  known = context.tuner->IsSettled() ? count : std::max(known, count);
+}
 
-  ProgressCallback progressCallback;
-  CompletionCallback completionCallback;
+bool DownloadEngine::IsAborted(const std::shared_ptr<EngineState> &state,
+                               const std::shared_ptr<Download> &download) {
+  DownloadStatus status = download->GetStatus();
+  return !state->running.load() || status == DownloadStatus::Cancelled ||
+         status == DownloadStatus::Paused;
+}
+
+int DownloadEngine::PrepareTransfer(const std::shared_ptr<EngineState> &state,
+                                    const std::shared_ptr<Download> &download,
+                                    const CompletionCallback &completionCallback,
+                                    std::string &filePath,
+                                    SegmentContext &context) {
+  // Besides its own and the global limit, the transfer is charged to its
+  // host's and category's
   {
-    std::lock_guard<std::mutex> lock(state->callbackMutex);
-    progressCallback = state->progressCallback;
-    completionCallback = state->completionCallback;
+    std::lock_guard<std::mutex> lock(state->limiterMutex);
+    HttpProtocol::Url url;
+    if (HttpProtocol::ParseUrl(download->GetUrl(), url)) {
+      context.limiters.push_back(AcquireLimiter(
+          state->hostLimiters, HttpProtocol::ToLower(url.host)));
+    }
+    context.limiters.push_back(
+        AcquireLimiter(state->categoryLimiters, download->GetCategory()));
   }
 
-  std::string url = download->GetUrl();
   std::string savePath = download->GetSavePath();
-  CreateDirectoryA(savePath.c_str(), NULL);
-  std::string filePath = savePath + "\\" + download->GetFilename();
+  std::error_code ec;
+  std::filesystem::create_directories(savePath, ec);
+  filePath =
+      (std::filesystem::path(savePath) / download->GetFilename()).string();
+  context.filePath = filePath;
+  context.mirrors = std::make_unique<MirrorSet>(download->GetUrl());
 
   // Check existing size for resume
   int64_t existingSize = 0;
@@ -491,193 +589,1042 @@ bool DownloadEngine::PerformDownload(std::shared_ptr<EngineState> state,
   bool shouldResume = (existingSize > 0 && download->GetDownloadedSize() > 0 &&
                        download->GetStatus() == DownloadStatus::Downloading);
 
-  // Headers for resume
-  std::string headers = "";
-  if (shouldResume) {
-    download->SetDownloadedSize(existingSize);
-    headers = "Range: bytes=" + std::to_string(existingSize) + "-";
+  // Reuse the chunk map from an earlier run in this session if it still
+  // describes the same remote file
+  bool chunkMapValid = shouldResume && download->IsResumable() &&
+                       download->HasValidChunkMap();
+
+  // After a restart, or a crash, the map comes from the sidecar instead
+  if (!chunkMapValid && existingSize > 0 &&
+      download->GetStatus() == DownloadStatus::Downloading) {
+    chunkMapValid = RestoreResumeState(download, filePath);
+  }
+
+  int workerCount = 1;
+  if (!chunkMapValid) {
+    // Without a chunk map a segmented file may contain holes, so only resume
+    // when the file is exactly the contiguous prefix we have accounted for.
+    // Whether the server lets us resume there is up to its first response.
+    int64_t completedBytes = 0;
+    if (shouldResume && existingSize == download->GetDownloadedSize()) {
+      completedBytes = existingSize;
+    }
+
+    download->InitializeChunks(1, completedBytes);
+    context.probing = true;
+    ResumeFile::Remove(filePath);
+
+    if (download->GetDownloadedSize() == 0) {
+      std::ofstream createFile(filePath, std::ios::binary | std::ios::trunc);
+      if (!createFile.is_open()) {
+        download->SetStatus(DownloadStatus::Error);
+        download->SetErrorMessage("File I/O Error");
+        if (completionCallback)
+          completionCallback(download->GetId(), false, "File I/O Error");
+        return 0;
+      }
+    }
   } else {
-    existingSize = 0;
-    download->SetDownloadedSize(0);
+    // Connections beyond the number of pending chunks split work off the
+    // slowest ones as soon as they start
+    workerCount = StartTuning(
+        state, download, context,
+        PlanConnectionCount(
+            state->maxConnections.load(),
+            download->GetTotalSize() - download->GetDownloadedSize(), true));
+    AddMirrors(download, context);
   }
 
-  // Open Request
-  DWORD flags = INTERNET_FLAG_NO_UI | INTERNET_FLAG_RELOAD |
-                INTERNET_FLAG_KEEP_CONNECTION;
-  if (!state->verifySSL.load())
-    flags |= (INTERNET_FLAG_IGNORE_CERT_CN_INVALID |
-              INTERNET_FLAG_IGNORE_CERT_DATE_INVALID);
+  context.writer = std::make_unique<FileWriter>(
+      state->bufferPool, Config::WRITE_QUEUE_SIZE, Config::WRITE_BLOCK_SIZE);
+  if (!context.writer->Open(filePath, state->asyncFileIo.load())) {
+    context.writer.reset();
+    download->SetStatus(DownloadStatus::Error);
+    download->SetErrorMessage("File I/O Error");
+    if (completionCallback)
+      completionCallback(download->GetId(), false, "File I/O Error");
+    return 0;
+  }
 
-  HINTERNET hUrl = InternetOpenUrlA(
-      hSession, url.c_str(), headers.empty() ? NULL : headers.c_str(),
-      headers.empty() ? -1 : headers.length(), flags, 0);
+  // A known size lets the whole file be reserved before any data arrives;
+  // otherwise the probe's response reserves it
+  if (!context.probing && !context.writer->Reserve(download->GetTotalSize())) {
+    download->SetStatus(DownloadStatus::Error);
+    download->SetErrorMessage(
+        "Not enough disk space - check available disk space");
+    if (completionCallback)
+      completionCallback(download->GetId(), false, "File I/O Error");
+    return 0;
+  }
+  if (!context.probing) {
+    MapOutput(state, download, filePath, context);
+  }
+  return workerCount;
+}
+
+int DownloadEngine::ApplyProbeResponse(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, const HttpResponse &response,
+    const std::string &filePath, SegmentContext &context, int &chunkIndex,
+    DownloadChunk &chunk) {
+  context.probing = false;
+
+  // The probe asked for everything from chunk.currentByte on. A 206 proves
+  // range support; a 200 carries the whole file from its first byte.
+  int64_t requestedStart = chunk.currentByte;
+  bool ranged = response.statusCode == 206;
+  if (ranged && (!response.hasContentRange ||
+                 response.rangeStart != requestedStart)) {
+    context.Fail("Server did not honour the requested range",
+                 "Connection failed", true);
+    return 0;
+  }
+
+  // What is on disk belongs to another version of the file
+  if (ranged && RemoteChanged(download, response)) {
+    context.remoteChanged = true;
+    context.Fail("File changed on the server - downloading it again",
+                 "Connection failed", true);
+    return 0;
+  }
+
+  int64_t completedBytes = ranged ? requestedStart : 0;
+  int64_t totalSize =
+      ranged ? response.instanceLength : response.contentLength;
+  bool resumable = ranged || response.acceptRanges;
+  download->SetTotalSize(totalSize);
+  download->SetResumable(resumable);
+  download->SetValidators(response.etag, response.lastModified);
+  AddMirrors(download, context);
+
+  MetadataCallback metadataCallback;
+  {
+    std::lock_guard<std::mutex> lock(state->callbackMutex);
+    metadataCallback = state->metadataCallback;
+  }
+  if (metadataCallback) {
+    metadataCallback(download->GetId(), totalSize, resumable);
+  }
+
+  // The writer holds the file open already, so it is cut through its handle
+  if (completedBytes != requestedStart && !context.writer->Truncate(0)) {
+    context.Fail("File I/O Error", "File I/O Error", false);
+    return 0;
+  }
+  if (!context.writer->Reserve(totalSize)) {
+    context.Fail("Not enough disk space - check available disk space",
+                 "File I/O Error", false);
+    return 0;
+  }
+  MapOutput(state, download, filePath, context);
+
+  int workerCount = PlanConnectionCount(
+      state->maxConnections.load(),
+      totalSize > 0 ? totalSize - completedBytes : -1, resumable);
+  download->InitializeChunks(workerCount, completedBytes);
+
+  // The first pending chunk starts where the response does
+  chunkIndex = download->AcquireChunk();
+  if (chunkIndex < 0 || !download->GetChunk(chunkIndex, chunk) ||
+      chunk.currentByte != completedBytes) {
+    context.Fail("Invalid chunk", "Download incomplete", false);
+    return 0;
+  }
+  return StartTuning(state, download, context, workerCount);
+}
+
+int DownloadEngine::OpenProbe(const std::shared_ptr<EngineState> &state,
+                              const std::shared_ptr<Download> &download,
+                              HttpTransport &transport,
+                              const std::string &filePath,
+                              SegmentContext &context,
+                              std::unique_ptr<HttpConnection> &connection,
+                              int &chunkIndex) {
+  chunkIndex = download->AcquireChunk();
+  DownloadChunk chunk(0, 0);
+  if (chunkIndex < 0 || !download->GetChunk(chunkIndex, chunk)) {
+    context.Fail("Invalid chunk", "Download incomplete", false);
+    return 0;
+  }
+  download->ReleaseChunk(chunkIndex);
+
+  bool rangeRequest = false;
+  HttpRequest request = BuildSegmentRequest(
+      state, download, download->GetUrl(), chunk, true, rangeRequest);
+
+  HttpResponse response;
+  std::string error;
+  connection = transport.Open(request, response, error);
+
+  // A range past the end (e.g. of an empty file) is asked again without one
+  if (connection && response.statusCode == 416) {
+    connection.reset();
+    request.rangeStart = -1;
+    response = HttpResponse();
+    connection = transport.Open(request, response, error);
+  }
+
+  if (!connection) {
+    context.Fail("Failed to open URL. " + error, "Connection failed", true);
+    return 0;
+  }
+  SegmentResult failure = SegmentResult::Failed;
+  if (!CheckSegmentResponse(download, response, chunk, rangeRequest, -1,
+                            context, failure)) {
+    connection.reset();
+    return 0;
+  }
+
+  int workerCount = ApplyProbeResponse(state, download, response, filePath,
+                                       context, chunkIndex, chunk);
+  if (workerCount <= 0) {
+    connection.reset();
+  }
+  return workerCount;
+}
 
-  if (!hUrl) {
+void DownloadEngine::UpdateDownloadSpeed(
+    const std::shared_ptr<Download> &download,
+    const ProgressCallback &progressCallback, int64_t &lastBytes,
+    std::chrono::steady_clock::time_point &lastSpeedUpdate) {
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     now - lastSpeedUpdate)
+                     .count();
+  if (elapsed < Config::SPEED_UPDATE_INTERVAL_MS) {
+    return;
+  }
+
+  int64_t currentSize = download->GetDownloadedSize();
+  double speed =
+      static_cast<double>(currentSize - lastBytes) / (elapsed / 1000.0);
+  download->SetSpeed(speed);
+  lastSpeedUpdate = now;
+  lastBytes = currentSize;
+
+  if (progressCallback) {
+    progressCallback(download->GetId(), currentSize, download->GetTotalSize(),
+                     speed);
+  }
+}
+
+DownloadEngine::TransferOutcome
+DownloadEngine::FinishTransfer(const std::shared_ptr<EngineState> &state,
+                               const std::shared_ptr<Download> &download,
+                               const CompletionCallback &completionCallback,
+                               SegmentContext &context) {
+  // Whatever was received has to reach the disk before the chunk map is
+  // trusted, also when pausing
+  if (context.writer && !context.writer->Close()) {
+    // Progress counted what was received; what was lost is fetched again
+    for (int64_t offset : context.writer->GetUnwrittenOffsets()) {
+      download->RewindChunk(offset);
+    }
+    context.Fail("Disk write failed - check available disk space",
+                 "File I/O Error", false);
+  }
+  RememberConnections(state, download, context);
+
+  // Start over from an empty file next time
+  if (context.remoteChanged.load()) {
+    ResumeFile::Remove(context.filePath);
+    download->InitializeChunks(1, 0);
+    download->SetValidators("", "");
+  }
+
+  if (!state->running.load())
+    return TransferOutcome::Aborted;
+
+  if (download->GetStatus() == DownloadStatus::Cancelled ||
+      download->GetStatus() == DownloadStatus::Paused) {
+    if (completionCallback)
+      completionCallback(download->GetId(), false, "User Aborted");
+    return TransferOutcome::Aborted;
+  }
+
+  if (context.failed.load() || !download->AreAllChunksCompleted()) {
     download->SetStatus(DownloadStatus::Error);
-    download->SetErrorMessage("Failed to open URL. Error: " +
-                              std::to_string(GetLastError()));
+    {
+      std::lock_guard<std::mutex> lock(context.errorMutex);
+      download->SetErrorMessage(context.errorMessage.empty()
+                                    ? "Download incomplete"
+                                    : context.errorMessage);
+    }
 
     // Retry Logic
-    if (download->ShouldRetry()) {
+    if (context.retryable.load() && download->ShouldRetry()) {
       download->IncrementRetry();
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(download->GetRetryDelayMs()));
-      if (download->GetStatus() == DownloadStatus::Cancelled)
-        return false;
-      download->SetStatus(DownloadStatus::Queued);
-      return PerformDownload(state, download);
+      download->PostponeRetry(context.retryAfterMs.load());
+      return TransferOutcome::Retry;
     }
 
-    if (completionCallback)
-      completionCallback(download->GetId(), false, "Connection failed");
+    if (completionCallback) {
+      std::lock_guard<std::mutex> lock(context.errorMutex);
+      completionCallback(download->GetId(), false,
+                         context.callbackError.empty() ? "Download incomplete"
+                                                       : context.callbackError);
+    }
+    return TransferOutcome::Failed;
+  }
+
+  // Open-ended downloads learn their size at EOF
+  if (download->GetTotalSize() <= 0) {
+    download->SetTotalSize(download->GetDownloadedSize());
+  }
+
+  ResumeFile::Remove(context.filePath);
+  download->SetStatus(DownloadStatus::Completed);
+  download->ResetRetry();
+  if (completionCallback)
+    completionCallback(download->GetId(), true, "");
+
+  return TransferOutcome::Completed;
+}
+
+bool DownloadEngine::PerformDownload(std::shared_ptr<EngineState> state,
+                                     std::shared_ptr<Download> download) {
+  if (!state || !download || !state->running.load())
+    return false;
+
+  auto transport = AcquireTransport(state);
+  if (!transport)
     return false;
+
+  ProgressCallback progressCallback;
+  CompletionCallback completionCallback;
+  {
+    std::lock_guard<std::mutex> lock(state->callbackMutex);
+    progressCallback = state->progressCallback;
+    completionCallback = state->completionCallback;
   }
 
-  if (shouldResume) {
-    bool resumeValid = false;
-    DWORD statusCode = 0;
-    DWORD statusSize = sizeof(statusCode);
-    if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER,
-                       &statusCode, &statusSize, NULL)) {
-      if (statusCode == 206) {
-        char rangeBuffer[128] = {0};
-        DWORD rangeSize = sizeof(rangeBuffer);
-        if (HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_RANGE, rangeBuffer,
-                           &rangeSize, NULL)) {
-          int64_t rangeStart = 0;
-          resumeValid = ParseContentRangeStart(rangeBuffer, rangeStart) &&
-                        rangeStart == existingSize;
-        }
+  std::string filePath;
+  SegmentContext context;
+  int workerCount = PrepareTransfer(state, download, completionCallback,
+                                    filePath, context);
+  if (workerCount <= 0)
+    return false;
+
+  // The first request doubles as the probe; its connection goes on with
+  // the first chunk of the layout planned from its response
+  std::unique_ptr<HttpConnection> probe;
+  int probeChunk = -1;
+  if (context.probing) {
+    workerCount = OpenProbe(state, download, *transport, filePath, context,
+                            probe, probeChunk);
+  }
+
+  // One connection per chunk; each worker keeps taking chunks until none
+  // are left
+  std::vector<std::future<void>> workers;
+  auto startWorker = [&](std::unique_ptr<HttpConnection> opened,
+                         int chunkIndex) {
+    context.workers++;
+    workers.push_back(std::async(
+        std::launch::async,
+        [&, opened = std::move(opened), chunkIndex]() mutable {
+          RunSegmentWorker(state, download, *transport, context,
+                           std::move(opened), chunkIndex);
+          context.workers--;
+        }));
+  };
+  for (int i = 0; i < workerCount; ++i) {
+    if (i == 0) {
+      startWorker(std::move(probe), probeChunk);
+    } else {
+      startWorker(nullptr, -1);
+    }
+  }
+
+  // Merge progress from all connections while they run
+  auto lastSpeedUpdate = std::chrono::steady_clock::now();
+  int64_t lastBytes = download->GetDownloadedSize();
+  int tuned = workerCount;
+  size_t finished = 0;
+  while (finished < workers.size()) {
+    if (workers[finished].wait_for(std::chrono::milliseconds(
+            Config::SPEED_UPDATE_INTERVAL_MS)) == std::future_status::ready) {
+      finished++;
+      continue;
+    }
+    UpdateDownloadSpeed(download, progressCallback, lastBytes,
+                        lastSpeedUpdate);
+    CheckpointResume(download, context, false);
+
+    // Adaptive mode: workers are added as the tuner raises the count, or
+    // asked to leave after their chunk when it lowers it
+    int target = TuneConnections(download, context);
+    if (target > 0 && !context.failed.load() &&
+        !IsAborted(state, download)) {
+      context.surplusWorkers.store(
+          std::max(0, context.workers.load() - target));
+      for (; tuned < target; ++tuned) {
+        startWorker(nullptr, -1);
       }
+      tuned = target;
     }
+  }
 
-    if (!resumeValid) {
-      InternetCloseHandle(hUrl);
-      shouldResume = false;
-      existingSize = 0;
-      download->SetDownloadedSize(0);
-      headers.clear();
+  // A transfer that stops short leaves its chunk map for the next run
+  if (!download->AreAllChunksCompleted()) {
+    CheckpointResume(download, context, true);
+  }
+  switch (FinishTransfer(state, download, completionCallback, context)) {
+  case TransferOutcome::Completed:
+    return true;
+  case TransferOutcome::Retry:
+    // Backing off holds no thread
+    state->retryScheduler->Schedule(download);
+    return false;
+  default:
+    return false;
+  }
+}
 
-      hUrl = InternetOpenUrlA(hSession, url.c_str(), NULL, -1, flags, 0);
-      if (!hUrl) {
-        download->SetStatus(DownloadStatus::Error);
-        download->SetErrorMessage("Failed to restart download. Error: " +
-                                  std::to_string(GetLastError()));
-        if (completionCallback)
-          completionCallback(download->GetId(), false, "Connection failed");
-        return false;
-      }
+void DownloadEngine::RunSegmentWorker(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, HttpTransport &transport,
+    SegmentContext &context, std::unique_ptr<HttpConnection> connection,
+    int chunkIndex) {
+  // The probe's connection is to the download's own URL
+  if (connection) {
+    int mirror = context.mirrors->Acquire(0);
+    SegmentResult result =
+        DownloadSegment(state, download, transport, chunkIndex, mirror,
+                        context, std::move(connection));
+    context.mirrors->Release(mirror);
+    download->ReleaseChunk(chunkIndex);
+    if (result != SegmentResult::Completed &&
+        result != SegmentResult::Reassign &&
+        result != SegmentResult::Reconnect) {
+      return;
     }
   }
 
-  // Open output file
-  std::ofstream file;
-  if (shouldResume) {
-    file.open(filePath, std::ios::binary | std::ios::app);
-  } else {
-    file.open(filePath, std::ios::binary | std::ios::trunc);
+  int64_t minStealSize = download->IsResumable() ? Config::MIN_STEAL_SIZE : 0;
+
+  while (!context.failed.load() && !IsAborted(state, download)) {
+    // Fewer connections wanted: as many workers leave as are surplus
+    int surplus = context.surplusWorkers.load();
+    while (surplus > 0 &&
+           !context.surplusWorkers.compare_exchange_weak(surplus,
+                                                         surplus - 1)) {
+    }
+    if (surplus > 0) {
+      return;
+    }
+
+    chunkIndex = download->AcquireChunk(minStealSize);
+    if (chunkIndex < 0) {
+      return;
+    }
+
+    int mirror = context.mirrors->Acquire();
+    SegmentResult result = DownloadSegment(
+        state, download, transport, chunkIndex, mirror, context, nullptr);
+    context.mirrors->Release(mirror);
+    download->ReleaseChunk(chunkIndex);
+
+    if (result != SegmentResult::Completed &&
+        result != SegmentResult::Reassign &&
+        result != SegmentResult::Reconnect) {
+      return;
+    }
   }
+}
 
-  if (!file.is_open()) {
-    InternetCloseHandle(hUrl);
-    download->SetStatus(DownloadStatus::Error);
-    download->SetErrorMessage("File I/O Error");
+DownloadEngine::SegmentResult DownloadEngine::SegmentContext::Fail(
+    const std::string &message, const std::string &callbackErrorText,
+    bool isRetryable) {
+  std::lock_guard<std::mutex> lock(errorMutex);
+  if (!failed.exchange(true)) {
+    errorMessage = message;
+    callbackError = callbackErrorText;
+    retryable.store(isRetryable);
+  }
+  return SegmentResult::Failed;
+}
+
+HttpRequest
+DownloadEngine::BuildSegmentRequest(const std::shared_ptr<EngineState> &state,
+                                    const std::shared_ptr<Download> &download,
+                                    const std::string &url,
+                                    const DownloadChunk &chunk, bool probe,
+                                    bool &rangeRequest) {
+  HttpRequest request;
+  request.url = url;
+  request.verifySSL = state->verifySSL.load();
+
+  // A probe asks for the rest of the file; it takes whatever it gets back
+  if (probe) {
+    rangeRequest = false;
+    request.rangeStart = chunk.currentByte;
+    if (chunk.currentByte > 0) {
+      request.ifRange = IfRangeValidator(download);
+    }
+    return request;
+  }
+
+  // Servers without range support get a plain request for the whole file
+  rangeRequest = download->IsResumable() &&
+                 (chunk.currentByte > 0 || !chunk.IsOpenEnded());
+  if (rangeRequest) {
+    request.rangeStart = chunk.currentByte;
+    request.rangeEnd = chunk.IsOpenEnded() ? -1 : chunk.endByte;
+    request.ifRange = IfRangeValidator(download);
+  }
+  return request;
+}
+
+bool DownloadEngine::CheckSegmentResponse(
+    const std::shared_ptr<Download> &download, const HttpResponse &response,
+    const DownloadChunk &chunk, bool rangeRequest, int mirror,
+    SegmentContext &context, SegmentResult &failure) {
+  bool overloaded = response.statusCode == 429 || response.statusCode == 503;
+  if (overloaded && response.retryAfterSeconds >= 0) {
+    int64_t waitMs =
+        std::min<int64_t>(response.retryAfterSeconds,
+                          Config::MAX_RETRY_AFTER_MS / 1000) *
+        1000;
+    int64_t known = context.retryAfterMs.load();
+    while (waitMs > known &&
+           !context.retryAfterMs.compare_exchange_weak(known, waitMs)) {
+    }
+  }
+
+  // An overloaded server turning some connections away: the transfer goes
+  // on with the others, and with fewer from now on
+  if (overloaded && context.tuner) {
+    std::vector<DownloadChunk> chunks = download->GetChunks();
+    if (std::count_if(chunks.begin(), chunks.end(),
+                      [](const DownloadChunk &other) {
+                        return other.active;
+                      }) > 1) {
+      context.tuner->Throttle();
+      failure = SegmentResult::Throttled;
+      return false;
+    }
+  }
+
+  if (response.statusCode >= 400) {
+    failure = FailSource(
+        context, mirror,
+        "Server returned HTTP " + std::to_string(response.statusCode),
+        "Connection failed", response.statusCode >= 500 || overloaded);
+    return false;
+  }
+
+  // The download's own URL defines the file; a mirror that does not match
+  // it is not used
+  if (rangeRequest && RemoteChanged(download, response)) {
+    if (mirror > 0) {
+      failure = FailSource(context, mirror,
+                           "Mirror has a different version of the file",
+                           "Connection failed", false);
+      return false;
+    }
+    context.remoteChanged = true;
+    failure = context.Fail("File changed on the server - downloading it again",
+                           "Connection failed", true);
     return false;
   }
 
+  if (rangeRequest && (response.statusCode != 206 ||
+                       !response.hasContentRange ||
+                       response.rangeStart != chunk.currentByte)) {
+    failure = FailSource(context, mirror,
+                         "Server did not honour the requested range",
+                         "Connection failed", true);
+    return false;
+  }
+
+  return true;
+}
+
+DownloadEngine::SegmentResult
+DownloadEngine::FailSource(SegmentContext &context, int mirror,
+                           const std::string &message,
+                           const std::string &callbackErrorText,
+                           bool isRetryable) {
+  if (mirror >= 0 && context.mirrors->Drop(mirror)) {
+    return SegmentResult::Reassign;
+  }
+  return context.Fail(message, callbackErrorText, isRetryable);
+}
+
+DownloadEngine::SegmentResult
+DownloadEngine::FailRead(const std::shared_ptr<Download> &download,
+                         SegmentContext &context, int chunkIndex, int mirror,
+                         const std::string &message, int &delayMs) {
+  // The chunk's progress is kept up to the last byte received, so a ranged
+  // request picks it up right there. Every break costs one of the
+  // download's retries; the backoff grows with the breaks in a row
+  // without new data.
+  delayMs = 0;
+  if (download->IsResumable() && !context.failed.load() &&
+      download->ConsumeRetry()) {
+    int reconnects = download->RecordReconnect(chunkIndex);
+    int shift = std::min(reconnects - 1, 8);
+    delayMs = std::min(Config::RECONNECT_DELAY_MS << shift,
+                       Config::MAX_RECONNECT_DELAY_MS);
+    return SegmentResult::Reconnect;
+  }
+  return FailSource(context, mirror, message, "Read Error", true);
+}
+
+void DownloadEngine::AddMirrors(const std::shared_ptr<Download> &download,
+                                SegmentContext &context) {
+  // Parts of a file can only be put together by range, at offsets that
+  // mean the same on every source
+  if (!download->IsResumable() || download->GetTotalSize() <= 0) {
+    return;
+  }
+  for (const auto &mirror : download->GetMirrors()) {
+    context.mirrors->Add(mirror);
+  }
+}
+
+std::string
+DownloadEngine::IfRangeValidator(const std::shared_ptr<Download> &download) {
+  // A weak ETag may not be used for ranges
+  std::string etag = download->GetETag();
+  if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+    return etag;
+  }
+  return download->GetLastModified();
+}
+
+bool DownloadEngine::RemoteChanged(const std::shared_ptr<Download> &download,
+                                   const HttpResponse &response) {
+  // A validator that no longer matches gets the whole file instead
+  if (response.statusCode == 200) {
+    return !IfRangeValidator(download).empty();
+  }
+  if (response.statusCode != 206) {
+    return false;
+  }
+
+  // Servers that ignore If-Range still tell by their validators or size
+  std::string etag = download->GetETag();
+  std::string lastModified = download->GetLastModified();
+  if (!etag.empty() && !response.etag.empty()) {
+    if (etag != response.etag) {
+      return true;
+    }
+  } else if (!lastModified.empty() && !response.lastModified.empty() &&
+             lastModified != response.lastModified) {
+    return true;
+  }
+  int64_t totalSize = download->GetTotalSize();
+  return totalSize > 0 && response.instanceLength >= 0 &&
+         response.instanceLength != totalSize;
+}
+
+int DownloadEngine::RecordSegmentProgress(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, int chunkIndex,
+    SegmentProgress &progress, size_t bytes, SegmentContext &context) {
+  progress.position += bytes;
+  download->UpdateChunkProgress(chunkIndex, progress.position);
+
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     now - progress.lastSpeedUpdate)
+                     .count();
+  if (elapsed >= Config::READ_SIZE_TARGET_MS) {
+    // The read size follows the running average right away, so a fast
+    // connection does not spend its first interval on small reads
+    double speed =
+        (progress.position - progress.lastPosition) / (elapsed / 1000.0);
+    progress.readSize = ReadSizeForSpeed(speed);
+    if (elapsed >= Config::SPEED_UPDATE_INTERVAL_MS) {
+      download->SetChunkSpeed(chunkIndex, speed);
+      context.mirrors->ReportSpeed(progress.mirror, speed);
+      progress.lastSpeedUpdate = now;
+      progress.lastPosition = progress.position;
+      CheckSlowConnection(state, download, chunkIndex, progress, context,
+                          now);
+    }
+  }
+
+  // Every level is charged; the most restrictive one sets the pause
+  int delayMs = download->GetBandwidthLimiter().Consume(bytes);
+  for (auto &limiter : context.limiters) {
+    delayMs = std::max(delayMs, limiter->Consume(bytes));
+  }
+  return std::max(delayMs, state->bandwidthLimiter.Consume(bytes));
+}
+
+size_t DownloadEngine::ReadSizeForSpeed(double speed) {
+  // Fast connections take big reads so the per-call overhead stays small;
+  // slow or throttled ones keep reads short so progress stays current and
+  // a blocking read never holds up a pause for long
+  double target = speed * Config::READ_SIZE_TARGET_MS / 1000.0;
+  if (target >= static_cast<double>(Config::MAX_READ_SIZE)) {
+    return Config::MAX_READ_SIZE;
+  }
+  return std::max(Config::MIN_READ_SIZE,
+                  BufferPool::RoundUp(static_cast<size_t>(target)));
+}
+
+void DownloadEngine::CheckSlowConnection(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, int chunkIndex,
+    SegmentProgress &progress, SegmentContext &context,
+    std::chrono::steady_clock::time_point now) {
+  auto window = std::chrono::milliseconds(state->slowWindowMs.load());
+  progress.samples.emplace_back(now, progress.position);
+  // The oldest sample kept is the last one from before the window
+  while (progress.samples.size() > 1 &&
+         now - progress.samples[1].first >= window) {
+    progress.samples.pop_front();
+  }
+
+  // Judged only once it ran for a whole window
+  auto &oldest = progress.samples.front();
+  if (progress.replace || now - oldest.first < window) {
+    return;
+  }
+
+  double seconds = std::chrono::duration<double>(now - oldest.first).count();
+  double speed = (progress.position - oldest.second) / seconds;
+  progress.replace =
+      IsSlowConnection(state, download, chunkIndex, speed, context);
+}
+
+bool DownloadEngine::IsSlowConnection(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, int chunkIndex, double speed,
+    SegmentContext &context) {
+  int percent = state->slowPercent.load();
+  if (percent <= 0 || !download->IsResumable()) {
+    return false;
+  }
+
+  // Only worth a new connection while a good part of a known range is
+  // left; idle connections steal the tail of what is left anyway
+  std::vector<DownloadChunk> chunks = download->GetChunks();
+  if (chunkIndex < 0 || chunkIndex >= static_cast<int>(chunks.size()) ||
+      chunks[chunkIndex].IsOpenEnded() ||
+      chunks[chunkIndex].GetRemaining() < Config::MIN_STEAL_SIZE) {
+    return false;
+  }
+
+  std::vector<double> siblings;
+  for (int i = 0; i < static_cast<int>(chunks.size()); ++i) {
+    if (i != chunkIndex && chunks[i].active && !chunks[i].completed) {
+      siblings.push_back(chunks[i].speed);
+    }
+  }
+  if (static_cast<int>(siblings.size()) <
+      Config::SLOW_CONNECTION_MIN_SIBLINGS) {
+    return false;
+  }
+
+  auto middle = siblings.begin() + siblings.size() / 2;
+  std::nth_element(siblings.begin(), middle, siblings.end());
+  if (speed * 100.0 >= *middle * percent) {
+    return false;
+  }
+
+  return context.slowReplacements.fetch_add(1) <
+         Config::MAX_SLOW_REPLACEMENTS;
+}
+
+void DownloadEngine::MapOutput(const std::shared_ptr<EngineState> &state,
+                               const std::shared_ptr<Download> &download,
+                               const std::string &filePath,
+                               SegmentContext &context) {
+  if (state->writeMode.load() != WriteMode::Mapped ||
+      download->GetTotalSize() <= 0) {
+    return;
+  }
+
+  auto mapped = std::make_unique<MappedFile>(Config::MAP_WINDOW_SIZE);
+  if (mapped->Open(filePath, download->GetTotalSize())) {
+    context.mapped = std::move(mapped);
+  }
+}
+
+char *DownloadEngine::MapForWrite(SegmentContext &context,
+                                  SegmentProgress &progress, int64_t offset,
+                                  size_t &size, bool wait) {
+  if (!progress.view.Contains(offset)) {
+    // Everything left behind in the old window is checkpointed with it
+    if (progress.view.IsValid() &&
+        !progress.view.Flush(progress.checkpointPosition, offset, wait)) {
+      return nullptr;
+    }
+    progress.view = context.mapped->Map(offset);
+    if (!progress.view.IsValid()) {
+      return nullptr;
+    }
+    progress.checkpointPosition = offset;
+    progress.lastCheckpoint = std::chrono::steady_clock::now();
+  }
+
+  size = std::min(size, progress.view.Available(offset));
+  return progress.view.At(offset);
+}
+
+bool DownloadEngine::CheckpointMapped(SegmentProgress &progress, bool force,
+                                      bool wait) {
+  auto now = std::chrono::steady_clock::now();
+  if (!progress.view.IsValid() ||
+      (!force && now - progress.lastCheckpoint <
+                     std::chrono::milliseconds(Config::MAP_CHECKPOINT_MS))) {
+    return true;
+  }
+
+  bool ok = progress.view.Flush(progress.checkpointPosition,
+                                progress.position, wait);
+  progress.checkpointPosition = progress.position;
+  progress.lastCheckpoint = now;
+  return ok;
+}
+
+bool DownloadEngine::RestoreResumeState(
+    const std::shared_ptr<Download> &download, const std::string &filePath) {
+  // Everything is checked before any of it is applied, so a download that
+  // starts over keeps none of a rejected sidecar
+  ResumeState saved;
+  if (!ResumeFile::Load(filePath, saved) || saved.url != download->GetUrl() ||
+      saved.totalSize <= 0 ||
+      (download->GetTotalSize() > 0 &&
+       download->GetTotalSize() != saved.totalSize) ||
+      !Download::IsValidChunkMap(saved.chunks, saved.totalSize)) {
+    return false;
+  }
+
+  download->SetTotalSize(saved.totalSize);
+  download->SetResumable(true);
+  download->SetValidators(saved.etag, saved.lastModified);
+  download->RestoreChunks(saved.chunks);
+  return true;
+}
+
+void DownloadEngine::CheckpointResume(const std::shared_ptr<Download> &download,
+                                      SegmentContext &context, bool force) {
+  auto now = std::chrono::steady_clock::now();
+  if (!context.writer || context.probing || context.remoteChanged.load() ||
+      !download->IsResumable() || download->GetTotalSize() <= 0 ||
+      (!force && (context.resumeSaves.load() > 0 ||
+                  now - context.lastResumeSave <
+                      std::chrono::milliseconds(
+                          Config::RESUME_CHECKPOINT_MS)))) {
+    return;
+  }
+  context.lastResumeSave = now;
+
+  // Taken before the flush is asked for, so everything it counts was
+  // handed to the writer (or into the mapping) by then
+  ResumeState state;
+  state.url = download->GetUrl();
+  state.totalSize = download->GetTotalSize();
+  state.etag = download->GetETag();
+  state.lastModified = download->GetLastModified();
+  state.chunks = download->GetChunks();
+
+  context.resumeSaves++;
+  context.writer->Sync([&context, state = std::move(state)](bool synced) {
+    if (synced && (!context.mapped || context.mapped->Sync())) {
+      ResumeFile::Save(context.filePath, state);
+    }
+    context.resumeSaves--;
+  });
+}
+
+DownloadEngine::SegmentResult DownloadEngine::DownloadSegment(
+    const std::shared_ptr<EngineState> &state,
+    const std::shared_ptr<Download> &download, HttpTransport &transport,
+    int chunkIndex, int mirror, SegmentContext &context,
+    std::unique_ptr<HttpConnection> connection) {
+  DownloadChunk chunk(0, 0);
+  if (!download->GetChunk(chunkIndex, chunk)) {
+    return context.Fail("Invalid chunk", "Download incomplete", false);
+  }
+
+  bool openEnded = chunk.IsOpenEnded();
+  std::string error;
+  if (!connection) {
+    bool rangeRequest = false;
+    HttpRequest request =
+        BuildSegmentRequest(state, download, context.mirrors->GetUrl(mirror),
+                            chunk, false, rangeRequest);
+
+    HttpResponse response;
+    connection = transport.Open(request, response, error);
+    if (!connection) {
+      return FailSource(context, mirror, "Failed to open URL. " + error,
+                        "Connection failed", true);
+    }
+
+    SegmentResult failure = SegmentResult::Failed;
+    if (!CheckSegmentResponse(download, response, chunk, rangeRequest,
+                              mirror, context, failure)) {
+      return failure;
+    }
+  }
+
+  // Plain bodies can go from the socket to the file without a stop in
+  // user space. Such reads are written as they arrive instead of queued.
+  int directFd = -1;
+#ifdef __linux__
+  if (!context.mapped && state->zeroCopy.load() &&
+      connection->CanReadToFile()) {
+    directFd = context.writer->GetDescriptor();
+  }
+#endif
+
   // Read Loop
-  DWORD bytesRead = 0;
-  char buffer[8192]; // 8KB buffer
-  auto lastSpeedUpdate = std::chrono::steady_clock::now();
-  auto lastThrottleUpdate = lastSpeedUpdate;
-  int64_t lastBytes = shouldResume ? existingSize : 0;
+  size_t bytesRead = 0;
+  SegmentProgress progress;
+  BufferPool::Buffer buffer;
+  progress.position = chunk.currentByte;
+  progress.lastPosition = chunk.currentByte;
+  progress.lastSpeedUpdate = std::chrono::steady_clock::now();
+  progress.mirror = mirror;
+
+  // A read that broke off is asked again after a backoff; the chunk stays
+  // this connection's meanwhile
+  auto failRead = [&](const std::string &message) {
+    int delayMs = 0;
+    SegmentResult result =
+        FailRead(download, context, chunkIndex, mirror, message, delayMs);
+    connection.reset();
+    while (delayMs > 0 && !IsAborted(state, download) &&
+           !context.failed.load()) {
+      int step = std::min(delayMs, Config::SPEED_UPDATE_INTERVAL_MS);
+      std::this_thread::sleep_for(std::chrono::milliseconds(step));
+      delayMs -= step;
+    }
+    return result;
+  };
 
-  do {
+  while (true) {
     // Check Status
-    if (!state->running.load() ||
-        download->GetStatus() == DownloadStatus::Cancelled ||
-        download->GetStatus() == DownloadStatus::Paused) {
-      file.close();
-      InternetCloseHandle(hUrl);
-      if (state->running.load() && completionCallback)
-        completionCallback(download->GetId(), false, "User Aborted");
-      return false;
+    if (IsAborted(state, download) || context.failed.load()) {
+      return SegmentResult::Aborted;
     }
 
-    if (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead)) {
-      if (bytesRead > 0) {
-        file.write(buffer, bytesRead);
-        if (file.fail()) {
-          file.close();
-          InternetCloseHandle(hUrl);
-          download->SetStatus(DownloadStatus::Error);
-          download->SetErrorMessage(
-              "Disk write failed - check available disk space");
-          if (completionCallback)
-            completionCallback(download->GetId(), false, "File I/O Error");
-          return false;
-        }
+    // The end may shrink while we run if another connection steals part of
+    // this chunk
+    int64_t remaining =
+        openEnded ? static_cast<int64_t>(progress.readSize)
+                  : download->GetChunkEnd(chunkIndex) - progress.position + 1;
+    if (remaining <= 0) {
+      break;
+    }
 
-        int64_t currentSize = download->GetDownloadedSize() + bytesRead;
-        download->SetDownloadedSize(currentSize);
-
-        // Speed Update
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                           now - lastSpeedUpdate)
-                           .count();
-        if (elapsed >= 500) {
-          double speed =
-              static_cast<double>(currentSize - lastBytes) / (elapsed / 1000.0);
-          download->SetSpeed(speed);
-          lastSpeedUpdate = now;
-          lastBytes = currentSize;
-
-          if (progressCallback) {
-            progressCallback(download->GetId(), currentSize,
-                             download->GetTotalSize(), speed);
-          }
+    size_t toRead = static_cast<size_t>(
+        std::min<int64_t>(progress.readSize, remaining));
+    if (directFd >= 0) {
+#ifdef __linux__
+      bool writeFailed = false;
+      if (!connection->ReadToFile(directFd, progress.position, toRead,
+                                  bytesRead, error, writeFailed)) {
+        if (writeFailed) {
+          return context.Fail(
+              "Disk write failed - check available disk space",
+              "File I/O Error", false);
         }
-
-        // Simple speed limit (blocking)
-        int64_t speedLimit = state->speedLimitBytes.load();
-        if (speedLimit > 0) {
-          auto now = std::chrono::steady_clock::now();
-          auto elapsedMs =
-              std::chrono::duration_cast<std::chrono::milliseconds>(
-                  now - lastThrottleUpdate)
-                  .count();
-          double targetMs = (bytesRead * 1000.0) / speedLimit;
-          if (elapsedMs < targetMs) {
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds(static_cast<int>(targetMs - elapsedMs)));
+        return failRead(error);
+      }
+#endif
+    } else if (context.mapped) {
+      // Read straight into the file's pages
+      char *target =
+          MapForWrite(context, progress, progress.position, toRead, true);
+      if (!target) {
+        return context.Fail("Disk write failed - check available disk space",
+                            "File I/O Error", false);
+      }
+      if (!connection->Read(target, toRead, bytesRead, error)) {
+        return failRead(error);
+      }
+    } else {
+      if (buffer.Size() != progress.readSize) {
+        buffer = BufferPool::Buffer();
+      }
+      // Over the memory budget (or out of memory) the read shrinks first,
+      // then the data waits in the socket until the writers have handed
+      // some buffers back
+      while (!buffer.Data()) {
+        buffer = state->bufferPool.AcquireWithin(progress.readSize,
+                                                 Config::MIN_READ_SIZE);
+        if (!buffer.Data()) {
+          if (IsAborted(state, download) || context.failed.load()) {
+            return SegmentResult::Aborted;
           }
-          lastThrottleUpdate = std::chrono::steady_clock::now();
+          std::this_thread::sleep_for(
+              std::chrono::milliseconds(Config::WRITE_RETRY_MS));
         }
       }
-    } else {
-      // Read Error
-      file.close();
-      InternetCloseHandle(hUrl);
-      download->SetStatus(DownloadStatus::Error);
-      download->SetErrorMessage("Read Error: " +
-                                std::to_string(GetLastError()));
-      if (completionCallback)
-        completionCallback(download->GetId(), false, "Read Error");
-      return false;
+      toRead = std::min(toRead, buffer.Size());
+      if (!connection->Read(buffer.Data(), toRead, bytesRead, error)) {
+        // Read Error
+        return failRead(error);
+      }
+    }
+
+    if (bytesRead == 0) {
+      if (!openEnded) {
+        return failRead("Connection closed before the segment was complete");
+      }
+      download->CompleteChunk(chunkIndex);
+      break;
+    }
+
+    // A steal during the read may have moved the end below what arrived;
+    // the stolen bytes are left to the connection that took them (a direct
+    // read has written them already, with the same contents)
+    if (!openEnded) {
+      int64_t wanted =
+          download->GetChunkEnd(chunkIndex) - progress.position + 1;
+      if (wanted <= 0) {
+        break;
+      }
+      bytesRead = static_cast<size_t>(std::min<int64_t>(bytesRead, wanted));
     }
 
-  } while (bytesRead > 0);
+    // The buffer goes to the writer; the next read takes a fresh one
+    if (directFd < 0 && !context.mapped &&
+        !context.writer->Submit(progress.position, std::move(buffer),
+                                bytesRead)) {
+      return context.Fail("Disk write failed - check available disk space",
+                          "File I/O Error", false);
+    }
 
-  file.close();
-  InternetCloseHandle(hUrl);
+    // Wait in short steps so a pause or cancel is not held up by a low
+    // limit
+    int delayMs = RecordSegmentProgress(state, download, chunkIndex, progress,
+                                        bytesRead, context);
+    if (progress.replace) {
+      // The range is asked again, from where it stopped, on a fresh
+      // connection (maybe to another source)
+      if (context.mapped && !CheckpointMapped(progress, true, true)) {
+        return context.Fail("Disk write failed - check available disk space",
+                            "File I/O Error", false);
+      }
+      return SegmentResult::Reconnect;
+    }
+    while (delayMs > 0 && !IsAborted(state, download)) {
+      int step = std::min(delayMs, Config::SPEED_UPDATE_INTERVAL_MS);
+      std::this_thread::sleep_for(std::chrono::milliseconds(step));
+      delayMs -= step;
+    }
 
-  download->SetStatus(DownloadStatus::Completed);
-  download->ResetRetry();
-  if (completionCallback)
-    completionCallback(download->GetId(), true, "");
+    if (context.mapped && !CheckpointMapped(progress, false, true)) {
+      return context.Fail("Disk write failed - check available disk space",
+                          "File I/O Error", false);
+    }
+  }
 
-  return true;
+  if (context.mapped && !CheckpointMapped(progress, true, true)) {
+    return context.Fail("Disk write failed - check available disk space",
+                        "File I/O Error", false);
+  }
+  return SegmentResult::Completed;
 }
 
 void DownloadEngine::CleanupCompletedDownloads() {
@@ -1,19 +1,28 @@
 #pragma once
 
+#include "BandwidthLimiter.h"
+#include "BufferPool.h"
+#include "ConnectionTuner.h"
 #include "Download.h"
+#include "EngineConfig.h"
+#include "FileWriter.h"
+#include "HttpTransport.h"
+#include "MappedFile.h"
+#include "MirrorSet.h"
+#include "RetryScheduler.h"
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#include <wininet.h>
 
-#pragma comment(lib, "wininet.lib")
+class EventLoop;
 
 class DownloadEngine {
 public:
@@ -32,25 +41,72 @@ public:
   void ResumeDownload(std::shared_ptr<Download> download);
   void CancelDownload(std::shared_ptr<Download> download);
 
-  // Get file info (size, resumable) without downloading
-  bool GetFileInfo(const std::string &url, int64_t &fileSize, bool &resumable);
-
   // Callbacks for progress updates
   using ProgressCallback = std::function<void(
       int downloadId, int64_t downloaded, int64_t total, double speed)>;
   using CompletionCallback = std::function<void(int downloadId, bool success,
                                                 const std::string &error)>;
+  // Called once a started download learned its size (-1 if the server did
+  // not tell) and whether it can be resumed
+  using MetadataCallback =
+      std::function<void(int downloadId, int64_t total, bool resumable)>;
 
   void SetProgressCallback(ProgressCallback callback);
   void SetCompletionCallback(CompletionCallback callback);
+  void SetMetadataCallback(MetadataCallback callback);
 
   // Settings
-  void SetMaxConnections(int connections) { m_maxConnections = connections; }
+  void SetMaxConnections(int connections);
+  // Adaptive: segmented downloads start with a few connections and add
+  // more, up to the maximum, while their speed keeps improving; fewer if
+  // the server answers 429 or 503. The count reached is remembered per
+  // host as the next download's start.
+  void SetAdaptiveConnections(bool enabled);
   void SetSpeedLimit(int64_t bytesPerSecond);
+  // Limits nested under the global one; bytesPerSecond <= 0 removes them.
+  // A download's own limit is set on the Download.
+  void SetHostSpeedLimit(const std::string &host, int64_t bytesPerSecond);
+  void SetCategorySpeedLimit(const std::string &category,
+                             int64_t bytesPerSecond);
   void SetUserAgent(const std::string &userAgent);
   void SetProxy(const std::string &proxyHost, int proxyPort);
   void SetSSLVerification(bool verify);
   bool GetSSLVerification() const;
+  // Lets threaded transfers move plain bodies from the socket to the file
+  // inside the kernel where the transport supports it (Linux only).
+  // Enabled by default.
+  void SetZeroCopy(bool enabled);
+  // Lets the file writers submit their writes through io_uring where the
+  // kernel allows it (Linux only). Enabled by default.
+  void SetAsyncFileIo(bool enabled);
+  // Caps the bytes all downloads together hold in receive buffers and
+  // write queues; connections stop reading while it is used up. The
+  // buffers are shared by the whole process, and so is the cap.
+  // bytes <= 0 removes it. A budget below MinMemoryBudget for the maximum
+  // connection count is raised to that.
+  void SetMemoryBudget(int64_t bytes);
+  // The smallest budget that still lets each of connections hold its
+  // largest read
+  static int64_t MinMemoryBudget(int connections);
+  // A connection whose speed over the last windowMs falls below percent of
+  // the median of the download's other connections, or that receives
+  // nothing for that long, is closed and its range requested again on a
+  // fresh connection. percent <= 0 turns this off.
+  void SetSlowConnectionPolicy(int percent, int windowMs);
+  // WriteBehind hands received data to a writer thread per download.
+  // Mapped copies it straight into a memory mapping of the file, for files
+  // whose size is known up front; others still use the writer. Mapped is
+  // not available on every platform and falls back the same way.
+  enum class WriteMode { WriteBehind, Mapped };
+  void SetWriteMode(WriteMode mode);
+
+  // Threaded runs every connection on its own thread. EventLoop drives all
+  // connections from a small fixed set of epoll threads (Linux only);
+  // loopThreads <= 0 picks a default. Returns false if the mode is not
+  // available on this platform.
+  enum class EngineMode { Threaded, EventLoop };
+  bool SetEngineMode(EngineMode mode, int loopThreads = 0);
+  EngineMode GetEngineMode() const;
 
   // CA bundle configuration (No longer needed for WinINet, kept for API compatibility if needed, but ignored)
   void SetCABundlePath(const std::string &path) { m_caBundlePath = path; }
@@ -59,40 +115,139 @@ public:
   bool GetUseNativeCAStore() const { return m_useNativeCAStore; }
 
 private:
-  struct SessionEntry {
-    HINTERNET handle = nullptr;
-    std::atomic<int> activeCount{0};
-    std::atomic<bool> closing{false};
-    std::mutex handleMutex;
-  };
-
   struct EngineState {
-    std::mutex sessionMutex;
-    std::shared_ptr<SessionEntry> session;
-    std::vector<std::shared_ptr<SessionEntry>> retiredSessions;
+    // Requests in flight hold their own reference, so replacing the
+    // transport (e.g. on a proxy change) never closes it under them
+    std::mutex transportMutex;
+    std::shared_ptr<HttpTransport> transport;
+    // Keep-alive sockets and host addresses shared by all downloads
+    // (socket transports only)
+    std::shared_ptr<ConnectionPool> connectionPool;
+    std::shared_ptr<HostResolver> resolver;
+    // Downloads waiting for their next attempt; the engine starts them
+    // again when it is due
+    std::unique_ptr<RetryScheduler> retryScheduler;
 
     std::atomic<bool> running{false};
-    std::atomic<int64_t> speedLimitBytes{0};
+    std::atomic<int> maxConnections{8};
+    std::atomic<int64_t> memoryBudget{0}; // As asked for; 0 for none
+    std::atomic<bool> adaptiveConnections{false};
+    std::mutex tuningMutex;
+    std::map<std::string, int> hostConnections; // Learned by the tuners
+    // Caps the combined throughput of all downloads
+    BandwidthLimiter bandwidthLimiter;
+    // Receive buffers, reused as connections change their read size and
+    // as the writers hand them back
+    BufferPool &bufferPool = BufferPool::Shared();
+    // Nested limits, created for every host and category a transfer runs
+    // on so a limit set later applies to it right away
+    std::mutex limiterMutex;
+    std::map<std::string, std::shared_ptr<BandwidthLimiter>> hostLimiters;
+    std::map<std::string, std::shared_ptr<BandwidthLimiter>> categoryLimiters;
     std::string userAgent;
     std::string proxyUrl;
     std::atomic<bool> verifySSL{true};
+    std::atomic<bool> zeroCopy{true};
+    std::atomic<bool> asyncFileIo{true};
+    std::atomic<WriteMode> writeMode{WriteMode::WriteBehind};
+    std::atomic<int> slowPercent{Config::SLOW_CONNECTION_PERCENT};
+    std::atomic<int> slowWindowMs{Config::SLOW_CONNECTION_WINDOW_MS};
 
     std::mutex callbackMutex;
     ProgressCallback progressCallback;
     CompletionCallback completionCallback;
+    MetadataCallback metadataCallback;
+
+    std::atomic<EngineMode> mode{EngineMode::Threaded};
+    std::mutex loopMutex;
+    std::vector<std::shared_ptr<EventLoop>> loops;
+    size_t nextLoop = 0;
+  };
+
+  // Reassign: the connection's source was dropped; its chunk is left for
+  // a connection to another one. Reconnect: the connection broke off
+  // mid-body or was too slow; its chunk is left for a new request from
+  // where it stopped. Throttled: the server turned the connection away as
+  // overloaded; its chunk is left to the others and it is not replaced.
+  enum class SegmentResult {
+    Completed,
+    Aborted,
+    Failed,
+    Reassign,
+    Reconnect,
+    Throttled
   };
+  enum class TransferOutcome { Completed, Failed, Aborted, Retry };
 
-  struct SessionUsage {
-    explicit SessionUsage(std::shared_ptr<SessionEntry> entry);
-    ~SessionUsage();
-    HINTERNET handle() const;
+  // Shared state of the connections working on one download
+  struct SegmentContext {
+    std::atomic<bool> failed{false};
+    std::atomic<bool> retryable{false};
+    // Longest wait a 429 or 503 asked for, applied to the next retry
+    std::atomic<int64_t> retryAfterMs{0};
+    // The server reported a different version of the file than the one
+    // being resumed; it is fetched again from the start
+    std::atomic<bool> remoteChanged{false};
+    std::mutex errorMutex;
+    std::string errorMessage;
+    std::string callbackError;
+    // The layout is not planned yet; the first response decides it
+    bool probing = false;
+    // Host and category limits of the download
+    std::vector<std::shared_ptr<BandwidthLimiter>> limiters;
+    // Output file; its resume sidecar is saved from the writer's thread
+    std::string filePath;
+    std::chrono::steady_clock::time_point lastResumeSave;
+    std::atomic<int> resumeSaves{0}; // Waiting for the writer's flush
+    std::atomic<int> slowReplacements{0};
+    // Adaptive mode: picks the connection count, from the speed measured
+    // since lastTune. Threaded transfers count their workers, and how
+    // many of them should leave after their chunk.
+    std::unique_ptr<ConnectionTuner> tuner;
+    std::string host;
+    std::chrono::steady_clock::time_point lastTune;
+    int64_t lastTuneBytes = 0;
+    std::atomic<int> workers{0};
+    std::atomic<int> surplusWorkers{0};
+    // The download's URL and, once ranges of a known size can be mixed,
+    // its mirrors
+    std::unique_ptr<MirrorSet> mirrors;
+    // Set in mapped write mode once the size is known; takes the place of
+    // the writer
+    std::unique_ptr<MappedFile> mapped;
+    // Takes the received data to disk off the connections' threads.
+    // Declared last: closing it stops the thread that uses the members
+    // above.
+    std::unique_ptr<FileWriter> writer;
 
-  private:
-    std::shared_ptr<SessionEntry> m_entry;
+    // Records the first failure; later ones are ignored
+    SegmentResult Fail(const std::string &message,
+                       const std::string &callbackErrorText, bool isRetryable);
   };
 
+  // Bookkeeping of one connection for the chunk it is writing
+  struct SegmentProgress {
+    int64_t position = 0;
+    int64_t lastPosition = 0;
+    std::chrono::steady_clock::time_point lastSpeedUpdate;
+    int mirror = 0; // Source the connection reads from
+    // Bytes to ask for per read, follows the connection's speed
+    size_t readSize = Config::MIN_READ_SIZE;
+    // Positions at the speed updates of the last slow-connection window,
+    // and whether the connection fell so far behind it is to be replaced
+    std::deque<std::pair<std::chrono::steady_clock::time_point, int64_t>>
+        samples;
+    bool replace = false;
+    // Mapped write mode: the window being written, and where the part not
+    // yet checkpointed starts
+    MappedFile::View view;
+    int64_t checkpointPosition = 0;
+    std::chrono::steady_clock::time_point lastCheckpoint;
+  };
+
+  struct EventLoopTransfer;
+
   // Settings
-  int m_maxConnections;
   std::string m_caBundlePath;
   bool m_useNativeCAStore;
 
@@ -107,21 +262,177 @@ private:
   // Cleanup completed futures
   void CleanupCompletedDownloads();
 
-  static void ConfigureSessionTimeouts(HINTERNET session);
-  static HINTERNET OpenSession(const std::string &userAgent,
-                               const std::string &proxyUrl);
-  static void CloseSessionHandle(const std::shared_ptr<SessionEntry> &entry);
-  static void CloseSessionIfIdle(const std::shared_ptr<SessionEntry> &entry);
-  static bool ParseContentRangeStart(const std::string &value,
-                                     int64_t &startOut);
-
-  static void CleanupRetiredSessions(
-      const std::shared_ptr<EngineState> &state);
-
-  bool ReinitializeSession(const std::string &proxyUrl);
+  static std::shared_ptr<HttpTransport>
+  AcquireTransport(const std::shared_ptr<EngineState> &state);
+  // Returns the limiter for key, adding an unlimited one if there is none.
+  // Unlimited limiters no transfer uses any more are dropped.
+  static std::shared_ptr<BandwidthLimiter> AcquireLimiter(
+      std::map<std::string, std::shared_ptr<BandwidthLimiter>> &limiters,
+      const std::string &key);
+  bool ReinitializeTransport(const std::string &proxyUrl);
 
   // Helper methods
   static bool PerformDownload(std::shared_ptr<EngineState> state,
                               std::shared_ptr<Download> download);
-  
+  static void StartEventLoopTransfer(std::shared_ptr<EngineState> state,
+                                     std::shared_ptr<Download> download,
+                                     const std::shared_ptr<EventLoop> &loop);
+  static std::shared_ptr<EventLoop>
+  PickEventLoop(const std::shared_ptr<EngineState> &state);
+
+  // Plans the chunk layout, prepares the output file and opens
+  // context.writer on it. Returns the number of connections to open, or 0
+  // after reporting a failure. Without a chunk map to reuse, a single
+  // probe chunk is planned and context.probing is set.
+  static int PrepareTransfer(const std::shared_ptr<EngineState> &state,
+                             const std::shared_ptr<Download> &download,
+                             const CompletionCallback &completionCallback,
+                             std::string &filePath, SegmentContext &context);
+  // Finishes planning once the probe's response headers arrived: records
+  // the size and range support, lays out the chunks and gives the probing
+  // connection the chunk its response starts with. Returns the number of
+  // connections to use, including the probing one, or 0 after a failure.
+  static int ApplyProbeResponse(const std::shared_ptr<EngineState> &state,
+                                const std::shared_ptr<Download> &download,
+                                const HttpResponse &response,
+                                const std::string &filePath,
+                                SegmentContext &context, int &chunkIndex,
+                                DownloadChunk &chunk);
+  // Sends the probe of a threaded transfer and applies its response
+  static int OpenProbe(const std::shared_ptr<EngineState> &state,
+                       const std::shared_ptr<Download> &download,
+                       HttpTransport &transport, const std::string &filePath,
+                       SegmentContext &context,
+                       std::unique_ptr<HttpConnection> &connection,
+                       int &chunkIndex);
+  static void UpdateDownloadSpeed(
+      const std::shared_ptr<Download> &download,
+      const ProgressCallback &progressCallback, int64_t &lastBytes,
+      std::chrono::steady_clock::time_point &lastSpeedUpdate);
+  // Waits for the writer, then sets the final status and reports it,
+  // unless a retry is due
+  static TransferOutcome
+  FinishTransfer(const std::shared_ptr<EngineState> &state,
+                 const std::shared_ptr<Download> &download,
+                 const CompletionCallback &completionCallback,
+                 SegmentContext &context);
+  static void ApplyMemoryBudget(EngineState &state);
+  static int PlanConnectionCount(int maxConnections, int64_t remainingBytes,
+                                 bool resumable);
+  // In adaptive mode sets up context.tuner for up to workerCount
+  // connections. Returns how many to open first.
+  static int StartTuning(const std::shared_ptr<EngineState> &state,
+                         const std::shared_ptr<Download> &download,
+                         SegmentContext &context, int workerCount);
+  // Reports the speed to the tuner every TUNE_INTERVAL_MS. Returns the
+  // number of connections wanted, 0 if the count is fixed.
+  static int TuneConnections(const std::shared_ptr<Download> &download,
+                             SegmentContext &context);
+  // Keeps the count the tuner reached as the start for the host
+  static void RememberConnections(const std::shared_ptr<EngineState> &state,
+                                  const std::shared_ptr<Download> &download,
+                                  SegmentContext &context);
+  static bool IsAborted(const std::shared_ptr<EngineState> &state,
+                        const std::shared_ptr<Download> &download);
+  // Fetches chunks until none are left, starting with the chunk of an
+  // already opened connection if one is given
+  static void RunSegmentWorker(const std::shared_ptr<EngineState> &state,
+                               const std::shared_ptr<Download> &download,
+                               HttpTransport &transport,
+                               SegmentContext &context,
+                               std::unique_ptr<HttpConnection> connection,
+                               int chunkIndex);
+  static HttpRequest
+  BuildSegmentRequest(const std::shared_ptr<EngineState> &state,
+                      const std::shared_ptr<Download> &download,
+                      const std::string &url, const DownloadChunk &chunk,
+                      bool probe, bool &rangeRequest);
+  // False if the response cannot be used; failure then tells how the
+  // connection ends: Failed, Reassign (only its source, mirror >= 0, was
+  // dropped) or Throttled
+  static bool CheckSegmentResponse(const std::shared_ptr<Download> &download,
+                                   const HttpResponse &response,
+                                   const DownloadChunk &chunk,
+                                   bool rangeRequest, int mirror,
+                                   SegmentContext &context,
+                                   SegmentResult &failure);
+  // Drops a failing source if another one is left (Reassign), otherwise
+  // fails the transfer. mirror < 0 always fails it.
+  static SegmentResult FailSource(SegmentContext &context, int mirror,
+                                  const std::string &message,
+                                  const std::string &callbackErrorText,
+                                  bool isRetryable);
+  // A read that broke off mid-body (reset, timeout, early close):
+  // reconnects after delayMs if the chunk can resume from the current byte
+  // and has breaks in a row left; otherwise the same as FailSource
+  static SegmentResult FailRead(const std::shared_ptr<Download> &download,
+                                SegmentContext &context, int chunkIndex,
+                                int mirror, const std::string &message,
+                                int &delayMs);
+  // Lets the transfer use the download's mirrors, if its ranges can be
+  // fetched from anywhere
+  static void AddMirrors(const std::shared_ptr<Download> &download,
+                         SegmentContext &context);
+  // The recorded validator to send as If-Range, empty if there is none
+  // that may be used
+  static std::string
+  IfRangeValidator(const std::shared_ptr<Download> &download);
+  // True if a response to a range request shows the remote file is no
+  // longer the one whose parts are on disk
+  static bool RemoteChanged(const std::shared_ptr<Download> &download,
+                            const HttpResponse &response);
+  // Records bytes received at the connection's position. Returns how many
+  // milliseconds the connection should pause to honour the speed limit.
+  static int RecordSegmentProgress(const std::shared_ptr<EngineState> &state,
+                                   const std::shared_ptr<Download> &download,
+                                   int chunkIndex, SegmentProgress &progress,
+                                   size_t bytes, SegmentContext &context);
+  // Read size for a connection receiving speed bytes per second
+  static size_t ReadSizeForSpeed(double speed);
+  // Adds a sample at the connection's position and sets progress.replace
+  // once its speed over a full window is far behind the other connections
+  static void CheckSlowConnection(const std::shared_ptr<EngineState> &state,
+                                  const std::shared_ptr<Download> &download,
+                                  int chunkIndex, SegmentProgress &progress,
+                                  SegmentContext &context,
+                                  std::chrono::steady_clock::time_point now);
+  // Whether a connection receiving speed bytes per second on the chunk is
+  // far enough behind the others to be replaced; counts the replacement
+  static bool IsSlowConnection(const std::shared_ptr<EngineState> &state,
+                               const std::shared_ptr<Download> &download,
+                               int chunkIndex, double speed,
+                               SegmentContext &context);
+  // Switches context to mapped writes if the engine is set to them and the
+  // size is known. Stays with the writer if the file cannot be mapped.
+  static void MapOutput(const std::shared_ptr<EngineState> &state,
+                        const std::shared_ptr<Download> &download,
+                        const std::string &filePath, SegmentContext &context);
+  // Mapped write mode: returns where the bytes at offset go and clips size
+  // to the mapped window. Moves the connection to the window holding
+  // offset as needed, checkpointing the one it leaves. Null if mapping or
+  // the checkpoint failed.
+  static char *MapForWrite(SegmentContext &context, SegmentProgress &progress,
+                           int64_t offset, size_t &size, bool wait);
+  // Writes back what the connection mapped since its last checkpoint, once
+  // MAP_CHECKPOINT_MS passed or when forced. wait blocks until it is on
+  // disk. Returns false on an I/O error.
+  static bool CheckpointMapped(SegmentProgress &progress, bool force,
+                               bool wait);
+  // Takes over the chunk map an earlier run of this URL saved next to
+  // filePath, e.g. before a crash. Returns false if there is none that
+  // fits.
+  static bool RestoreResumeState(const std::shared_ptr<Download> &download,
+                                 const std::string &filePath);
+  // Saves the chunk map next to the file once the data it counts is on
+  // disk, at most every RESUME_CHECKPOINT_MS unless forced. Does not wait
+  // for the disk.
+  static void CheckpointResume(const std::shared_ptr<Download> &download,
+                               SegmentContext &context, bool force);
+  // Opens a request to the mirror for the chunk unless a connection is
+  // passed in
+  static SegmentResult DownloadSegment(
+      const std::shared_ptr<EngineState> &state,
+      const std::shared_ptr<Download> &download, HttpTransport &transport,
+      int chunkIndex, int mirror, SegmentContext &context,
+      std::unique_ptr<HttpConnection> connection);
 };
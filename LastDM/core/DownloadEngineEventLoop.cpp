@@ -0,0 +1,1171 @@
+// Event loop transfer mode: every connection of a download is a
+// non-blocking socket driven by one of the engine's epoll threads.
+
+#include "DownloadEngine.h"
+#include "ConnectionPool.h"
+#include "EngineConfig.h"
+#include "ConnectRace.h"
+#include "EventLoop.h"
+#include "HostResolver.h"
+#include "HttpProtocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+constexpr int MAX_REDIRECTS = 5;
+constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+
+std::string SystemError(const std::string &what, int error) {
+  return what + ": " + std::strerror(error);
+}
+
+// Consumes the framing that ends a body (e.g. the last chunk of a chunked
+// response). Returns true if the response ended exactly with the input.
+bool FinishBody(HttpBodyDecoder &decoder, const char *data, size_t size) {
+  while (size > 0 && !decoder.IsComplete()) {
+    size_t before = size;
+    const char *body = nullptr;
+    size_t bodySize = 0;
+    if (!decoder.Next(data, size, 0, body, bodySize) || size == before) {
+      return false;
+    }
+  }
+  return decoder.IsComplete() && size == 0;
+}
+
+} // namespace
+
+struct DownloadEngine::EventLoopTransfer
+    : public std::enable_shared_from_this<EventLoopTransfer> {
+  using Clock = std::chrono::steady_clock;
+
+  struct Connection {
+    enum class Phase { Resolving, Connecting, Sending, Headers, Body };
+
+    uint64_t id = 0; // Finds the connection again after a lookup
+    int fd = -1;
+    int chunkIndex = -1;
+    DownloadChunk chunk{0, 0};
+    bool rangeRequest = false;
+    bool probe = false; // Its response decides the chunk layout
+    HttpRequest request;
+
+    Phase phase = Phase::Connecting;
+    HttpProtocol::Url url;
+    int redirects = 0;
+    std::string poolKey;
+    // Connect attempts racing until one succeeds, and the timer starting
+    // the next one
+    std::unique_ptr<ConnectRace> race;
+    EventLoop::TimerId attemptTimer = 0;
+    bool reused = false;    // Socket came from the connection pool
+    bool keepAlive = false; // Server allows another request on it
+    bool reusable = false;  // Response was read to its exact end
+    // How the connection ends after an error: Reassign if only its source
+    // was dropped
+    SegmentResult failure = SegmentResult::Failed;
+    int reconnectDelayMs = 0; // Backoff before a broken read is asked again
+    std::string message;
+    size_t sent = 0;
+    std::string head;
+    HttpBodyDecoder decoder;
+
+    SegmentProgress progress;
+    Clock::time_point lastActivity;
+    EventLoop::TimerId resumeTimer = 0;
+  };
+
+  std::shared_ptr<EngineState> state;
+  std::shared_ptr<Download> download;
+  EventLoop &loop;
+  std::weak_ptr<EventLoop> loopHandle; // Posts to the loop from lookups
+
+  ProgressCallback progressCallback;
+  CompletionCallback completionCallback;
+  std::string userAgent;
+  std::string proxyUrl;
+  std::string filePath;
+  SegmentContext context;
+  int64_t minStealSize = 0;
+  int tuned = 0; // Connections the tuner asked for so far
+
+  std::vector<std::unique_ptr<Connection>> connections;
+  uint64_t nextConnectionId = 1;
+
+  int64_t lastBytes = 0;
+  Clock::time_point lastSpeedUpdate;
+  EventLoop::TimerId tickTimer = 0;
+  EventLoop::TimerId drainTimer = 0; // Waiting for the writer to finish
+  // Segments waiting out their backoff before they are reopened
+  std::vector<EventLoop::TimerId> reconnectTimers;
+  bool finalCheckpoint = false;
+  bool finished = false;
+
+  EventLoopTransfer(std::shared_ptr<EngineState> engineState,
+                    std::shared_ptr<Download> target,
+                    const std::shared_ptr<EventLoop> &eventLoop)
+      : state(std::move(engineState)), download(std::move(target)),
+        loop(*eventLoop), loopHandle(eventLoop) {}
+
+  ~EventLoopTransfer() {
+    // Only reached with connections left when the loop shuts down
+    for (auto &connection : connections) {
+      if (connection->fd >= 0) {
+        close(connection->fd);
+      }
+      download->ReleaseChunk(connection->chunkIndex);
+    }
+  }
+
+  // Opens the file and plans the segments. Runs on a thread of its own:
+  // the disk work (opening, reserving space, loading the chunk map) would
+  // hold up every other transfer on the loop. Returns the connections to
+  // start with, or 0 if the transfer ended here.
+  int Prepare() {
+    {
+      std::lock_guard<std::mutex> lock(state->callbackMutex);
+      progressCallback = state->progressCallback;
+      completionCallback = state->completionCallback;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->transportMutex);
+      userAgent = state->userAgent;
+      proxyUrl = state->proxyUrl;
+    }
+
+    if (!state->running.load()) {
+      return 0;
+    }
+    return PrepareTransfer(state, download, completionCallback, filePath,
+                           context);
+  }
+
+  // Opens the first connections, on the loop thread
+  void Start(int workerCount) {
+    if (!state->running.load()) {
+      return;
+    }
+
+    minStealSize = download->IsResumable() ? Config::MIN_STEAL_SIZE : 0;
+    lastBytes = download->GetDownloadedSize();
+    lastSpeedUpdate = Clock::now();
+    ScheduleTick();
+
+    tuned = workerCount;
+    for (int i = 0; i < workerCount; ++i) {
+      if (!OpenNextSegment()) {
+        break;
+      }
+    }
+    FinishIfIdle();
+  }
+
+  void ScheduleTick() {
+    auto self = shared_from_this();
+    tickTimer = loop.AddTimer(Config::SPEED_UPDATE_INTERVAL_MS,
+                              [self]() { self->OnTick(); });
+  }
+
+  // Merges progress and enforces aborts and timeouts
+  void OnTick() {
+    tickTimer = 0;
+    UpdateDownloadSpeed(download, progressCallback, lastBytes,
+                        lastSpeedUpdate);
+    CheckpointResume(download, context, false);
+    if (state->connectionPool) {
+      state->connectionPool->Reap();
+    }
+
+    if (IsAborted(state, download) || context.failed.load()) {
+      CloseAll();
+      return;
+    }
+
+    // Closing one connection can open another or, once the transfer
+    // failed, close them all, so they are looked up again by id
+    auto now = Clock::now();
+    std::vector<uint64_t> expired;
+    std::vector<uint64_t> stalled;
+    auto stallTime = std::chrono::milliseconds(state->slowWindowMs.load());
+    for (auto &connection : connections) {
+      if (connection->resumeTimer != 0) {
+        continue;
+      }
+      long limit = connection->phase == Connection::Phase::Resolving ||
+                           connection->phase == Connection::Phase::Connecting
+                       ? Config::CONNECT_TIMEOUT_MS
+                       : Config::RECEIVE_TIMEOUT_MS;
+      if (now - connection->lastActivity > std::chrono::milliseconds(limit)) {
+        expired.push_back(connection->id);
+      } else if (connection->phase == Connection::Phase::Body &&
+                 now - connection->lastActivity >= stallTime) {
+        stalled.push_back(connection->id);
+      }
+    }
+    // A body that stopped arriving while the other connections go on is
+    // asked again on a fresh connection
+    for (uint64_t id : stalled) {
+      Connection *connection = FindConnection(id);
+      if (!connection || !IsSlowConnection(state, download,
+                                           connection->chunkIndex, 0.0,
+                                           context)) {
+        continue;
+      }
+      CloseConnection(connection, SegmentResult::Reconnect);
+      if (finished) {
+        return;
+      }
+      if (IsAborted(state, download) || context.failed.load()) {
+        CloseAll();
+        return;
+      }
+    }
+    for (uint64_t id : expired) {
+      Connection *connection = FindConnection(id);
+      if (!connection) {
+        continue;
+      }
+      bool opening = connection->phase != Connection::Phase::Body;
+      if (opening) {
+        FailConnection(connection, "Failed to open URL. Receive timed out",
+                       "Connection failed", true);
+      } else {
+        FailRead(connection, "Receive timed out");
+      }
+      CloseConnection(connection, connection->failure);
+      if (finished) {
+        return;
+      }
+      if (IsAborted(state, download) || context.failed.load()) {
+        CloseAll();
+        return;
+      }
+    }
+
+    // Adaptive mode: connections are added as the tuner raises the count;
+    // when it lowers it, closed ones are not replaced
+    int target = TuneConnections(download, context);
+    for (; tuned < target; ++tuned) {
+      if (!OpenNextSegment()) {
+        break;
+      }
+    }
+    tuned = target;
+    if (finished) {
+      return;
+    }
+
+    ScheduleTick();
+  }
+
+  Connection *FindConnection(uint64_t id) const {
+    auto it = std::find_if(connections.begin(), connections.end(),
+                           [id](const std::unique_ptr<Connection> &item) {
+                             return item->id == id;
+                           });
+    return it == connections.end() ? nullptr : it->get();
+  }
+
+  bool OpenNextSegment() {
+    if (context.failed.load() || IsAborted(state, download)) {
+      return false;
+    }
+
+    int chunkIndex = download->AcquireChunk(minStealSize);
+    if (chunkIndex < 0) {
+      return false;
+    }
+
+    auto connection = std::make_unique<Connection>();
+    connection->id = nextConnectionId++;
+    connection->chunkIndex = chunkIndex;
+    if (!download->GetChunk(chunkIndex, connection->chunk)) {
+      download->ReleaseChunk(chunkIndex);
+      context.Fail("Invalid chunk", "Download incomplete", false);
+      return false;
+    }
+    connection->probe = context.probing;
+    // The probe goes to the download's own URL
+    connection->progress.mirror =
+        context.mirrors->Acquire(connection->probe ? 0 : -1);
+    connection->request = BuildSegmentRequest(
+        state, download, context.mirrors->GetUrl(connection->progress.mirror),
+        connection->chunk, connection->probe, connection->rangeRequest);
+    connection->progress.position = connection->chunk.currentByte;
+    connection->progress.lastPosition = connection->chunk.currentByte;
+    connection->progress.lastSpeedUpdate = Clock::now();
+
+    Connection *raw = connection.get();
+    connections.push_back(std::move(connection));
+    if (!BeginRequest(raw, raw->request.url)) {
+      CloseConnection(raw, raw->failure);
+      return false;
+    }
+    return true;
+  }
+
+  // Reports an error of the connection's source; the probe's always fails
+  // the transfer. Returns how the connection ends, also kept in failure.
+  SegmentResult FailConnection(Connection *connection,
+                               const std::string &message,
+                               const std::string &callbackErrorText,
+                               bool isRetryable) {
+    connection->failure = FailSource(
+        context, connection->probe ? -1 : connection->progress.mirror,
+        message, callbackErrorText, isRetryable);
+    return connection->failure;
+  }
+
+  // Reports a read that broke off mid-body; the chunk may be fetched again
+  // from where it stopped, after reconnectDelayMs
+  SegmentResult FailRead(Connection *connection, const std::string &message) {
+    connection->failure = DownloadEngine::FailRead(
+        download, context, connection->chunkIndex,
+        connection->probe ? -1 : connection->progress.mirror, message,
+        connection->reconnectDelayMs);
+    return connection->failure;
+  }
+
+  // Starts (or restarts, after a redirect) the request on a new socket
+  bool BeginRequest(Connection *connection, const std::string &url) {
+    if (!HttpProtocol::ParseUrl(url, connection->url)) {
+      FailConnection(connection, "Failed to open URL. Invalid URL: " + url,
+                     "Connection failed", false);
+      return false;
+    }
+    if (connection->url.scheme != "http") {
+      FailConnection(connection,
+                     "Failed to open URL. Unsupported scheme for the socket "
+                     "transport: " +
+                         connection->url.scheme,
+                     "Connection failed", false);
+      return false;
+    }
+
+    bool viaProxy = !proxyUrl.empty();
+    connection->message = HttpProtocol::FormatGetRequest(
+        connection->url, url, connection->request, userAgent, viaProxy,
+        state->connectionPool != nullptr);
+    connection->sent = 0;
+    connection->head.clear();
+    return Connect(connection, true);
+  }
+
+  // A pooled socket the server closed just as we reused it fails before
+  // any response arrives; the request then goes out on a new connection.
+  // Returns false if the failure has to be reported instead.
+  bool RetryOnFreshSocket(Connection *connection) {
+    if (!connection->reused) {
+      return false;
+    }
+
+    CloseSocket(connection);
+    connection->sent = 0;
+    connection->head.clear();
+    if (!Connect(connection, false)) {
+      CloseConnection(connection, connection->failure);
+    }
+    return true;
+  }
+
+  bool Register(Connection *connection, int fd, uint32_t events) {
+    auto self = shared_from_this();
+    return loop.Add(fd, events, [self, connection](uint32_t ready) {
+      self->OnEvent(connection, ready);
+    });
+  }
+
+  bool Connect(Connection *connection, bool allowPooled) {
+    std::string host = connection->url.host;
+    std::string port = connection->url.port;
+    if (!proxyUrl.empty()) {
+      HttpProtocol::ParseProxy(proxyUrl, host, port);
+    }
+
+    connection->poolKey = host + ":" + port;
+    connection->reused = false;
+    if (allowPooled && state->connectionPool) {
+      int fd = state->connectionPool->Acquire(connection->poolKey);
+      if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if (Register(connection, fd, EPOLLOUT)) {
+          connection->fd = fd;
+          connection->reused = true;
+          connection->phase = Connection::Phase::Sending;
+          connection->lastActivity = Clock::now();
+          return true;
+        }
+        close(fd);
+      }
+    }
+
+    // Lookups run off the loop thread unless the address cache has them
+    std::vector<HostResolver::Address> addresses;
+    if (state->resolver->GetCached(host, port, addresses)) {
+      return StartConnect(connection, host, port, addresses);
+    }
+
+    connection->phase = Connection::Phase::Resolving;
+    connection->lastActivity = Clock::now();
+    std::weak_ptr<EventLoopTransfer> weakSelf = shared_from_this();
+    std::weak_ptr<EventLoop> weakLoop = loopHandle;
+    uint64_t id = connection->id;
+    state->resolver->ResolveAsync(
+        host, port,
+        [weakSelf, weakLoop, id, host,
+         port](const std::vector<HostResolver::Address> &resolved,
+               const std::string &error) {
+          auto eventLoop = weakLoop.lock();
+          if (!eventLoop) {
+            return;
+          }
+          eventLoop->Post([weakSelf, id, host, port, resolved, error]() {
+            if (auto self = weakSelf.lock()) {
+              self->OnResolved(id, host, port, resolved, error);
+            }
+          });
+        });
+    return true;
+  }
+
+  void OnResolved(uint64_t id, const std::string &host,
+                  const std::string &port,
+                  const std::vector<HostResolver::Address> &addresses,
+                  const std::string &error) {
+    // The connection may have timed out or been closed meanwhile
+    Connection *connection = FindConnection(id);
+    if (!connection || connection->phase != Connection::Phase::Resolving) {
+      return;
+    }
+
+    if (!error.empty()) {
+      CloseConnection(connection,
+                      FailConnection(connection, "Failed to open URL. " + error,
+                                     "Connection failed", true));
+      return;
+    }
+    if (!StartConnect(connection, host, port, addresses)) {
+      CloseConnection(connection, connection->failure);
+    }
+  }
+
+  // Races connects to the addresses; the first socket to connect carries
+  // the request
+  bool StartConnect(Connection *connection, const std::string &host,
+                    const std::string &port,
+                    const std::vector<HostResolver::Address> &addresses) {
+    connection->race = std::make_unique<ConnectRace>(addresses);
+    connection->phase = Connection::Phase::Connecting;
+    connection->lastActivity = Clock::now();
+    return StartAttempt(connection, host, port);
+  }
+
+  // Starts the next connect attempt. Returns false, having reported the
+  // failure, once every address failed.
+  bool StartAttempt(Connection *connection, const std::string &host,
+                    const std::string &port) {
+    if (connection->attemptTimer != 0) {
+      loop.CancelTimer(connection->attemptTimer);
+      connection->attemptTimer = 0;
+    }
+
+    ConnectRace &race = *connection->race;
+    auto self = shared_from_this();
+    while (true) {
+      int fd = race.StartNext();
+      if (fd < 0) {
+        break;
+      }
+      if (loop.Add(fd, EPOLLOUT,
+                   [self, connection, fd, host, port](uint32_t) {
+                     self->OnAttempt(connection, fd, host, port);
+                   })) {
+        break;
+      }
+      // Left to the race to close
+    }
+
+    if (race.HasNext()) {
+      connection->attemptTimer = loop.AddTimer(
+          ConnectRace::ATTEMPT_DELAY_MS, [self, connection, host, port]() {
+            connection->attemptTimer = 0;
+            if (!self->StartAttempt(connection, host, port)) {
+              self->CloseConnection(connection, connection->failure);
+            }
+          });
+    }
+    if (!race.GetPending().empty()) {
+      return true;
+    }
+
+    FailConnection(connection,
+                   "Failed to open URL. " +
+                       SystemError("Failed to connect to " + host,
+                                   race.GetLastError()),
+                   "Connection failed", true);
+    return false;
+  }
+
+  void OnAttempt(Connection *connection, int fd, const std::string &host,
+                 const std::string &port) {
+    // Handlers are keyed by socket alone, so an event may be stale: for an
+    // attempt already finished, or a number since reused. It says nothing
+    // about any address.
+    if (!connection->race) {
+      return;
+    }
+    HostResolver::Address failed = {};
+    ConnectRace::Result result = connection->race->Finish(fd, failed);
+    if (result == ConnectRace::Result::Unknown) {
+      return;
+    }
+    loop.Remove(fd);
+    if (result == ConnectRace::Result::Failed) {
+      // A refused address makes way for the next one right away
+      state->resolver->ReportFailure(host, port, failed);
+      if (!StartAttempt(connection, host, port)) {
+        CloseConnection(connection, connection->failure);
+      }
+      return;
+    }
+
+    CancelConnect(connection);
+    if (!Register(connection, fd, EPOLLOUT)) {
+      int error = errno;
+      close(fd);
+      CloseConnection(
+          connection,
+          FailConnection(connection,
+                         "Failed to open URL. " +
+                             SystemError("Failed to watch the socket", error),
+                         "Connection failed", true));
+      return;
+    }
+    connection->fd = fd;
+    connection->phase = Connection::Phase::Sending;
+    connection->lastActivity = Clock::now();
+  }
+
+  // Drops the connect attempts still racing
+  void CancelConnect(Connection *connection) {
+    if (connection->attemptTimer != 0) {
+      loop.CancelTimer(connection->attemptTimer);
+      connection->attemptTimer = 0;
+    }
+    if (connection->race) {
+      for (int fd : connection->race->GetPending()) {
+        loop.Remove(fd);
+      }
+      connection->race.reset();
+    }
+  }
+
+  void CloseSocket(Connection *connection) {
+    CancelConnect(connection);
+    if (connection->fd >= 0) {
+      loop.Remove(connection->fd);
+      close(connection->fd);
+      connection->fd = -1;
+    }
+  }
+
+  void OnEvent(Connection *connection, uint32_t events) {
+    connection->lastActivity = Clock::now();
+
+    // A reset or other socket error fails the connection here rather than
+    // through the next send or receive. A plain hang-up still has the data
+    // left in the socket read first.
+    if (events & EPOLLERR) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error,
+                     &length) == 0 &&
+          error != 0) {
+        OnSocketError(connection, "Connection failed", error);
+        return;
+      }
+    }
+
+    if (connection->phase == Connection::Phase::Sending) {
+      if (!SendRequest(connection)) {
+        return;
+      }
+      if (connection->phase == Connection::Phase::Sending) {
+        return;
+      }
+    }
+
+    ReceiveAvailable(connection);
+  }
+
+  // Returns false if the connection was closed
+  bool SendRequest(Connection *connection) {
+    while (connection->sent < connection->message.size()) {
+      ssize_t result = send(connection->fd,
+                            connection->message.data() + connection->sent,
+                            connection->message.size() - connection->sent,
+                            MSG_NOSIGNAL);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return true;
+        }
+        int error = errno;
+        if (RetryOnFreshSocket(connection)) {
+          return false;
+        }
+        CloseConnection(connection,
+                        FailConnection(connection,
+                                       "Failed to open URL. " +
+                                           SystemError("Send failed", error),
+                                       "Connection failed", true));
+        return false;
+      }
+      connection->sent += static_cast<size_t>(result);
+    }
+
+    connection->message.clear();
+    connection->phase = Connection::Phase::Headers;
+    loop.Modify(connection->fd, EPOLLIN);
+    return true;
+  }
+
+  void ReceiveAvailable(Connection *connection) {
+    // While the disk is behind, data waits in the socket buffer rather
+    // than in memory
+    if (connection->phase == Connection::Phase::Body &&
+        context.writer->IsBacklogged()) {
+      PauseReading(connection, Config::WRITE_RETRY_MS);
+      return;
+    }
+
+    // Body data is received straight into the block the writer gets, so
+    // each read may need a fresh buffer
+    BufferPool::Buffer buffer;
+    // Bounded per wakeup so one fast connection cannot starve the others
+    for (int i = 0; i < Config::READS_PER_EVENT; ++i) {
+      if (!buffer.Data()) {
+        buffer = state->bufferPool.AcquireWithin(
+            connection->progress.readSize, Config::MIN_READ_SIZE);
+        if (!buffer.Data()) {
+          // Over the memory budget or out of memory for now; try again
+          // once some has been returned
+          PauseReading(connection, Config::WRITE_RETRY_MS);
+          return;
+        }
+      }
+
+      ssize_t result = recv(connection->fd, buffer.Data(), buffer.Size(), 0);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return;
+        }
+        OnSocketError(connection, "Receive failed", errno);
+        return;
+      }
+
+      if (result == 0) {
+        OnPeerClosed(connection);
+        return;
+      }
+
+      if (!Consume(connection, buffer, static_cast<size_t>(result))) {
+        return;
+      }
+    }
+  }
+
+  // Takes the first size bytes of buffer, which it may hand on. Returns
+  // false once the connection stopped reading (closed, redirected or
+  // throttled).
+  bool Consume(Connection *connection, BufferPool::Buffer &buffer,
+               size_t size) {
+    if (connection->phase == Connection::Phase::Headers) {
+      connection->head.append(buffer.Data(), size);
+      size_t end = connection->head.find("\r\n\r\n");
+      if (end == std::string::npos) {
+        if (connection->head.size() > MAX_HEADER_SIZE) {
+          CloseConnection(
+              connection,
+              FailConnection(connection,
+                             "Failed to open URL. Response headers too large",
+                             "Connection failed", true));
+          return false;
+        }
+        return true;
+      }
+
+      HttpResponse response;
+      std::map<std::string, std::string> headers;
+      if (!HttpProtocol::ParseResponseHead(connection->head.substr(0, end),
+                                           response, headers)) {
+        CloseConnection(
+            connection,
+            FailConnection(connection,
+                           "Failed to open URL. Malformed HTTP response",
+                           "Connection failed", true));
+        return false;
+      }
+
+      auto location = headers.find("location");
+      if (HttpProtocol::IsRedirect(response.statusCode) &&
+          location != headers.end()) {
+        CloseSocket(connection);
+        if (++connection->redirects > MAX_REDIRECTS) {
+          CloseConnection(connection,
+                          FailConnection(connection,
+                                         "Failed to open URL. Too many "
+                                         "redirects",
+                                         "Connection failed", true));
+          return false;
+        }
+        std::string next =
+            HttpProtocol::ResolveRedirect(connection->url, location->second);
+        if (!BeginRequest(connection, next)) {
+          CloseConnection(connection, connection->failure);
+        }
+        return false;
+      }
+
+      // A range past the end (e.g. of an empty file) is asked again
+      // without one
+      if (connection->probe && response.statusCode == 416 &&
+          connection->request.rangeStart >= 0) {
+        CloseSocket(connection);
+        connection->request.rangeStart = -1;
+        if (!BeginRequest(connection, connection->request.url)) {
+          CloseConnection(connection, connection->failure);
+        }
+        return false;
+      }
+
+      SegmentResult failure = SegmentResult::Failed;
+      if (!CheckSegmentResponse(
+              download, response, connection->chunk, connection->rangeRequest,
+              connection->probe ? -1 : connection->progress.mirror, context,
+              failure)) {
+        CloseConnection(connection, failure);
+        return false;
+      }
+      if (connection->probe && !PlanFromProbe(connection, response)) {
+        CloseConnection(connection, context.failed.load()
+                                        ? SegmentResult::Failed
+                                        : SegmentResult::Reassign);
+        return false;
+      }
+
+      connection->decoder.Reset(response, headers);
+      connection->keepAlive =
+          HttpProtocol::IsKeepAlive(connection->head, headers);
+      connection->phase = Connection::Phase::Body;
+
+      // Whatever followed the headers arrived with this read, at the end
+      // of the buffer
+      size_t bodySize = connection->head.size() - (end + 4);
+      connection->head.clear();
+      return ConsumeBody(connection, buffer, size - bodySize, bodySize);
+    }
+
+    return ConsumeBody(connection, buffer, 0, size);
+  }
+
+  // Lays out the chunks from the probe's response. The other connections
+  // are opened once the current event has been handled.
+  bool PlanFromProbe(Connection *connection, const HttpResponse &response) {
+    connection->probe = false;
+    download->ReleaseChunk(connection->chunkIndex);
+    int workerCount =
+        ApplyProbeResponse(state, download, response, filePath, context,
+                           connection->chunkIndex, connection->chunk);
+    if (workerCount <= 0) {
+      return false;
+    }
+
+    connection->progress.position = connection->chunk.currentByte;
+    connection->progress.lastPosition = connection->chunk.currentByte;
+    minStealSize = download->IsResumable() ? Config::MIN_STEAL_SIZE : 0;
+    lastBytes = download->GetDownloadedSize();
+    tuned = workerCount;
+
+    if (workerCount > 1) {
+      auto self = shared_from_this();
+      loop.Post([self, workerCount]() {
+        for (int i = 1; i < workerCount && !self->finished; ++i) {
+          if (!self->OpenNextSegment()) {
+            break;
+          }
+        }
+      });
+    }
+    return true;
+  }
+
+  // Takes the size body bytes at offset in buffer. Unless they go to a
+  // mapping, they are gathered at the front of the buffer (over any
+  // chunked framing) and the buffer itself is handed to the writer.
+  bool ConsumeBody(Connection *connection, BufferPool::Buffer &buffer,
+                   size_t offset, size_t size) {
+    bool openEnded = connection->chunk.IsOpenEnded();
+    int chunkIndex = connection->chunkIndex;
+    int pauseMs = 0;
+    const char *data = buffer.Data() + offset;
+    int64_t blockPosition = connection->progress.position;
+    size_t blockSize = 0;
+
+    // Progress is recorded as the pieces are taken and the block written
+    // after; checkpoints run on this thread, so none sees the difference
+    auto submitBlock = [&]() {
+      if (blockSize == 0 ||
+          context.writer->Submit(blockPosition, std::move(buffer), blockSize,
+                                 false)) {
+        blockSize = 0;
+        return true;
+      }
+      context.Fail("Disk write failed - check available disk space",
+                   "File I/O Error", false);
+      CloseConnection(connection, SegmentResult::Failed);
+      return false;
+    };
+
+    while (true) {
+      if (IsAborted(state, download) || context.failed.load()) {
+        CloseConnection(connection, SegmentResult::Aborted);
+        return false;
+      }
+
+      // The end may shrink while we run if another connection steals part
+      // of this chunk
+      int64_t remaining =
+          openEnded ? static_cast<int64_t>(size)
+                    : download->GetChunkEnd(chunkIndex) -
+                          connection->progress.position + 1;
+      if (!openEnded && remaining <= 0) {
+        connection->reusable = connection->keepAlive &&
+                               FinishBody(connection->decoder, data, size);
+        if (!submitBlock()) {
+          return false;
+        }
+        CloseConnection(connection, SegmentResult::Completed);
+        return false;
+      }
+      if (connection->decoder.IsComplete()) {
+        connection->reusable = connection->keepAlive && size == 0;
+        if (!submitBlock()) {
+          return false;
+        }
+        OnBodyEnd(connection);
+        return false;
+      }
+      if (size == 0) {
+        break;
+      }
+
+      const char *body = nullptr;
+      size_t bodySize = 0;
+      if (!connection->decoder.Next(data, size,
+                                    static_cast<size_t>(remaining), body,
+                                    bodySize)) {
+        CloseConnection(connection,
+                        FailConnection(connection, "Malformed chunked encoding",
+                                       "Read Error", false));
+        return false;
+      }
+      // The end is read again before the piece counts, in case a steal
+      // moved it; what lies past it is left to the connection that took it
+      if (!openEnded) {
+        int64_t wanted = download->GetChunkEnd(chunkIndex) -
+                         connection->progress.position + 1;
+        bodySize = static_cast<size_t>(
+            std::max<int64_t>(0, std::min<int64_t>(bodySize, wanted)));
+      }
+      if (bodySize == 0) {
+        continue;
+      }
+
+      if (context.mapped) {
+        if (!CopyToMapping(connection, body, bodySize)) {
+          context.Fail("Disk write failed - check available disk space",
+                       "File I/O Error", false);
+          CloseConnection(connection, SegmentResult::Failed);
+          return false;
+        }
+      } else {
+        // Plain bodies are in place already
+        char *target = buffer.Data() + blockSize;
+        if (body != target) {
+          std::memmove(target, body, bodySize);
+        }
+        blockSize += bodySize;
+      }
+
+      pauseMs = std::max(
+          pauseMs, RecordSegmentProgress(state, download, chunkIndex,
+                                         connection->progress, bodySize,
+                                         context));
+    }
+
+    if (!submitBlock()) {
+      return false;
+    }
+
+    // Checkpoints only start the write-back; waiting would stall the
+    // whole loop
+    if (context.mapped &&
+        !CheckpointMapped(connection->progress, false, false)) {
+      context.Fail("Disk write failed - check available disk space",
+                   "File I/O Error", false);
+      CloseConnection(connection, SegmentResult::Failed);
+      return false;
+    }
+
+    if (connection->progress.replace) {
+      // The range is asked again, from where it stopped, on a fresh
+      // connection (maybe to another source)
+      CloseConnection(connection, SegmentResult::Reconnect);
+      return false;
+    }
+
+    if (pauseMs > 0) {
+      // Wait until the speed limit allows more data
+      PauseReading(connection, pauseMs);
+      return false;
+    }
+    return true;
+  }
+
+  // Mapped write mode: copies body bytes to the connection's position in
+  // the file, which may span two windows
+  bool CopyToMapping(Connection *connection, const char *data, size_t size) {
+    int64_t offset = connection->progress.position;
+    while (size > 0) {
+      size_t piece = size;
+      char *target =
+          MapForWrite(context, connection->progress, offset, piece, false);
+      if (!target) {
+        return false;
+      }
+      std::memcpy(target, data, piece);
+      data += piece;
+      size -= piece;
+      offset += static_cast<int64_t>(piece);
+    }
+    return true;
+  }
+
+  // Closes the connection after a failed receive or a socket error. One
+  // broken off in the body is resumed; a pooled socket that failed before
+  // the response is replaced.
+  void OnSocketError(Connection *connection, const std::string &what,
+                     int error) {
+    if (connection->phase == Connection::Phase::Body) {
+      FailRead(connection, SystemError(what, error));
+    } else if (RetryOnFreshSocket(connection)) {
+      return;
+    } else {
+      FailConnection(connection,
+                     "Failed to open URL. " + SystemError(what, error),
+                     "Connection failed", true);
+    }
+    CloseConnection(connection, connection->failure);
+  }
+
+  // Stops polling the socket for a while
+  void PauseReading(Connection *connection, int ms) {
+    loop.Modify(connection->fd, 0);
+    auto self = shared_from_this();
+    connection->resumeTimer = loop.AddTimer(ms, [self, connection]() {
+      connection->resumeTimer = 0;
+      connection->lastActivity = Clock::now();
+      self->loop.Modify(connection->fd, EPOLLIN);
+    });
+  }
+
+  void OnPeerClosed(Connection *connection) {
+    if (connection->phase != Connection::Phase::Body) {
+      if (RetryOnFreshSocket(connection)) {
+        return;
+      }
+      CloseConnection(connection,
+                      FailConnection(connection,
+                                     "Failed to open URL. Connection closed "
+                                     "before response headers",
+                                     "Connection failed", true));
+      return;
+    }
+
+    if (!connection->decoder.OnConnectionClosed()) {
+      CloseConnection(connection,
+                      FailRead(connection,
+                               "Connection closed before the end of the body"));
+      return;
+    }
+    OnBodyEnd(connection);
+  }
+
+  void OnBodyEnd(Connection *connection) {
+    if (!connection->chunk.IsOpenEnded()) {
+      if (download->GetChunkEnd(connection->chunkIndex) -
+              connection->progress.position + 1 >
+          0) {
+        CloseConnection(
+            connection,
+            FailRead(connection,
+                     "Connection closed before the segment was complete"));
+        return;
+      }
+    } else {
+      download->CompleteChunk(connection->chunkIndex);
+    }
+    CloseConnection(connection, SegmentResult::Completed);
+  }
+
+  void CloseConnection(Connection *connection, SegmentResult result) {
+    if (connection->resumeTimer != 0) {
+      loop.CancelTimer(connection->resumeTimer);
+    }
+    if ((result == SegmentResult::Completed ||
+         result == SegmentResult::Reconnect) &&
+        context.mapped &&
+        !CheckpointMapped(connection->progress, true, false)) {
+      context.Fail("Disk write failed - check available disk space",
+                   "File I/O Error", false);
+      result = SegmentResult::Failed;
+    }
+    if (result == SegmentResult::Completed && connection->reusable &&
+        connection->fd >= 0 && state->connectionPool) {
+      loop.Remove(connection->fd);
+      state->connectionPool->Release(connection->poolKey, connection->fd);
+      connection->fd = -1;
+    }
+    CloseSocket(connection);
+    download->ReleaseChunk(connection->chunkIndex);
+    context.mirrors->Release(connection->progress.mirror);
+    int reconnectDelayMs =
+        result == SegmentResult::Reconnect ? connection->reconnectDelayMs : 0;
+
+    connections.erase(
+        std::find_if(connections.begin(), connections.end(),
+                     [connection](const std::unique_ptr<Connection> &item) {
+                       return item.get() == connection;
+                     }));
+
+    if (result == SegmentResult::Completed ||
+        result == SegmentResult::Reassign ||
+        result == SegmentResult::Reconnect) {
+      if (reconnectDelayMs > 0) {
+        ScheduleReconnect(reconnectDelayMs);
+      } else if (!context.tuner || static_cast<int>(connections.size()) <
+                                       context.tuner->GetTarget()) {
+        OpenNextSegment();
+      }
+    } else if (context.failed.load()) {
+      CloseAll();
+      return;
+    }
+    FinishIfIdle();
+  }
+
+  // Opens a segment once delayMs has passed, e.g. after a broken read
+  void ScheduleReconnect(int delayMs) {
+    auto self = shared_from_this();
+    auto timer = std::make_shared<EventLoop::TimerId>(0);
+    *timer = loop.AddTimer(delayMs, [self, timer]() {
+      auto &timers = self->reconnectTimers;
+      timers.erase(std::find(timers.begin(), timers.end(), *timer));
+      if (!self->context.tuner ||
+          static_cast<int>(self->connections.size()) <
+              self->context.tuner->GetTarget()) {
+        self->OpenNextSegment();
+      }
+      self->FinishIfIdle();
+    });
+    reconnectTimers.push_back(*timer);
+  }
+
+  void CloseAll() {
+    for (EventLoop::TimerId timer : reconnectTimers) {
+      loop.CancelTimer(timer);
+    }
+    reconnectTimers.clear();
+    while (!connections.empty()) {
+      Connection *connection = connections.back().get();
+      if (connection->resumeTimer != 0) {
+        loop.CancelTimer(connection->resumeTimer);
+      }
+      CloseSocket(connection);
+      download->ReleaseChunk(connection->chunkIndex);
+      context.mirrors->Release(connection->progress.mirror);
+      connections.pop_back();
+    }
+    FinishIfIdle();
+  }
+
+  void FinishIfIdle() {
+    if (finished || !connections.empty() || !reconnectTimers.empty() ||
+        drainTimer != 0) {
+      return;
+    }
+
+    // A transfer that stops short leaves its chunk map for the next run
+    if (!finalCheckpoint) {
+      finalCheckpoint = true;
+      if (!download->AreAllChunksCompleted()) {
+        CheckpointResume(download, context, true);
+      }
+    }
+
+    // Closing the writer waits for the disk; poll instead so the other
+    // transfers on this loop keep going meanwhile
+    if (context.writer && (context.writer->HasPending() ||
+                           context.resumeSaves.load() > 0)) {
+      auto self = shared_from_this();
+      drainTimer = loop.AddTimer(Config::WRITE_RETRY_MS, [self]() {
+        self->drainTimer = 0;
+        self->FinishIfIdle();
+      });
+      return;
+    }
+    finished = true;
+    if (tickTimer != 0) {
+      loop.CancelTimer(tickTimer);
+      tickTimer = 0;
+    }
+
+    UpdateDownloadSpeed(download, progressCallback, lastBytes,
+                        lastSpeedUpdate);
+    if (FinishTransfer(state, download, completionCallback, context) ==
+        TransferOutcome::Retry) {
+      state->retryScheduler->Schedule(download);
+    }
+  }
+};
+
+void DownloadEngine::StartEventLoopTransfer(
+    std::shared_ptr<EngineState> state, std::shared_ptr<Download> download,
+    const std::shared_ptr<EventLoop> &loop) {
+  auto transfer = std::make_shared<EventLoopTransfer>(std::move(state),
+                                                      std::move(download), loop);
+  std::weak_ptr<EventLoop> weakLoop = loop;
+  std::thread([transfer, weakLoop]() {
+    int workerCount = transfer->Prepare();
+    auto eventLoop = weakLoop.lock();
+    if (workerCount <= 0 || !eventLoop) {
+      return;
+    }
+    eventLoop->Post(
+        [transfer, workerCount]() { transfer->Start(workerCount); });
+  }).detach();
+}
@@ -1,6 +1,8 @@
 #include "DownloadManager.h"
+#include "ResumeFile.h"
 #include "../database/DatabaseManager.h"
 #include "../utils/Settings.h"
+#include <Windows.h>
 #include <KnownFolders.h>
 #include <Shlobj.h>
 #include <algorithm>
@@ -68,6 +70,11 @@ DownloadManager::DownloadManager()
         OnDownloadComplete(id, success, error);
       });
 
+  // The engine has set the reported size and resume support on the
+  // download already
+  m_engine->SetMetadataCallback(
+      [this](int id, int64_t, bool) { OnDownloadMetadata(id); });
+
   // Load downloads from database
   LoadDownloadsFromDatabase();
 
@@ -115,12 +122,21 @@ void DownloadManager::ApplySettings(const Settings &settings) {
 
   if (m_engine) {
     m_engine->SetMaxConnections(std::max(1, settings.GetMaxConnections()));
+    m_engine->SetAdaptiveConnections(settings.GetAdaptiveConnections());
 
     int speedLimitKb = settings.GetSpeedLimit();
     int64_t speedLimitBytes =
         speedLimitKb > 0 ? static_cast<int64_t>(speedLimitKb) * 1024 : 0;
     m_engine->SetSpeedLimit(speedLimitBytes);
 
+    int memoryBudgetMb = settings.GetMemoryBudget();
+    m_engine->SetMemoryBudget(
+        memoryBudgetMb > 0 ? static_cast<int64_t>(memoryBudgetMb) << 20 : 0);
+
+    m_engine->SetSlowConnectionPolicy(settings.GetSlowConnectionPercent(),
+                                      settings.GetSlowConnectionWindow() *
+                                          1000);
+
     if (settings.GetUseProxy()) {
       m_engine->SetProxy(settings.GetProxyHost(), settings.GetProxyPort());
     } else {
@@ -129,12 +145,49 @@ void DownloadManager::ApplySettings(const Settings &settings) {
   }
 }
 
+void DownloadManager::SetDownloadSpeedLimit(int downloadId,
+                                            int64_t bytesPerSecond) {
+  auto download = GetDownload(downloadId);
+  if (download) {
+    // Applies to a running transfer right away
+    download->SetSpeedLimit(bytesPerSecond);
+    DatabaseManager::GetInstance().UpdateDownload(*download);
+  }
+}
+
+void DownloadManager::SetHostSpeedLimit(const std::string &host,
+                                        int64_t bytesPerSecond) {
+  m_engine->SetHostSpeedLimit(host, bytesPerSecond);
+  if (!DatabaseManager::GetInstance().SetSpeedLimit("host", host,
+                                                    bytesPerSecond)) {
+    std::cerr << "Database error: Failed to save speed limit for host "
+              << host << std::endl;
+  }
+}
+
+void DownloadManager::SetCategorySpeedLimit(const std::string &category,
+                                            int64_t bytesPerSecond) {
+  m_engine->SetCategorySpeedLimit(category, bytesPerSecond);
+  if (!DatabaseManager::GetInstance().SetSpeedLimit("category", category,
+                                                    bytesPerSecond)) {
+    std::cerr << "Database error: Failed to save speed limit for category "
+              << category << std::endl;
+  }
+}
+
 void DownloadManager::LoadDownloadsFromDatabase() {
   DatabaseManager &db = DatabaseManager::GetInstance();
   db.Initialize();
 
   auto loadedDownloads = db.LoadAllDownloads();
 
+  for (const auto &limit : db.GetSpeedLimits("host")) {
+    m_engine->SetHostSpeedLimit(limit.first, limit.second);
+  }
+  for (const auto &limit : db.GetSpeedLimits("category")) {
+    m_engine->SetCategorySpeedLimit(limit.first, limit.second);
+  }
+
   std::lock_guard<std::mutex> lock(m_downloadsMutex);
 
   for (auto &download : loadedDownloads) {
@@ -185,12 +238,36 @@ void DownloadManager::SaveDownloadToDatabase(int downloadId) {
   }
 }
 
+void DownloadManager::SaveProbedDownloads() {
+  std::set<int> ids;
+  {
+    std::lock_guard<std::mutex> lock(m_probedMutex);
+    ids.swap(m_probedIds);
+  }
+
+  std::vector<std::shared_ptr<Download>> downloads;
+  for (int id : ids) {
+    if (auto download = GetDownload(id)) {
+      downloads.push_back(download);
+    }
+  }
+  if (!downloads.empty()) {
+    DatabaseManager::GetInstance().UpdateDownloads(downloads);
+  }
+}
+
 int DownloadManager::AddDownload(const std::string &url,
-                                 const std::string &savePath) {
+                                 const std::string &savePath,
+                                 const std::vector<std::string> &mirrors) {
   // Validate URL first
   if (!IsValidUrl(url)) {
     return -1; // Invalid URL
   }
+  for (const auto &mirror : mirrors) {
+    if (!IsValidUrl(mirror)) {
+      return -1;
+    }
+  }
 
   std::lock_guard<std::mutex> lock(m_downloadsMutex);
 
@@ -208,6 +285,7 @@ int DownloadManager::AddDownload(const std::string &url,
     download->SetSavePath(m_defaultSavePath + "\\" + category);
   }
   // else: keep default save path
+  download->SetMirrors(mirrors);
 
   m_downloads.push_back(download);
 
@@ -238,6 +316,7 @@ void DownloadManager::RemoveDownload(int downloadId, bool deleteFile) {
     if (deleteFile) {
       std::string filePath = (*it)->GetSavePath() + "\\" + (*it)->GetFilename();
       DeleteFileA(filePath.c_str());
+      DeleteFileA(ResumeFile::PathFor(filePath).c_str());
     }
 
     // Remove from database
@@ -457,6 +536,21 @@ void DownloadManager::OnDownloadComplete(int downloadId, bool success,
   }
 }
 
+void DownloadManager::OnDownloadMetadata(int downloadId) {
+  // The size and resume support are known as soon as the first response
+  // arrived; keep them even if the download is stopped before any progress.
+  // Writing the database here would rewrite it on the engine's worker for
+  // every probe, so it is batched on the timer.
+  {
+    std::lock_guard<std::mutex> lock(m_probedMutex);
+    m_probedIds.insert(downloadId);
+  }
+
+  if (m_updateCallback) {
+    m_updateCallback(downloadId);
+  }
+}
+
 // Queue management
 void DownloadManager::StartQueue() {
   m_isQueueRunning = true;
@@ -538,6 +632,7 @@ void DownloadManager::CheckSchedule() {
 }
 
 void DownloadManager::OnSchedulerTimer(wxTimerEvent &event) {
+  SaveProbedDownloads();
   CheckSchedule();
   if (m_isQueueRunning) {
     ProcessQueue();
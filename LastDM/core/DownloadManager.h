@@ -4,6 +4,7 @@
 #include "DownloadEngine.h"
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -20,7 +21,9 @@ public:
   DownloadManager &operator=(const DownloadManager &) = delete;
 
   // Download management
-  int AddDownload(const std::string &url, const std::string &savePath = "");
+  // mirrors are other URLs serving the same file
+  int AddDownload(const std::string &url, const std::string &savePath = "",
+                  const std::vector<std::string> &mirrors = {});
   void RemoveDownload(int downloadId, bool deleteFile = false);
   void StartDownload(int downloadId);
   void PauseDownload(int downloadId);
@@ -64,6 +67,13 @@ public:
   void SetDefaultSavePath(const std::string &path) { m_defaultSavePath = path; }
   void ApplySettings(const class Settings &settings);
 
+  // Speed limits in bytes per second (0 = none), nested under the global
+  // limit from Settings. Stored in the database.
+  void SetDownloadSpeedLimit(int downloadId, int64_t bytesPerSecond);
+  void SetHostSpeedLimit(const std::string &host, int64_t bytesPerSecond);
+  void SetCategorySpeedLimit(const std::string &category,
+                             int64_t bytesPerSecond);
+
   // Callbacks for UI updates
   using DownloadUpdateCallback = std::function<void(int downloadId)>;
   void SetUpdateCallback(DownloadUpdateCallback callback) {
@@ -77,6 +87,11 @@ private:
   std::vector<std::shared_ptr<Download>> m_downloads;
   mutable std::mutex m_downloadsMutex;
 
+  // Downloads the engine reported metadata for, saved on the next timer
+  // tick rather than on its worker
+  std::set<int> m_probedIds;
+  std::mutex m_probedMutex;
+
   // Queue & Schedule state
   bool m_isQueueRunning;
   wxTimer *m_schedulerTimer;
@@ -105,6 +120,8 @@ private:
   void LoadDownloadsFromDatabase();
   void SaveAllDownloadsToDatabase();
   void SaveDownloadToDatabase(int downloadId);
+  // Writes the downloads whose metadata arrived since the last call
+  void SaveProbedDownloads();
 
   // Folder management
   void EnsureCategoryFoldersExist();
@@ -113,4 +130,5 @@ private:
                           double speed);
   void OnDownloadComplete(int downloadId, bool success,
                           const std::string &error);
+  void OnDownloadMetadata(int downloadId);
 };
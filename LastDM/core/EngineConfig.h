@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Tunables shared by the download engine's transfer modes
+namespace Config {
+constexpr long CONNECT_TIMEOUT_MS = 30000;
+constexpr long RECEIVE_TIMEOUT_MS = 30000;
+constexpr int64_t MIN_SEGMENT_SIZE = 512 * 1024; // Don't split below 512KB
+constexpr int MAX_CONNECTIONS = 32;
+constexpr int SPEED_UPDATE_INTERVAL_MS = 500;
+// Each connection reads about READ_SIZE_TARGET_MS worth of its measured
+// throughput per call, rounded to a power of two between the bounds. The
+// largest read fills a whole write block.
+constexpr size_t MIN_READ_SIZE = 16 * 1024;
+constexpr size_t MAX_READ_SIZE = 4 * 1024 * 1024;
+constexpr int READ_SIZE_TARGET_MS = 10;
+// Write-behind: bytes a download may have waiting for the disk before its
+// connections stop reading, and the size and alignment of merged writes
+constexpr size_t WRITE_QUEUE_SIZE = 32 * 1024 * 1024;
+constexpr size_t WRITE_BLOCK_SIZE = 4 * 1024 * 1024;
+// Recheck of a full queue, or of the memory budget by a waiting reader
+constexpr int WRITE_RETRY_MS = 10;
+// Mapped write mode: bytes mapped at a time, and how often a connection
+// checkpoints what it wrote to disk
+constexpr size_t MAP_WINDOW_SIZE = 64 * 1024 * 1024;
+constexpr int MAP_CHECKPOINT_MS = 5000;
+// How often the chunk map is saved next to the file for resuming after a
+// crash
+constexpr int RESUME_CHECKPOINT_MS = 5000;
+// Bytes a limited transfer may take at once after idling, in ms of the rate
+constexpr int64_t SPEED_LIMIT_BURST_MS = 100;
+// Smallest range an idle connection may steal
+constexpr int64_t MIN_STEAL_SIZE = 256 * 1024;
+// A connection whose speed over the last window is below this percentage
+// of the median of the download's other connections is replaced by a
+// fresh one; at most so many times per transfer
+constexpr int SLOW_CONNECTION_PERCENT = 10;
+constexpr int SLOW_CONNECTION_WINDOW_MS = 10000;
+constexpr int SLOW_CONNECTION_MIN_SIBLINGS = 2;
+constexpr int MAX_SLOW_REPLACEMENTS = 32;
+// A segment whose read broke off is asked again after a backoff that
+// doubles up to the cap, while the download has retries left
+constexpr int RECONNECT_DELAY_MS = 250;
+constexpr int MAX_RECONNECT_DELAY_MS = 4000;
+// Longest Retry-After of a 429 or 503 that is waited for
+constexpr int64_t MAX_RETRY_AFTER_MS = 300000;
+// Adaptive connection count: connections a download starts with on a host
+// not seen before, and how often the count is reconsidered
+constexpr int ADAPTIVE_INITIAL_CONNECTIONS = 2;
+constexpr int TUNE_INTERVAL_MS = 2000;
+// Keep-alive connections
+constexpr int MAX_CONNECTIONS_PER_HOST = 64;
+constexpr size_t POOL_MAX_IDLE_PER_HOST = MAX_CONNECTIONS;
+constexpr size_t POOL_MAX_IDLE = 128;
+constexpr long POOL_IDLE_TIMEOUT_MS = 30000;
+// Host address cache of the socket transports: how long lookups are kept,
+// failed ones for less
+constexpr long RESOLVER_TTL_MS = 60000;
+constexpr long RESOLVER_FAILURE_TTL_MS = 5000;
+constexpr size_t RESOLVER_MAX_HOSTS = 256;
+// Downloads backing off before a retry wait on a wheel of this many slots,
+// turned every RETRY_TICK_MS
+constexpr int RETRY_TICK_MS = 100;
+constexpr size_t RETRY_WHEEL_SLOTS = 1024;
+// Event loop mode
+constexpr int MAX_EVENT_LOOPS = 8;
+constexpr int READS_PER_EVENT = 8; // Reads per wakeup before yielding
+} // namespace Config
@@ -0,0 +1,220 @@
+#include "EventLoop.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+constexpr int MAX_EVENTS = 64;
+} // namespace
+
+EventLoop::EventLoop() {
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_epollFd >= 0 && m_wakeFd >= 0) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+  }
+}
+
+EventLoop::~EventLoop() {
+  Stop();
+  if (m_wakeFd >= 0) {
+    close(m_wakeFd);
+  }
+  if (m_epollFd >= 0) {
+    close(m_epollFd);
+  }
+}
+
+bool EventLoop::Start() {
+  if (m_epollFd < 0 || m_wakeFd < 0 || m_running.exchange(true)) {
+    return false;
+  }
+
+  m_thread = std::thread([this]() { Run(); });
+  return true;
+}
+
+void EventLoop::Stop() {
+  m_running.store(false);
+  Wake();
+  if (m_thread.joinable() && !IsInLoopThread()) {
+    m_thread.join();
+  }
+
+  // Handlers and tasks may own objects whose destructors touch the loop, so
+  // release them only after the maps are empty
+  auto handlers = std::move(m_handlers);
+  auto timers = std::move(m_timers);
+  std::vector<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    tasks.swap(m_tasks);
+  }
+  m_handlers.clear();
+  m_timers.clear();
+  m_timerIndex.clear();
+}
+
+bool EventLoop::IsInLoopThread() const {
+  return m_thread.get_id() == std::this_thread::get_id();
+}
+
+void EventLoop::Post(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    m_tasks.push_back(std::move(task));
+  }
+  Wake();
+}
+
+void EventLoop::Wake() {
+  if (m_wakeFd >= 0) {
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeFd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+bool EventLoop::Add(int fd, uint32_t events, Handler handler) {
+  Registration registration;
+  registration.handler = std::make_shared<Handler>(std::move(handler));
+  registration.armed = events != 0;
+
+  if (registration.armed) {
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      return false;
+    }
+  }
+
+  m_handlers[fd] = std::move(registration);
+  return true;
+}
+
+bool EventLoop::Modify(int fd, uint32_t events) {
+  auto it = m_handlers.find(fd);
+  if (it == m_handlers.end()) {
+    return false;
+  }
+
+  // A descriptor without interest is removed from the epoll set entirely,
+  // otherwise hang-ups would keep waking the loop
+  if (events == 0) {
+    if (it->second.armed) {
+      epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+      it->second.armed = false;
+    }
+    return true;
+  }
+
+  epoll_event event = {};
+  event.events = events;
+  event.data.fd = fd;
+  int op = it->second.armed ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(m_epollFd, op, fd, &event) != 0) {
+    return false;
+  }
+  it->second.armed = true;
+  return true;
+}
+
+void EventLoop::Remove(int fd) {
+  auto it = m_handlers.find(fd);
+  if (it == m_handlers.end()) {
+    return;
+  }
+  if (it->second.armed) {
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  }
+  m_handlers.erase(it);
+}
+
+EventLoop::TimerId EventLoop::AddTimer(int delayMs, Task task) {
+  TimerId id = m_nextTimerId++;
+  auto due = Clock::now() + std::chrono::milliseconds(std::max(0, delayMs));
+  m_timerIndex[id] = m_timers.emplace(due, std::make_pair(id, std::move(task)));
+  return id;
+}
+
+void EventLoop::CancelTimer(TimerId id) {
+  auto it = m_timerIndex.find(id);
+  if (it == m_timerIndex.end()) {
+    return;
+  }
+  m_timers.erase(it->second);
+  m_timerIndex.erase(it);
+}
+
+int EventLoop::NextTimeoutMs() const {
+  if (m_timers.empty()) {
+    return -1;
+  }
+
+  auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  m_timers.begin()->first - Clock::now())
+                  .count();
+  // Round up so the loop does not spin just before a timer is due
+  return static_cast<int>(std::max<int64_t>(0, wait + 1));
+}
+
+void EventLoop::RunExpiredTimers() {
+  auto now = Clock::now();
+  while (!m_timers.empty() && m_timers.begin()->first <= now) {
+    auto it = m_timers.begin();
+    Task task = std::move(it->second.second);
+    m_timerIndex.erase(it->second.first);
+    m_timers.erase(it);
+    task();
+  }
+}
+
+void EventLoop::RunPostedTasks() {
+  std::vector<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(m_taskMutex);
+    tasks.swap(m_tasks);
+  }
+  for (auto &task : tasks) {
+    task();
+  }
+}
+
+void EventLoop::Run() {
+  epoll_event events[MAX_EVENTS];
+
+  while (m_running.load()) {
+    int count = epoll_wait(m_epollFd, events, MAX_EVENTS, NextTimeoutMs());
+    if (count < 0 && errno != EINTR) {
+      break;
+    }
+
+    for (int i = 0; i < count && m_running.load(); ++i) {
+      int fd = events[i].data.fd;
+      if (fd == m_wakeFd) {
+        uint64_t value;
+        ssize_t drained = read(m_wakeFd, &value, sizeof(value));
+        (void)drained;
+        continue;
+      }
+
+      // Earlier handlers in this batch may have removed the descriptor; keep
+      // the handler alive while it runs, since it may remove itself
+      auto it = m_handlers.find(fd);
+      if (it == m_handlers.end() || !it->second.armed) {
+        continue;
+      }
+      std::shared_ptr<Handler> handler = it->second.handler;
+      (*handler)(events[i].events);
+    }
+
+    RunExpiredTimers();
+    RunPostedTasks();
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Single threaded epoll reactor (Linux only). Descriptor handlers and timers
+// run on the loop thread and must only be registered from it; Post() hands
+// work to the loop from any thread.
+class EventLoop {
+public:
+  using Handler = std::function<void(uint32_t events)>;
+  using Task = std::function<void()>;
+  using TimerId = uint64_t;
+
+  EventLoop();
+  ~EventLoop();
+
+  // Disable copy
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  bool Start();
+  // Joins the loop thread and drops all handlers, timers and queued tasks
+  void Stop();
+  bool IsInLoopThread() const;
+
+  void Post(Task task);
+
+  bool Add(int fd, uint32_t events, Handler handler);
+  // An empty event mask stops polling the descriptor but keeps its handler
+  bool Modify(int fd, uint32_t events);
+  void Remove(int fd);
+
+  TimerId AddTimer(int delayMs, Task task);
+  void CancelTimer(TimerId id);
+
+private:
+  using Clock = std::chrono::steady_clock;
+  using TimerQueue = std::multimap<Clock::time_point, std::pair<TimerId, Task>>;
+
+  struct Registration {
+    std::shared_ptr<Handler> handler;
+    bool armed = false;
+  };
+
+  int m_epollFd = -1;
+  int m_wakeFd = -1;
+  std::thread m_thread;
+  std::atomic<bool> m_running{false};
+
+  std::mutex m_taskMutex;
+  std::vector<Task> m_tasks;
+
+  std::unordered_map<int, Registration> m_handlers;
+  TimerQueue m_timers;
+  std::unordered_map<TimerId, TimerQueue::iterator> m_timerIndex;
+  TimerId m_nextTimerId = 1;
+
+  void Run();
+  void Wake();
+  int NextTimeoutMs() const;
+  void RunExpiredTimers();
+  void RunPostedTasks();
+};
@@ -0,0 +1,474 @@
+#include "FileWriter.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include "IoRing.h"
+#endif
+
+namespace {
+
+// Pieces at least this large are written without merging
+constexpr size_t DIRECT_WRITE_SIZE = 256 * 1024;
+#ifdef __linux__
+// Writes in flight at once through io_uring, and the most pieces one of
+// them gathers
+constexpr unsigned RING_ENTRIES = 32;
+constexpr size_t MAX_GATHER = 256;
+#endif
+
+} // namespace
+
+FileWriter::FileWriter(BufferPool &pool, size_t maxQueued, size_t blockSize)
+    : m_pool(pool), m_maxQueued(maxQueued), m_blockSize(blockSize) {
+#ifdef _WIN32
+  m_handle = INVALID_HANDLE_VALUE;
+#endif
+}
+
+FileWriter::~FileWriter() { Close(); }
+
+bool FileWriter::Open(const std::string &path, bool asyncIo) {
+#ifdef _WIN32
+  m_handle = CreateFileA(path.c_str(), GENERIC_WRITE,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+#else
+  m_fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (m_fd < 0) {
+    return false;
+  }
+#endif
+#ifdef __linux__
+  if (asyncIo) {
+    m_ring = std::make_unique<IoRing>(RING_ENTRIES);
+    if (!m_ring->IsValid()) {
+      m_ring.reset();
+    }
+  }
+#else
+  (void)asyncIo;
+#endif
+  m_thread = std::thread(&FileWriter::Run, this);
+  return true;
+}
+
+bool FileWriter::Reserve(int64_t size) {
+  if (size <= 0) {
+    return true;
+  }
+
+#ifdef _WIN32
+  FILE_ALLOCATION_INFO info = {};
+  info.AllocationSize.QuadPart = size;
+  if (SetFileInformationByHandle(m_handle, FileAllocationInfo, &info,
+                                 sizeof(info))) {
+    return true;
+  }
+  if (GetLastError() == ERROR_DISK_FULL) {
+    return false;
+  }
+
+  // Without a reservation, writing far past the end would first fill the
+  // gap with zeros
+  DWORD returned = 0;
+  DeviceIoControl(m_handle, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned,
+                  NULL);
+  return true;
+#elif defined(__linux__)
+  int rc;
+  do {
+    rc = fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, size);
+  } while (rc != 0 && errno == EINTR);
+  return rc == 0 || errno != ENOSPC;
+#else
+  // Unallocated ranges of a POSIX file are sparse already
+  return true;
+#endif
+}
+
+bool FileWriter::Truncate(int64_t size) {
+#ifdef _WIN32
+  LARGE_INTEGER position;
+  position.QuadPart = size;
+  return SetFilePointerEx(m_handle, position, NULL, FILE_BEGIN) &&
+         SetEndOfFile(m_handle);
+#else
+  int rc;
+  do {
+    rc = ftruncate(m_fd, static_cast<off_t>(size));
+  } while (rc != 0 && errno == EINTR);
+  return rc == 0;
+#endif
+}
+
+bool FileWriter::Submit(int64_t offset, BufferPool::Buffer data, size_t size,
+                        bool wait) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (wait) {
+    m_space.wait(lock, [this]() {
+      return m_failed.load() || m_queued < m_maxQueued;
+    });
+  }
+  if (m_failed.load() || m_closing) {
+    return false;
+  }
+
+  Block block;
+  block.offset = offset;
+  block.data = std::move(data);
+  block.size = size;
+  m_queue.push_back(std::move(block));
+  m_queued += size;
+  m_wake.notify_one();
+  return true;
+}
+
+void FileWriter::Sync(std::function<void(bool)> done) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_syncs.push_back(std::move(done));
+  m_wake.notify_one();
+}
+
+bool FileWriter::IsBacklogged() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_queued >= m_maxQueued;
+}
+
+bool FileWriter::HasPending() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_queued > 0;
+}
+
+bool FileWriter::Close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_wake.notify_one();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+
+#ifdef __linux__
+  if (m_stranded) {
+    // Writes a broken ring still held may since have completed. Those that
+    // never report back keep their buffers for good.
+    uint64_t index = 0;
+    int32_t result = 0;
+    while (m_stranded->outstanding > 0 &&
+           m_stranded->ring->WaitCompletion(index, result)) {
+      m_stranded->outstanding--;
+    }
+    if (m_stranded->outstanding > 0) {
+      static_cast<void>(m_stranded.release());
+    }
+    m_stranded.reset();
+  }
+#endif
+
+  // Network filesystems may only report a failed write when closing
+#ifdef _WIN32
+  if (m_handle != INVALID_HANDLE_VALUE) {
+    if (!CloseHandle(m_handle)) {
+      m_failed = true;
+    }
+    m_handle = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (m_fd >= 0) {
+    if (close(m_fd) != 0 && errno != EINTR) {
+      m_failed = true;
+    }
+    m_fd = -1;
+  }
+#endif
+  return !m_failed.load();
+}
+
+std::vector<int64_t> FileWriter::GetUnwrittenOffsets() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_unwritten;
+}
+
+void FileWriter::Run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_wake.wait(lock, [this]() {
+      return m_closing || !m_queue.empty() || !m_syncs.empty();
+    });
+    if (m_queue.empty() && m_syncs.empty()) {
+      return;
+    }
+
+    // Take everything queued so far; producers keep queueing meanwhile.
+    // Syncs asked for by now cover it.
+    std::vector<Block> batch;
+    batch.swap(m_queue);
+    std::vector<std::function<void(bool)>> syncs;
+    syncs.swap(m_syncs);
+    lock.unlock();
+
+    size_t bytes = 0;
+    for (const Block &block : batch) {
+      bytes += block.size;
+    }
+    if (!m_failed.load() && !WriteBatch(batch)) {
+      m_failed = true;
+    }
+    if (!syncs.empty()) {
+      bool synced = !m_failed.load() && FlushToDisk();
+      for (auto &done : syncs) {
+        done(synced);
+      }
+    }
+
+    lock.lock();
+    if (m_failed.load()) {
+      for (const Block &block : batch) {
+        m_unwritten.push_back(block.offset);
+      }
+    }
+    batch.clear();
+    m_queued -= bytes;
+    m_space.notify_all();
+  }
+}
+
+bool FileWriter::WriteBatch(std::vector<Block> &batch) {
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const Block &a, const Block &b) {
+                     return a.offset < b.offset;
+                   });
+#ifdef __linux__
+  if (m_ring) {
+    return WriteBatchQueued(batch);
+  }
+#endif
+
+  // Small adjacent pieces are gathered in staging and written a block at a
+  // time, cut at block boundaries. Large ones gain nothing from the copy
+  // and are written as they are.
+  BufferPool::Buffer staging;
+  int64_t stagedAt = 0;
+  size_t staged = 0;
+  auto flushStaging = [&]() {
+    bool ok = staged == 0 || WriteAt(stagedAt, staging.Data(), staged);
+    staged = 0;
+    return ok;
+  };
+
+  for (const Block &block : batch) {
+    if (staged > 0 &&
+        block.offset != stagedAt + static_cast<int64_t>(staged)) {
+      if (!flushStaging()) {
+        return false;
+      }
+    }
+
+    // Without memory for staging, small pieces are written as they are too
+    if (block.size < DIRECT_WRITE_SIZE && !staging.Data()) {
+      staging = m_pool.Acquire(m_blockSize);
+    }
+    if (block.size >= DIRECT_WRITE_SIZE || !staging.Data()) {
+      if (!flushStaging() ||
+          !WriteAt(block.offset, block.data.Data(), block.size)) {
+        return false;
+      }
+      continue;
+    }
+
+    const char *data = block.data.Data();
+    size_t left = block.size;
+    int64_t at = block.offset;
+    while (left > 0) {
+      if (staged == 0) {
+        stagedAt = at;
+      }
+      int64_t boundary =
+          (stagedAt / static_cast<int64_t>(m_blockSize) + 1) * m_blockSize;
+      size_t take =
+          static_cast<size_t>(std::min<int64_t>(left, boundary - at));
+      std::memcpy(staging.Data() + staged, data, take);
+      staged += take;
+      data += take;
+      left -= take;
+      at += static_cast<int64_t>(take);
+      if (at == boundary && !flushStaging()) {
+        return false;
+      }
+    }
+  }
+  return flushStaging();
+}
+
+bool FileWriter::FlushToDisk() {
+#ifdef _WIN32
+  return FlushFileBuffers(m_handle) != 0;
+#elif defined(__linux__)
+  return fdatasync(m_fd) == 0;
+#else
+  return fsync(m_fd) == 0;
+#endif
+}
+
+bool FileWriter::WriteAt(int64_t offset, const char *data, size_t size) {
+  // Each write names its offset, so there is no file position to keep
+  while (size > 0) {
+#ifdef _WIN32
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD toWrite = static_cast<DWORD>(
+        std::min<size_t>(size, static_cast<size_t>(1) << 30));
+    DWORD written = 0;
+    if (!WriteFile(m_handle, data, toWrite, &written, &overlapped) ||
+        written == 0) {
+      return false;
+    }
+#else
+    ssize_t written = pwrite(m_fd, data, size, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+#endif
+    data += written;
+    size -= static_cast<size_t>(written);
+    offset += static_cast<int64_t>(written);
+  }
+  return true;
+}
+
+#ifdef __linux__
+bool FileWriter::WriteBatchQueued(std::vector<Block> &batch) {
+  // Adjacent pieces are gathered into one vectored write, cut where a
+  // piece starts in a new block, so nothing is copied
+  struct Run {
+    int64_t offset;
+    size_t first; // Index of the first piece in batch
+    size_t count;
+    size_t size;
+  };
+  std::vector<iovec> iovecs(batch.size());
+  std::vector<Run> runs;
+  int64_t blockSize = static_cast<int64_t>(m_blockSize);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const Block &block = batch[i];
+    iovecs[i].iov_base = block.data.Data();
+    iovecs[i].iov_len = block.size;
+
+    Run *last = runs.empty() ? nullptr : &runs.back();
+    if (last && block.offset == last->offset + static_cast<int64_t>(
+                                                   last->size) &&
+        block.offset / blockSize == last->offset / blockSize &&
+        last->count < MAX_GATHER) {
+      last->count++;
+      last->size += block.size;
+    } else {
+      runs.push_back({block.offset, i, 1, block.size});
+    }
+  }
+
+  // Writes what is left of a run after its first done bytes with plain
+  // writes
+  auto finishRun = [&](const Run &run, size_t done) {
+    for (size_t i = run.first; i < run.first + run.count; ++i) {
+      const Block &block = batch[i];
+      if (done >= block.size) {
+        done -= block.size;
+        continue;
+      }
+      if (!WriteAt(block.offset + static_cast<int64_t>(done),
+                   block.data.Data() + done, block.size - done)) {
+        return false;
+      }
+      done = 0;
+    }
+    return true;
+  };
+
+  // Keep the ring full; each completion hands its buffers back to the pool
+  // right away
+  bool ok = true;
+  size_t next = 0;
+  size_t inFlight = 0;
+  std::vector<bool> completed(runs.size(), false);
+  while (inFlight > 0 || (ok && next < runs.size())) {
+    while (ok && next < runs.size() && inFlight < m_ring->GetEntries()) {
+      const Run &run = runs[next];
+      if (!m_ring->PrepareWritev(m_fd, &iovecs[run.first],
+                                 static_cast<unsigned>(run.count),
+                                 run.offset, next)) {
+        break;
+      }
+      ++next;
+      ++inFlight;
+    }
+
+    uint64_t index = 0;
+    int32_t result = 0;
+    if (!m_ring->Submit() || !m_ring->WaitCompletion(index, result)) {
+      // Nothing more goes through a broken ring, but closing it would not
+      // stop the writes the kernel already took: they keep reading their
+      // buffers and may land at any time. Each is reaped first; every run
+      // not known to be written is then written again with plain writes,
+      // as later batches will be.
+      size_t outstanding = inFlight - m_ring->GetUnsubmitted();
+      std::vector<size_t> written(runs.size(), 0);
+      while (outstanding > 0 && m_ring->WaitCompletion(index, result)) {
+        --outstanding;
+        written[index] = result < 0 ? 0 : static_cast<size_t>(result);
+      }
+      if (outstanding > 0) {
+        // Their buffers must outlive them, and a plain write could be
+        // overtaken by one still in flight; the batch fails instead
+        auto stranded = std::make_unique<Stranded>();
+        stranded->ring = std::move(m_ring);
+        stranded->outstanding = outstanding;
+        stranded->iovecs = std::move(iovecs);
+        for (Block &block : batch) {
+          stranded->buffers.push_back(std::move(block.data));
+        }
+        m_stranded = std::move(stranded);
+        return false;
+      }
+
+      m_ring.reset();
+      for (size_t i = 0; ok && i < runs.size(); ++i) {
+        if (!completed[i]) {
+          ok = finishRun(runs[i], written[i]);
+        }
+      }
+      return ok;
+    }
+    --inFlight;
+
+    // A failed or short write is finished with plain writes, so only their
+    // errors (e.g. a full disk) fail the batch and not the ring's
+    const Run &run = runs[index];
+    if (ok) {
+      ok = finishRun(run, result < 0 ? 0 : static_cast<size_t>(result));
+    }
+    completed[index] = true;
+    for (size_t i = run.first; i < run.first + run.count; ++i) {
+      batch[i].data = BufferPool::Buffer();
+    }
+  }
+  return ok;
+}
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "BufferPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+class IoRing;
+
+// Write-behind stage of one download. Connections hand over what they
+// received and go back to the network; a thread of its own writes it to
+// the file with positional writes. Whatever queued up while the disk was
+// busy is written in one go, small adjacent pieces merged into writes of
+// up to blockSize that end on blockSize boundaries. On Linux the batches
+// can go through io_uring instead, several writes in flight at once.
+// Thread-safe.
+class FileWriter {
+public:
+  // Producers wait (or are told to back off) once maxQueued bytes are
+  // waiting to be written
+  FileWriter(BufferPool &pool, size_t maxQueued, size_t blockSize);
+  ~FileWriter();
+
+  // Disable copy
+  FileWriter(const FileWriter &) = delete;
+  FileWriter &operator=(const FileWriter &) = delete;
+
+  // Opens an existing file and starts the writer thread. asyncIo submits
+  // the writes through io_uring where the kernel allows it (Linux only).
+  bool Open(const std::string &path, bool asyncIo = false);
+
+  // Reserves disk space for the file to grow to size bytes, so chunks
+  // written out of order still end up contiguous on disk. The length is
+  // left alone; where reserving is not supported the file stays sparse.
+  // Returns false only if the disk is too full to hold it.
+  bool Reserve(int64_t size);
+
+  // Cuts the file to size bytes through the writer's own handle, e.g. when
+  // data already on disk turns out to be stale. Only before anything is
+  // submitted.
+  bool Truncate(int64_t size);
+
+  // Queues the first size bytes of data for offset. With wait, blocks
+  // while the queue is full; otherwise always queues. Returns false once
+  // a write has failed.
+  bool Submit(int64_t offset, BufferPool::Buffer data, size_t size,
+              bool wait = true);
+
+#ifdef __linux__
+  // The open file, for writers that move data into it themselves (e.g.
+  // with splice) rather than queueing it
+  int GetDescriptor() const { return m_fd; }
+#endif
+
+  // Once everything submitted so far has been written, flushes the file
+  // to disk and calls done on the writer thread, with false if a write or
+  // the flush failed. Does not wait.
+  void Sync(std::function<void(bool)> done);
+
+  // True while producers should hold off
+  bool IsBacklogged() const;
+  // True until everything submitted has been written
+  bool HasPending() const;
+
+  // Writes everything queued and closes the file. Returns false if any
+  // write failed.
+  bool Close();
+  // After a failure, the offsets of the pieces that may not have been
+  // written
+  std::vector<int64_t> GetUnwrittenOffsets() const;
+
+private:
+  struct Block {
+    int64_t offset = 0;
+    BufferPool::Buffer data;
+    size_t size = 0;
+  };
+
+  void Run();
+  bool WriteBatch(std::vector<Block> &batch);
+  bool WriteAt(int64_t offset, const char *data, size_t size);
+  bool FlushToDisk();
+#ifdef __linux__
+  bool WriteBatchQueued(std::vector<Block> &batch);
+#endif
+
+  BufferPool &m_pool;
+  size_t m_maxQueued;
+  size_t m_blockSize;
+
+#ifdef _WIN32
+  void *m_handle; // HANDLE
+#else
+  int m_fd = -1;
+#endif
+#ifdef __linux__
+  // A ring given up on with writes it could not reap, and what those may
+  // still read
+  struct Stranded {
+    std::unique_ptr<IoRing> ring;
+    size_t outstanding = 0;
+    std::vector<iovec> iovecs;
+    std::vector<BufferPool::Buffer> buffers;
+  };
+
+  std::unique_ptr<IoRing> m_ring;
+  std::unique_ptr<Stranded> m_stranded;
+#endif
+  std::thread m_thread;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;  // Signals the writer
+  std::condition_variable m_space; // Signals waiting producers
+  std::vector<Block> m_queue;
+  std::vector<std::function<void(bool)>> m_syncs;
+  size_t m_queued = 0; // Bytes queued or being written
+  std::vector<int64_t> m_unwritten;
+  bool m_closing = false;
+  std::atomic<bool> m_failed{false};
+};
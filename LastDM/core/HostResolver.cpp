@@ -0,0 +1,227 @@
+#include "HostResolver.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <netdb.h>
+#include <thread>
+#include <utility>
+
+HostResolver::HostResolver(const Limits &limits, LookupFunction lookup)
+    : m_limits(limits), m_lookup(std::move(lookup)) {
+  if (!m_lookup) {
+    m_lookup = SystemLookup;
+  }
+}
+
+bool HostResolver::Resolve(const std::string &host, const std::string &port,
+                           std::vector<Address> &addresses,
+                           std::string &error) {
+  std::promise<void> resolved;
+  auto done = [&](const std::vector<Address> &result,
+                  const std::string &message) {
+    addresses = result;
+    error = message;
+    resolved.set_value();
+  };
+
+  std::string key = host + ":" + port;
+  switch (Begin(key, done, addresses, error)) {
+  case Lookup::Cached:
+    break;
+  case Lookup::Query:
+    // Looked up on this thread; others asking meanwhile wait for it
+    Query(key, host, port);
+    break;
+  case Lookup::Pending:
+    resolved.get_future().wait();
+    break;
+  }
+  return error.empty();
+}
+
+bool HostResolver::GetCached(const std::string &host, const std::string &port,
+                             std::vector<Address> &addresses) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(host + ":" + port);
+  if (it == m_entries.end() || it->second.resolving ||
+      !it->second.error.empty() || Clock::now() >= it->second.expires) {
+    return false;
+  }
+  m_stats.hits++;
+  addresses = it->second.addresses;
+  return true;
+}
+
+void HostResolver::ResolveAsync(const std::string &host,
+                                const std::string &port, Callback done) {
+  std::vector<Address> addresses;
+  std::string error;
+  std::string key = host + ":" + port;
+  switch (Begin(key, done, addresses, error)) {
+  case Lookup::Cached:
+    done(addresses, error);
+    break;
+  case Lookup::Query: {
+    auto self = shared_from_this();
+    std::thread([self, key, host, port]() {
+      self->Query(key, host, port);
+    }).detach();
+    break;
+  }
+  case Lookup::Pending:
+    break;
+  }
+}
+
+HostResolver::Lookup HostResolver::Begin(const std::string &key,
+                                         Callback done,
+                                         std::vector<Address> &addresses,
+                                         std::string &error) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto now = Clock::now();
+  auto it = m_entries.find(key);
+  if (it != m_entries.end() && it->second.resolving) {
+    it->second.waiters.push_back(std::move(done));
+    return Lookup::Pending;
+  }
+  if (it != m_entries.end() && now < it->second.expires) {
+    m_stats.hits++;
+    addresses = it->second.addresses;
+    error = it->second.error;
+    return Lookup::Cached;
+  }
+
+  EvictLocked(now);
+  Entry &entry = m_entries[key];
+  entry.resolving = true;
+  entry.waiters.push_back(std::move(done));
+  m_stats.queries++;
+  return Lookup::Query;
+}
+
+void HostResolver::Query(const std::string &key, const std::string &host,
+                         const std::string &port) {
+  std::vector<Address> addresses;
+  std::string error;
+  int rc = m_lookup(host, port, addresses);
+  if (rc != 0) {
+    addresses.clear();
+    error = "Failed to resolve " + host + ": " + gai_strerror(rc);
+  } else if (addresses.empty()) {
+    error = "Failed to resolve " + host + ": no addresses";
+  }
+
+  std::vector<Callback> waiters;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &entry = m_entries[key];
+    entry.addresses = addresses;
+    entry.error = error;
+    entry.expires =
+        Clock::now() + std::chrono::milliseconds(error.empty()
+                                                     ? m_limits.ttlMs
+                                                     : m_limits.failureTtlMs);
+    entry.resolving = false;
+    waiters.swap(entry.waiters);
+  }
+  for (auto &done : waiters) {
+    done(addresses, error);
+  }
+}
+
+void HostResolver::ReportFailure(const std::string &host,
+                                 const std::string &port,
+                                 const Address &address) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_entries.find(host + ":" + port);
+  if (it == m_entries.end()) {
+    return;
+  }
+  auto &addresses = it->second.addresses;
+  auto failed = std::find_if(addresses.begin(), addresses.end(),
+                             [&address](const Address &candidate) {
+                               return candidate.length == address.length &&
+                                      std::memcmp(&candidate.storage,
+                                                  &address.storage,
+                                                  address.length) == 0;
+                             });
+  if (failed != addresses.end()) {
+    std::rotate(failed, failed + 1, addresses.end());
+  }
+}
+
+void HostResolver::Clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    it = it->second.resolving ? std::next(it) : m_entries.erase(it);
+  }
+}
+
+HostResolver::Stats HostResolver::GetStats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void HostResolver::EvictLocked(Clock::time_point now) {
+  if (m_entries.size() < m_limits.maxEntries) {
+    return;
+  }
+
+  // Expired entries first, then the ones closest to expiring
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    it = !it->second.resolving && now >= it->second.expires
+             ? m_entries.erase(it)
+             : std::next(it);
+  }
+  while (m_entries.size() >= m_limits.maxEntries) {
+    auto oldest = m_entries.end();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+      if (!it->second.resolving &&
+          (oldest == m_entries.end() ||
+           it->second.expires < oldest->second.expires)) {
+        oldest = it;
+      }
+    }
+    if (oldest == m_entries.end()) {
+      return;
+    }
+    m_entries.erase(oldest);
+  }
+}
+
+int HostResolver::SystemLookup(const std::string &host,
+                               const std::string &port,
+                               std::vector<Address> &addresses) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo *result = nullptr;
+  int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+  if (rc != 0) {
+    return rc;
+  }
+
+  // Split by family in the resolver's order, then take turns
+  std::vector<Address> first;
+  std::vector<Address> other;
+  int firstFamily = result->ai_family;
+  for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+    Address address = {};
+    std::memcpy(&address.storage, ai->ai_addr, ai->ai_addrlen);
+    address.length = ai->ai_addrlen;
+    (ai->ai_family == firstFamily ? first : other).push_back(address);
+  }
+  freeaddrinfo(result);
+
+  addresses.clear();
+  for (size_t i = 0; i < std::max(first.size(), other.size()); ++i) {
+    if (i < first.size()) {
+      addresses.push_back(first[i]);
+    }
+    if (i < other.size()) {
+      addresses.push_back(other[i]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+// Addresses of the hosts the socket transports connect to, kept for a
+// while and shared by all downloads, so a batch of transfers to one host
+// looks it up once. Concurrent lookups of a host share one query, and
+// failed lookups are remembered briefly too. Must be owned by a
+// shared_ptr. Thread-safe.
+class HostResolver : public std::enable_shared_from_this<HostResolver> {
+public:
+  struct Address {
+    sockaddr_storage storage;
+    socklen_t length;
+  };
+
+  struct Limits {
+    long ttlMs = 60000;       // How long resolved addresses are kept
+    long failureTtlMs = 5000; // How long a failed lookup is kept
+    size_t maxEntries = 256;
+  };
+
+  struct Stats {
+    uint64_t hits = 0;    // Lookups answered from the cache
+    uint64_t queries = 0; // Lookups that had to ask the resolver
+  };
+
+  // Resolves like getaddrinfo: returns 0 and fills addresses, or returns
+  // a getaddrinfo error code. Replaceable, e.g. by a stub for tests.
+  using LookupFunction =
+      std::function<int(const std::string &host, const std::string &port,
+                        std::vector<Address> &addresses)>;
+  // addresses is empty and error set if the host could not be resolved
+  using Callback = std::function<void(const std::vector<Address> &addresses,
+                                      const std::string &error)>;
+
+  explicit HostResolver(const Limits &limits,
+                        LookupFunction lookup = nullptr);
+
+  // Disable copy
+  HostResolver(const HostResolver &) = delete;
+  HostResolver &operator=(const HostResolver &) = delete;
+
+  // Returns the addresses of host:port, waiting for the lookup unless they
+  // are cached. Returns false and fills error if it failed.
+  bool Resolve(const std::string &host, const std::string &port,
+               std::vector<Address> &addresses, std::string &error);
+  // Fills addresses and returns true only if they are cached
+  bool GetCached(const std::string &host, const std::string &port,
+                 std::vector<Address> &addresses);
+  // Calls done once host:port is resolved: right away if the result is
+  // cached, otherwise from a lookup thread
+  void ResolveAsync(const std::string &host, const std::string &port,
+                    Callback done);
+
+  // Moves an address that could not be connected to behind the others of
+  // its host, so later connections try it last
+  void ReportFailure(const std::string &host, const std::string &port,
+                     const Address &address);
+
+  void Clear();
+  Stats GetStats() const;
+
+  // The system resolver (getaddrinfo), with the addresses ordered for a
+  // happy eyeballs connect: alternating between the address families,
+  // starting with the one listed first
+  static int SystemLookup(const std::string &host, const std::string &port,
+                          std::vector<Address> &addresses);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::vector<Address> addresses;
+    std::string error;
+    Clock::time_point expires;
+    bool resolving = false;
+    std::vector<Callback> waiters; // Asked while it was resolving
+  };
+
+  Limits m_limits;
+  LookupFunction m_lookup;
+  mutable std::mutex m_mutex;
+  std::map<std::string, Entry> m_entries; // Keyed by "host:port"
+  Stats m_stats;
+
+  enum class Lookup { Cached, Pending, Query };
+
+  // Cached: the result is filled in. Otherwise done is queued for the
+  // result; with Query the caller has to run the lookup.
+  Lookup Begin(const std::string &key, Callback done,
+               std::vector<Address> &addresses, std::string &error);
+  // Runs the lookup for key, records it and calls everyone waiting
+  void Query(const std::string &key, const std::string &host,
+             const std::string &port);
+  void EvictLocked(Clock::time_point now);
+};
@@ -0,0 +1,382 @@
+#include "HttpProtocol.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr size_t MAX_LINE_SIZE = 8 * 1024;
+
+std::string Trim(const std::string &value) {
+  size_t start = value.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return "";
+  }
+  size_t end = value.find_last_not_of(" \t\r");
+  return value.substr(start, end - start + 1);
+}
+
+} // namespace
+
+std::string HttpProtocol::ToLower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return value;
+}
+
+bool HttpProtocol::ParseUrl(const std::string &url, Url &out) {
+  size_t schemeEnd = url.find("://");
+  if (schemeEnd == std::string::npos) {
+    return false;
+  }
+
+  out.scheme = ToLower(url.substr(0, schemeEnd));
+  size_t hostStart = schemeEnd + 3;
+  size_t pathStart = url.find_first_of("/?#", hostStart);
+  std::string authority = url.substr(
+      hostStart,
+      pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+
+  // Drop credentials
+  size_t atPos = authority.rfind('@');
+  if (atPos != std::string::npos) {
+    authority = authority.substr(atPos + 1);
+  }
+
+  out.port = out.scheme == "https" ? "443" : "80";
+  if (!authority.empty() && authority[0] == '[') {
+    // IPv6 literal
+    size_t close = authority.find(']');
+    if (close == std::string::npos) {
+      return false;
+    }
+    out.host = authority.substr(1, close - 1);
+    if (close + 1 < authority.size() && authority[close + 1] == ':') {
+      out.port = authority.substr(close + 2);
+    }
+  } else {
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+      out.host = authority.substr(0, colon);
+      out.port = authority.substr(colon + 1);
+    } else {
+      out.host = authority;
+    }
+  }
+
+  out.target = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+  size_t fragment = out.target.find('#');
+  if (fragment != std::string::npos) {
+    out.target.erase(fragment);
+  }
+  if (out.target.empty() || out.target[0] != '/') {
+    out.target = "/" + out.target;
+  }
+
+  return !out.host.empty() && !out.port.empty();
+}
+
+std::string HttpProtocol::ResolveRedirect(const Url &base,
+                                          const std::string &location) {
+  if (location.find("://") != std::string::npos) {
+    return location;
+  }
+
+  std::string authority = base.scheme + "://" +
+                          (base.host.find(':') != std::string::npos
+                               ? "[" + base.host + "]"
+                               : base.host) +
+                          ":" + base.port;
+  if (location.compare(0, 2, "//") == 0) {
+    return base.scheme + ":" + location;
+  }
+  if (!location.empty() && location[0] == '/') {
+    return authority + location;
+  }
+
+  // Relative to the directory of the current target
+  std::string path = base.target.substr(0, base.target.find('?'));
+  return authority + path.substr(0, path.rfind('/') + 1) + location;
+}
+
+void HttpProtocol::ParseProxy(const std::string &proxyUrl, std::string &host,
+                              std::string &port) {
+  size_t colon = proxyUrl.rfind(':');
+  host = proxyUrl.substr(0, colon);
+  port = colon == std::string::npos ? "8080" : proxyUrl.substr(colon + 1);
+}
+
+bool HttpProtocol::IsRedirect(int statusCode) {
+  return statusCode == 301 || statusCode == 302 || statusCode == 303 ||
+         statusCode == 307 || statusCode == 308;
+}
+
+std::string HttpProtocol::FormatGetRequest(const Url &url,
+                                           const std::string &absoluteUrl,
+                                           const HttpRequest &request,
+                                           const std::string &userAgent,
+                                           bool viaProxy, bool keepAlive) {
+  std::string hostHeader =
+      url.host.find(':') != std::string::npos ? "[" + url.host + "]"
+                                              : url.host;
+  if (url.port != (url.scheme == "https" ? "443" : "80")) {
+    hostHeader += ":" + url.port;
+  }
+
+  std::string message =
+      "GET " + (viaProxy ? absoluteUrl : url.target) + " HTTP/1.1\r\n";
+  message += "Host: " + hostHeader + "\r\n";
+  message += "User-Agent: " + userAgent + "\r\n";
+  message += "Accept: */*\r\n";
+  message += "Accept-Encoding: identity\r\n";
+  if (request.rangeStart >= 0) {
+    message += "Range: " +
+               HttpTransport::FormatRangeHeader(request.rangeStart,
+                                                request.rangeEnd) +
+               "\r\n";
+    if (!request.ifRange.empty()) {
+      message += "If-Range: " + request.ifRange + "\r\n";
+    }
+  }
+  message += keepAlive ? "Connection: keep-alive\r\n\r\n"
+                       : "Connection: close\r\n\r\n";
+  return message;
+}
+
+bool HttpProtocol::IsKeepAlive(
+    const std::string &head, const std::map<std::string, std::string> &headers) {
+  auto it = headers.find("connection");
+  std::string connection = it != headers.end() ? ToLower(it->second) : "";
+  if (connection.find("close") != std::string::npos) {
+    return false;
+  }
+
+  // HTTP/1.0 connections only persist when the server says so
+  if (head.compare(0, 8, "HTTP/1.0") == 0) {
+    return connection.find("keep-alive") != std::string::npos;
+  }
+  return true;
+}
+
+bool HttpProtocol::ParseResponseHead(
+    const std::string &head, HttpResponse &response,
+    std::map<std::string, std::string> &headers) {
+  response = HttpResponse();
+  size_t lineEnd = head.find("\r\n");
+  std::string statusLine = head.substr(0, lineEnd);
+
+  // HTTP/1.1 206 Partial Content
+  if (statusLine.compare(0, 5, "HTTP/") != 0) {
+    return false;
+  }
+  size_t codeStart = statusLine.find(' ');
+  if (codeStart == std::string::npos) {
+    return false;
+  }
+  response.statusCode = std::atoi(statusLine.c_str() + codeStart + 1);
+  if (response.statusCode < 100 || response.statusCode > 999) {
+    return false;
+  }
+
+  headers.clear();
+  while (lineEnd != std::string::npos) {
+    size_t start = lineEnd + 2;
+    lineEnd = head.find("\r\n", start);
+    std::string line = head.substr(
+        start, lineEnd == std::string::npos ? std::string::npos
+                                            : lineEnd - start);
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+
+    std::string name = ToLower(Trim(line.substr(0, colon)));
+    std::string value = Trim(line.substr(colon + 1));
+    auto it = headers.find(name);
+    if (it != headers.end()) {
+      it->second += ", " + value;
+    } else {
+      headers[name] = value;
+    }
+  }
+
+  auto it = headers.find("content-length");
+  if (it != headers.end()) {
+    response.contentLength = std::strtoll(it->second.c_str(), nullptr, 10);
+  }
+
+  it = headers.find("accept-ranges");
+  response.acceptRanges =
+      it != headers.end() &&
+      ToLower(it->second).find("bytes") != std::string::npos;
+
+  it = headers.find("etag");
+  if (it != headers.end()) {
+    response.etag = it->second;
+  }
+  it = headers.find("last-modified");
+  if (it != headers.end()) {
+    response.lastModified = it->second;
+  }
+
+  it = headers.find("retry-after");
+  if (it != headers.end()) {
+    response.retryAfterSeconds = HttpTransport::ParseRetryAfter(it->second);
+  }
+
+  it = headers.find("content-range");
+  if (it != headers.end()) {
+    response.hasContentRange = HttpTransport::ParseContentRange(
+        it->second, response.rangeStart, response.rangeEnd,
+        response.instanceLength);
+  }
+
+  return true;
+}
+
+void HttpBodyDecoder::Reset(Mode mode, int64_t contentLength) {
+  m_mode = mode;
+  m_line.clear();
+  switch (mode) {
+  case Mode::ContentLength:
+    m_remaining = contentLength;
+    m_state = contentLength > 0 ? State::Data : State::Done;
+    break;
+  case Mode::Chunked:
+    m_remaining = 0;
+    m_state = State::SizeLine;
+    break;
+  case Mode::UntilClose:
+    m_remaining = 0;
+    m_state = State::Data;
+    break;
+  }
+}
+
+void HttpBodyDecoder::Reset(const HttpResponse &response,
+                            const std::map<std::string, std::string> &headers) {
+  int status = response.statusCode;
+  auto it = headers.find("transfer-encoding");
+  if (status == 204 || status == 304 || status < 200) {
+    Reset(Mode::ContentLength, 0);
+  } else if (it != headers.end() && HttpProtocol::ToLower(it->second).find(
+                                        "chunked") != std::string::npos) {
+    Reset(Mode::Chunked);
+  } else if (response.contentLength >= 0) {
+    Reset(Mode::ContentLength, response.contentLength);
+  } else {
+    Reset(Mode::UntilClose);
+  }
+}
+
+int64_t HttpBodyDecoder::GetRemaining() const {
+  return m_mode == Mode::ContentLength ? m_remaining : -1;
+}
+
+bool HttpBodyDecoder::TakeLine(const char *&data, size_t &size,
+                               std::string &line, bool &complete) {
+  const char *eol = static_cast<const char *>(std::memchr(data, '\n', size));
+  size_t take = eol ? static_cast<size_t>(eol - data) : size;
+  if (m_line.size() + take > MAX_LINE_SIZE) {
+    return false;
+  }
+
+  m_line.append(data, take);
+  complete = eol != nullptr;
+  take += complete ? 1 : 0;
+  data += take;
+  size -= take;
+
+  if (complete) {
+    if (!m_line.empty() && m_line.back() == '\r') {
+      m_line.pop_back();
+    }
+    line.swap(m_line);
+    m_line.clear();
+  }
+  return true;
+}
+
+bool HttpBodyDecoder::Next(const char *&data, size_t &size, size_t maxBody,
+                           const char *&body, size_t &bodySize) {
+  body = nullptr;
+  bodySize = 0;
+
+  while (size > 0 && m_state != State::Done) {
+    if (m_state == State::Data) {
+      size_t run = std::min(size, maxBody);
+      if (m_mode != Mode::UntilClose) {
+        run = static_cast<size_t>(std::min<int64_t>(run, m_remaining));
+        m_remaining -= run;
+        if (m_remaining == 0) {
+          m_state =
+              m_mode == Mode::Chunked ? State::DataEnd : State::Done;
+        }
+      }
+      body = data;
+      bodySize = run;
+      data += run;
+      size -= run;
+      return true;
+    }
+
+    std::string line;
+    bool complete = false;
+    if (!TakeLine(data, size, line, complete)) {
+      return false;
+    }
+    if (!complete) {
+      break;
+    }
+
+    switch (m_state) {
+    case State::SizeLine: {
+      // Ignore chunk extensions after ';'
+      std::string sizeStr = Trim(line.substr(0, line.find(';')));
+      char *endPtr = nullptr;
+      int64_t chunkSize = std::strtoll(sizeStr.c_str(), &endPtr, 16);
+      if (sizeStr.empty() || !endPtr || *endPtr != '\0' || chunkSize < 0) {
+        return false;
+      }
+      m_remaining = chunkSize;
+      m_state = chunkSize == 0 ? State::Trailer : State::Data;
+      break;
+    }
+    case State::DataEnd:
+      // Every chunk's data is followed by CRLF
+      if (!line.empty()) {
+        return false;
+      }
+      m_state = State::SizeLine;
+      break;
+    case State::Trailer:
+      // Skip trailers up to the terminating empty line
+      if (line.empty()) {
+        m_state = State::Done;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  return true;
+}
+
+void HttpBodyDecoder::Skip(size_t size) {
+  if (m_mode != Mode::ContentLength || m_state != State::Data) {
+    return;
+  }
+  m_remaining -= std::min<int64_t>(static_cast<int64_t>(size), m_remaining);
+  if (m_remaining == 0) {
+    m_state = State::Done;
+  }
+}
+
+bool HttpBodyDecoder::OnConnectionClosed() {
+  if (m_mode == Mode::UntilClose) {
+    m_state = State::Done;
+  }
+  return m_state == State::Done;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "HttpTransport.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// HTTP/1.1 wire format helpers shared by the socket based clients
+class HttpProtocol {
+public:
+  struct Url {
+    std::string scheme;
+    std::string host;
+    std::string port;
+    std::string target; // Path and query
+  };
+
+  static bool ParseUrl(const std::string &url, Url &out);
+  static std::string ResolveRedirect(const Url &base,
+                                     const std::string &location);
+  static bool IsRedirect(int statusCode);
+  // Splits a "host:port" proxy setting, defaulting to port 8080
+  static void ParseProxy(const std::string &proxyUrl, std::string &host,
+                         std::string &port);
+
+  // Builds a GET request. Requests sent through a proxy use the absolute
+  // URL as the request target.
+  static std::string FormatGetRequest(const Url &url,
+                                      const std::string &absoluteUrl,
+                                      const HttpRequest &request,
+                                      const std::string &userAgent,
+                                      bool viaProxy, bool keepAlive);
+
+  // Parses the status line and headers (without the blank line that ends
+  // them). Header names are lower-cased.
+  static bool ParseResponseHead(const std::string &head,
+                                HttpResponse &response,
+                                std::map<std::string, std::string> &headers);
+
+  // Whether the server lets the connection stay open after this response
+  static bool IsKeepAlive(const std::string &head,
+                          const std::map<std::string, std::string> &headers);
+
+  static std::string ToLower(std::string value);
+};
+
+// Incremental decoder for a response body (Content-Length, chunked or
+// delimited by connection close)
+class HttpBodyDecoder {
+public:
+  enum class Mode { ContentLength, Chunked, UntilClose };
+
+  void Reset(Mode mode, int64_t contentLength = 0);
+  // Picks the framing from the response status and headers
+  void Reset(const HttpResponse &response,
+             const std::map<std::string, std::string> &headers);
+
+  // Consumes framing bytes from [data, data + size) and yields the next run
+  // of at most maxBody body bytes, pointing into the input. data and size
+  // are advanced past everything consumed. bodySize is 0 when the input
+  // only held framing. Returns false on malformed input.
+  bool Next(const char *&data, size_t &size, size_t maxBody,
+            const char *&body, size_t &bodySize);
+
+  // Accounts for size body bytes the caller took off the connection
+  // itself, bypassing Next. Only valid for identity framing.
+  void Skip(size_t size);
+
+  // Called when the peer closed the connection. Returns true if that was a
+  // valid end of the body.
+  bool OnConnectionClosed();
+
+  bool IsComplete() const { return m_state == State::Done; }
+  bool IsIdentity() const { return m_mode != Mode::Chunked; }
+  // Body bytes left for Content-Length bodies, -1 if not known
+  int64_t GetRemaining() const;
+
+private:
+  enum class State { SizeLine, Data, DataEnd, Trailer, Done };
+
+  Mode m_mode = Mode::UntilClose;
+  State m_state = State::Data;
+  int64_t m_remaining = 0; // Body bytes, or bytes left in the current chunk
+  std::string m_line;      // Partial framing line
+
+  bool TakeLine(const char *&data, size_t &size, std::string &line,
+                bool &complete);
+};
@@ -0,0 +1,98 @@
+#include "HttpTransport.h"
+#include <cctype>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include "WinINetTransport.h"
+#else
+#include "PosixHttpTransport.h"
+#endif
+
+std::shared_ptr<HttpTransport>
+HttpTransport::Create(const HttpTransportOptions &options) {
+#ifdef _WIN32
+  auto transport = std::make_shared<WinINetTransport>(options);
+  if (!transport->IsOpen()) {
+    return nullptr;
+  }
+  return transport;
+#else
+  return std::make_shared<PosixHttpTransport>(options);
+#endif
+}
+
+bool HttpTransport::ParseContentRange(const std::string &value, int64_t &start,
+                                      int64_t &end, int64_t &instanceLength) {
+  // Format: "bytes <start>-<end>/<length or *>"
+  size_t spacePos = value.find(' ');
+  if (spacePos == std::string::npos) {
+    return false;
+  }
+
+  size_t startPos = spacePos + 1;
+  while (startPos < value.size() &&
+         std::isspace(static_cast<unsigned char>(value[startPos]))) {
+    startPos++;
+  }
+
+  size_t dashPos = value.find('-', startPos);
+  if (dashPos == std::string::npos || dashPos == startPos) {
+    return false;
+  }
+
+  std::string startStr = value.substr(startPos, dashPos - startPos);
+  char *endPtr = nullptr;
+  int64_t parsedStart = std::strtoll(startStr.c_str(), &endPtr, 10);
+  if (!endPtr || endPtr == startStr.c_str() || *endPtr != '\0') {
+    return false;
+  }
+
+  size_t slashPos = value.find('/', dashPos);
+  std::string endStr = value.substr(
+      dashPos + 1,
+      slashPos == std::string::npos ? std::string::npos : slashPos - dashPos - 1);
+  int64_t parsedEnd = std::strtoll(endStr.c_str(), &endPtr, 10);
+  if (!endPtr || endPtr == endStr.c_str()) {
+    return false;
+  }
+
+  int64_t parsedLength = -1;
+  if (slashPos != std::string::npos) {
+    std::string lengthStr = value.substr(slashPos + 1);
+    if (!lengthStr.empty() && lengthStr[0] != '*') {
+      parsedLength = std::strtoll(lengthStr.c_str(), nullptr, 10);
+    }
+  }
+
+  start = parsedStart;
+  end = parsedEnd;
+  instanceLength = parsedLength;
+  return true;
+}
+
+std::string HttpTransport::FormatRangeHeader(int64_t start, int64_t end) {
+  std::string value = "bytes=" + std::to_string(start) + "-";
+  if (end >= 0) {
+    value += std::to_string(end);
+  }
+  return value;
+}
+
+int64_t HttpTransport::ParseRetryAfter(const std::string &value) {
+  size_t start = 0;
+  while (start < value.size() &&
+         std::isspace(static_cast<unsigned char>(value[start]))) {
+    start++;
+  }
+  if (start == value.size() ||
+      !std::isdigit(static_cast<unsigned char>(value[start]))) {
+    return -1;
+  }
+
+  char *endPtr = nullptr;
+  int64_t seconds = std::strtoll(value.c_str() + start, &endPtr, 10);
+  while (*endPtr != '\0' && std::isspace(static_cast<unsigned char>(*endPtr))) {
+    endPtr++;
+  }
+  return *endPtr == '\0' ? seconds : -1;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class ConnectionPool;
+class HostResolver;
+
+// A single HTTP GET, optionally restricted to a byte range
+struct HttpRequest {
+  std::string url;
+  int64_t rangeStart = -1; // First byte to request, -1 for no Range header
+  int64_t rangeEnd = -1;   // Last byte (inclusive), -1 for open-ended
+  // Validator sent as If-Range: the server answers with the whole file
+  // instead of the range if it no longer matches. Empty for none.
+  std::string ifRange;
+  bool verifySSL = true;
+};
+
+// Response metadata, available once the headers have been received
+struct HttpResponse {
+  int statusCode = 0;
+  int64_t contentLength = -1;
+  bool acceptRanges = false;
+
+  // Parsed Content-Range header (206 responses)
+  bool hasContentRange = false;
+  int64_t rangeStart = -1;
+  int64_t rangeEnd = -1;
+  int64_t instanceLength = -1; // Total size after the '/', -1 if unknown
+
+  // Validators of the resource, empty if not sent
+  std::string etag;
+  std::string lastModified;
+
+  // Retry-After of a 429 or 503 in seconds, -1 if not sent
+  int64_t retryAfterSeconds = -1;
+};
+
+// Body stream of an opened request. Destroying it closes the request.
+class HttpConnection {
+public:
+  virtual ~HttpConnection() = default;
+
+  // Reads up to size bytes of the body. Returns false on a transport error;
+  // a successful read of 0 bytes means the body is complete.
+  virtual bool Read(char *buffer, size_t size, size_t &bytesRead,
+                    std::string &error) = 0;
+
+#ifdef __linux__
+  // Whether ReadToFile can take the body; it needs plain framing and bytes
+  // the transport does not have to look at
+  virtual bool CanReadToFile() const { return false; }
+  // Like Read, but moves the bytes into the file fd at offset without
+  // copying them through user space. writeFailed tells a failed file write
+  // apart from a transport error.
+  virtual bool ReadToFile(int /*fd*/, int64_t /*offset*/, size_t /*size*/,
+                          size_t &bytesRead, std::string &error,
+                          bool &writeFailed) {
+    bytesRead = 0;
+    writeFailed = false;
+    error = "Not supported by this transport";
+    return false;
+  }
+#endif
+};
+
+struct HttpTransportOptions {
+  std::string userAgent;
+  std::string proxyUrl; // host:port, empty for a direct connection
+  long connectTimeoutMs = 30000;
+  long receiveTimeoutMs = 30000;
+  int maxConnectionsPerHost = 0; // 0 keeps the platform default
+  // Keep-alive sockets shared between requests (socket transport only;
+  // WinINet pools connections inside its session). Null disables reuse.
+  std::shared_ptr<ConnectionPool> connectionPool;
+  // Address cache shared between transports (socket transport only). Null
+  // gives the transport one of its own.
+  std::shared_ptr<HostResolver> resolver;
+};
+
+class HttpTransport {
+public:
+  virtual ~HttpTransport() = default;
+
+  // Sends the request and waits for the response headers. Returns nullptr
+  // and fills error if the server could not be reached.
+  virtual std::unique_ptr<HttpConnection> Open(const HttpRequest &request,
+                                               HttpResponse &response,
+                                               std::string &error) = 0;
+
+  // Creates the native transport for this platform: WinINet on Windows,
+  // POSIX sockets elsewhere. Returns nullptr if it cannot be initialized.
+  static std::shared_ptr<HttpTransport>
+  Create(const HttpTransportOptions &options);
+
+  // Helpers shared by the implementations
+  static bool ParseContentRange(const std::string &value, int64_t &start,
+                                int64_t &end, int64_t &instanceLength);
+  static std::string FormatRangeHeader(int64_t start, int64_t end);
+  // Seconds of a Retry-After value, -1 if it is not a number of seconds
+  // (the HTTP-date form is not used)
+  static int64_t ParseRetryAfter(const std::string &value);
+};
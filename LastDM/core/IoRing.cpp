@@ -0,0 +1,142 @@
+#include "IoRing.h"
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+void *MapRing(int fd, size_t size, off_t offset) {
+  void *ring = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, offset);
+  return ring == MAP_FAILED ? nullptr : ring;
+}
+
+template <typename T> T *At(void *ring, unsigned offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+int Enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit,
+                                  minComplete, flags, nullptr, 0));
+}
+
+} // namespace
+
+IoRing::IoRing(unsigned entries) {
+  io_uring_params params = {};
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) {
+    return;
+  }
+
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+  // Newer kernels map both rings with one call
+  bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMap) {
+    m_sqRingSize = m_cqRingSize =
+        m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+  }
+  m_sqRing = MapRing(fd, m_sqRingSize, IORING_OFF_SQ_RING);
+  m_cqRing = singleMap ? m_sqRing : MapRing(fd, m_cqRingSize,
+                                            IORING_OFF_CQ_RING);
+  m_sqes = static_cast<io_uring_sqe *>(
+      MapRing(fd, m_sqesSize, IORING_OFF_SQES));
+  m_fd = fd;
+  if (!m_sqRing || !m_cqRing || !m_sqes) {
+    Release();
+    return;
+  }
+
+  m_sqEntries = params.sq_entries;
+  m_sqHead = At<unsigned>(m_sqRing, params.sq_off.head);
+  m_sqTail = At<unsigned>(m_sqRing, params.sq_off.tail);
+  m_sqMask = At<unsigned>(m_sqRing, params.sq_off.ring_mask);
+  m_sqArray = At<unsigned>(m_sqRing, params.sq_off.array);
+  m_cqHead = At<unsigned>(m_cqRing, params.cq_off.head);
+  m_cqTail = At<unsigned>(m_cqRing, params.cq_off.tail);
+  m_cqMask = At<unsigned>(m_cqRing, params.cq_off.ring_mask);
+  m_cqes = At<io_uring_cqe>(m_cqRing, params.cq_off.cqes);
+}
+
+IoRing::~IoRing() { Release(); }
+
+void IoRing::Release() {
+  if (m_sqes) {
+    munmap(m_sqes, m_sqesSize);
+    m_sqes = nullptr;
+  }
+  if (m_cqRing && m_cqRing != m_sqRing) {
+    munmap(m_cqRing, m_cqRingSize);
+  }
+  m_cqRing = nullptr;
+  if (m_sqRing) {
+    munmap(m_sqRing, m_sqRingSize);
+    m_sqRing = nullptr;
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+bool IoRing::PrepareWritev(int fd, const iovec *iov, unsigned count,
+                           int64_t offset, uint64_t userData) {
+  unsigned tail = *m_sqTail;
+  if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+    return false;
+  }
+
+  unsigned index = tail & *m_sqMask;
+  io_uring_sqe &sqe = m_sqes[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_WRITEV;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uint64_t>(iov);
+  sqe.len = count;
+  sqe.off = static_cast<uint64_t>(offset);
+  sqe.user_data = userData;
+  m_sqArray[index] = index;
+
+  // The kernel may look at the entry as soon as it sees the new tail
+  __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++m_unsubmitted;
+  return true;
+}
+
+bool IoRing::Submit() {
+  while (m_unsubmitted > 0) {
+    int submitted = Enter(m_fd, m_unsubmitted, 0, 0);
+    if (submitted < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return false;
+    }
+    m_unsubmitted -= static_cast<unsigned>(submitted);
+  }
+  return true;
+}
+
+bool IoRing::WaitCompletion(uint64_t &userData, int32_t &result) {
+  while (true) {
+    unsigned head = *m_cqHead;
+    if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+      userData = cqe.user_data;
+      result = cqe.res;
+      __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+
+    if (Enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+      return false;
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Minimal io_uring instance for batches of file writes (Linux only), set up
+// with the raw system calls. Not thread-safe; one writer thread owns it.
+class IoRing {
+public:
+  explicit IoRing(unsigned entries);
+  ~IoRing();
+
+  // Disable copy
+  IoRing(const IoRing &) = delete;
+  IoRing &operator=(const IoRing &) = delete;
+
+  // False if the kernel does not offer io_uring (too old, or blocked by a
+  // seccomp policy)
+  bool IsValid() const { return m_fd >= 0; }
+  // Operations that can be queued before Submit
+  unsigned GetEntries() const { return m_sqEntries; }
+  // Operations queued but not yet taken by the kernel; a failed Submit
+  // leaves them here, and they never run
+  unsigned GetUnsubmitted() const { return m_unsubmitted; }
+
+  // Queues a write of iov[0, count) to fd at offset. The iovecs and the
+  // memory they point to must stay valid until its completion is taken.
+  // Returns false if the submission queue is full.
+  bool PrepareWritev(int fd, const iovec *iov, unsigned count,
+                     int64_t offset, uint64_t userData);
+  // Hands everything queued to the kernel
+  bool Submit();
+  // Waits for the next completion. result is the written byte count or a
+  // negated errno.
+  bool WaitCompletion(uint64_t &userData, int32_t &result);
+
+private:
+  int m_fd = -1;
+
+  void *m_sqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  void *m_cqRing = nullptr;
+  size_t m_cqRingSize = 0;
+  io_uring_sqe *m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned m_sqEntries = 0;
+  unsigned *m_sqHead = nullptr;
+  unsigned *m_sqTail = nullptr;
+  unsigned *m_sqMask = nullptr;
+  unsigned *m_sqArray = nullptr;
+  unsigned *m_cqHead = nullptr;
+  unsigned *m_cqTail = nullptr;
+  unsigned *m_cqMask = nullptr;
+  io_uring_cqe *m_cqes = nullptr;
+
+  unsigned m_unsubmitted = 0;
+
+  void Release();
+};
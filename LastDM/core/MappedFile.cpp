@@ -0,0 +1,192 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::View::View(View &&other) noexcept
+    : m_data(other.m_data), m_offset(other.m_offset), m_size(other.m_size) {
+#ifdef _WIN32
+  m_owner = other.m_owner;
+#endif
+  other.m_data = nullptr;
+  other.m_size = 0;
+}
+
+MappedFile::View &MappedFile::View::operator=(View &&other) noexcept {
+  if (this != &other) {
+    Reset();
+    m_data = other.m_data;
+    m_offset = other.m_offset;
+    m_size = other.m_size;
+#ifdef _WIN32
+    m_owner = other.m_owner;
+#endif
+    other.m_data = nullptr;
+    other.m_size = 0;
+  }
+  return *this;
+}
+
+void MappedFile::View::Reset() {
+  if (m_data) {
+#ifdef _WIN32
+    // Unmapped pages are written back lazily; start writing them now so
+    // the next Sync of the file covers them
+    std::lock_guard<std::mutex> lock(m_owner->m_viewsMutex);
+    auto &views = m_owner->m_views;
+    views.erase(std::find(views.begin(), views.end(),
+                          std::make_pair(m_data, m_size)));
+    FlushViewOfFile(m_data, 0);
+    UnmapViewOfFile(m_data);
+#else
+    munmap(m_data, m_size);
+#endif
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+bool MappedFile::View::Flush(int64_t from, int64_t to, bool wait) {
+  from = std::max(from, m_offset);
+  to = std::min(to, m_offset + static_cast<int64_t>(m_size));
+  if (!m_data || from >= to) {
+    return true;
+  }
+
+#ifdef _WIN32
+  if (!FlushViewOfFile(At(from), static_cast<SIZE_T>(to - from))) {
+    return false;
+  }
+  return !wait || FlushFileBuffers(m_owner->m_file);
+#else
+  // msync wants a page aligned start; the view itself starts on one
+  static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+  int64_t start = from - (from - m_offset) % pageSize;
+  return msync(At(start), static_cast<size_t>(to - start),
+               wait ? MS_SYNC : MS_ASYNC) == 0;
+#endif
+}
+
+MappedFile::MappedFile(size_t windowSize) : m_windowSize(windowSize) {
+#ifdef _WIN32
+  m_file = INVALID_HANDLE_VALUE;
+  m_mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_file);
+  }
+#else
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+#endif
+}
+
+bool MappedFile::Open(const std::string &path, int64_t size) {
+  if (size <= 0) {
+    return false;
+  }
+  m_size = size;
+
+#ifdef _WIN32
+  m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  FILE_ALLOCATION_INFO allocation = {};
+  allocation.AllocationSize.QuadPart = size;
+  FILE_END_OF_FILE_INFO end = {};
+  end.EndOfFile.QuadPart = size;
+  if (!SetFileInformationByHandle(m_file, FileAllocationInfo, &allocation,
+                                  sizeof(allocation)) ||
+      !SetFileInformationByHandle(m_file, FileEndOfFileInfo, &end,
+                                  sizeof(end))) {
+    return false;
+  }
+
+  m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, 0, 0, NULL);
+  return m_mapping != NULL;
+#elif defined(__linux__)
+  m_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (m_fd < 0) {
+    return false;
+  }
+
+  int rc;
+  do {
+    rc = fallocate(m_fd, 0, 0, size);
+  } while (rc != 0 && errno == EINTR);
+  return rc == 0;
+#else
+  // Without a way to allocate ahead, a full disk would fault on a mapped
+  // page
+  (void)path;
+  return false;
+#endif
+}
+
+MappedFile::View MappedFile::Map(int64_t offset) const {
+  View view;
+  if (offset < 0 || offset >= m_size) {
+    return view;
+  }
+
+  int64_t window = static_cast<int64_t>(m_windowSize);
+  int64_t start = offset - offset % window;
+  size_t size = static_cast<size_t>(std::min(window, m_size - start));
+
+#ifdef _WIN32
+  void *data = MapViewOfFile(m_mapping, FILE_MAP_WRITE,
+                             static_cast<DWORD>(start >> 32),
+                             static_cast<DWORD>(start & 0xFFFFFFFF), size);
+  if (!data) {
+    return view;
+  }
+  view.m_owner = this;
+  std::lock_guard<std::mutex> lock(m_viewsMutex);
+  m_views.emplace_back(static_cast<char *>(data), size);
+#else
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd,
+                    static_cast<off_t>(start));
+  if (data == MAP_FAILED) {
+    return view;
+  }
+#endif
+  view.m_data = static_cast<char *>(data);
+  view.m_offset = start;
+  view.m_size = size;
+  return view;
+}
+
+bool MappedFile::Sync() const {
+#ifdef _WIN32
+  std::lock_guard<std::mutex> lock(m_viewsMutex);
+  for (const auto &view : m_views) {
+    if (!FlushViewOfFile(view.first, view.second)) {
+      return false;
+    }
+  }
+  return FlushFileBuffers(m_file) != 0;
+#else
+  return m_fd >= 0 && fsync(m_fd) == 0;
+#endif
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Output file written through memory mappings, a window at a time, so
+// received data goes into the page cache without a write call per piece.
+// The file is sized and allocated when opened: a mapped page the disk has
+// no room for would crash the process instead of failing a write.
+// Thread-safe; every connection maps its own windows.
+class MappedFile {
+public:
+  // One mapped window of the file, unmapped when destroyed. Must not
+  // outlive the MappedFile it came from.
+  class View {
+  public:
+    View() = default;
+    ~View() { Reset(); }
+
+    View(View &&other) noexcept;
+    View &operator=(View &&other) noexcept;
+
+    // Disable copy
+    View(const View &) = delete;
+    View &operator=(const View &) = delete;
+
+    bool IsValid() const { return m_data != nullptr; }
+    bool Contains(int64_t offset) const {
+      return m_data && offset >= m_offset &&
+             offset < m_offset + static_cast<int64_t>(m_size);
+    }
+    // Address of a file offset inside the view
+    char *At(int64_t offset) const { return m_data + (offset - m_offset); }
+    // Bytes from offset to the end of the view
+    size_t Available(int64_t offset) const {
+      return static_cast<size_t>(m_offset + static_cast<int64_t>(m_size) -
+                                 offset);
+    }
+
+    // Writes the pages of [from, to) back to the file. With wait, returns
+    // once they are on disk and reports I/O errors; otherwise only starts
+    // the write-back.
+    bool Flush(int64_t from, int64_t to, bool wait);
+
+  private:
+    friend class MappedFile;
+
+    void Reset();
+
+    char *m_data = nullptr;
+    int64_t m_offset = 0;
+    size_t m_size = 0;
+#ifdef _WIN32
+    const MappedFile *m_owner = nullptr;
+#endif
+  };
+
+  // windowSize must be a multiple of the mapping granularity (64 KB on
+  // Windows)
+  explicit MappedFile(size_t windowSize);
+  ~MappedFile();
+
+  // Disable copy
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Opens an existing file, sets its length to size and allocates all of
+  // it. Returns false if it cannot be mapped safely, e.g. on a filesystem
+  // that cannot allocate ahead.
+  bool Open(const std::string &path, int64_t size);
+
+  // Maps the window holding offset. The view is invalid on failure.
+  View Map(int64_t offset) const;
+
+  // Writes everything copied into the file so far, in any view, to disk.
+  // Returns false on an I/O error.
+  bool Sync() const;
+
+private:
+  size_t m_windowSize;
+  int64_t m_size = 0;
+#ifdef _WIN32
+  void *m_file;    // HANDLE
+  void *m_mapping; // HANDLE
+  // Views still mapped. Syncing the file does not reach the pages of a
+  // view on Windows, so Sync flushes each of them.
+  mutable std::mutex m_viewsMutex;
+  mutable std::vector<std::pair<char *, size_t>> m_views;
+#else
+  int m_fd = -1;
+#endif
+};
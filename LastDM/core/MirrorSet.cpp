@@ -0,0 +1,99 @@
+#include "MirrorSet.h"
+
+namespace {
+
+// Weight of a new speed sample against the average so far
+constexpr double SPEED_SMOOTHING = 0.25;
+
+} // namespace
+
+MirrorSet::MirrorSet(const std::string &url) { Add(url); }
+
+void MirrorSet::Add(const std::string &url) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Source source;
+  source.url = url;
+  m_sources.push_back(source);
+}
+
+int MirrorSet::Acquire(int index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0) {
+    // Unmeasured sources first, the least busy of them; then the fastest,
+    // the least busy on a tie
+    for (size_t i = 0; i < m_sources.size(); ++i) {
+      const Source &source = m_sources[i];
+      if (source.dropped) {
+        continue;
+      }
+      if (index < 0) {
+        index = static_cast<int>(i);
+        continue;
+      }
+      const Source &best = m_sources[index];
+      bool better;
+      if (source.measured != best.measured) {
+        better = !source.measured;
+      } else if (source.measured && source.speed != best.speed) {
+        better = source.speed > best.speed;
+      } else {
+        better = source.connections < best.connections;
+      }
+      if (better) {
+        index = static_cast<int>(i);
+      }
+    }
+  }
+  if (index < 0 || index >= static_cast<int>(m_sources.size())) {
+    return 0;
+  }
+  m_sources[index].connections++;
+  return index;
+}
+
+void MirrorSet::Release(int index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index >= 0 && index < static_cast<int>(m_sources.size()) &&
+      m_sources[index].connections > 0) {
+    m_sources[index].connections--;
+  }
+}
+
+std::string MirrorSet::GetUrl(int index) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0 || index >= static_cast<int>(m_sources.size())) {
+    return m_sources[0].url;
+  }
+  return m_sources[index].url;
+}
+
+void MirrorSet::ReportSpeed(int index, double speed) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0 || index >= static_cast<int>(m_sources.size())) {
+    return;
+  }
+  Source &source = m_sources[index];
+  source.speed = source.measured
+                     ? source.speed + SPEED_SMOOTHING * (speed - source.speed)
+                     : speed;
+  source.measured = true;
+}
+
+bool MirrorSet::Drop(int index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index < 0 || index >= static_cast<int>(m_sources.size())) {
+    return false;
+  }
+  if (m_sources[index].dropped) {
+    return true;
+  }
+  size_t usable = 0;
+  for (const Source &source : m_sources) {
+    usable += source.dropped ? 0 : 1;
+  }
+  if (usable <= 1) {
+    return false;
+  }
+  m_sources[index].dropped = true;
+  return true;
+}
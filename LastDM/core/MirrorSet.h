@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The sources one download is fetched from: its URL (index 0) and any
+// mirrors of it. Tracks the throughput each source gives a connection, so
+// new connections go where they are likely fastest, and drops sources that
+// fail. Thread-safe.
+class MirrorSet {
+public:
+  explicit MirrorSet(const std::string &url);
+
+  // Disable copy
+  MirrorSet(const MirrorSet &) = delete;
+  MirrorSet &operator=(const MirrorSet &) = delete;
+
+  void Add(const std::string &url);
+
+  // Picks the source for a new connection and counts the connection on it
+  // until Release: one not measured yet if there is any, otherwise the one
+  // with the best speed per connection. index >= 0 asks for that source.
+  int Acquire(int index = -1);
+  void Release(int index);
+
+  std::string GetUrl(int index) const;
+
+  // Speed in bytes per second a connection to the source measured
+  void ReportSpeed(int index, double speed);
+
+  // Stops using a failing source. Returns false, keeping it, if it is the
+  // last one left.
+  bool Drop(int index);
+
+private:
+  struct Source {
+    std::string url;
+    int connections = 0;
+    double speed = 0.0; // Smoothed speed per connection
+    bool measured = false;
+    bool dropped = false;
+  };
+
+  mutable std::mutex m_mutex;
+  std::vector<Source> m_sources;
+};
@@ -0,0 +1,539 @@
+#include "PosixHttpTransport.h"
+#include "ConnectRace.h"
+#include "ConnectionPool.h"
+#include "HttpProtocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int MAX_REDIRECTS = 5;
+constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+constexpr size_t RECEIVE_CHUNK_SIZE = 16 * 1024;
+// Unread body bytes worth receiving and discarding to keep a connection
+// alive; anything larger is cheaper to drop with the socket
+constexpr int64_t MAX_DRAIN_SIZE = 64 * 1024;
+// How long draining waits for the rest to arrive; a server slower than
+// that is hung up on instead of holding up the caller
+constexpr int DRAIN_TIMEOUT_MS = 100;
+#ifdef __linux__
+// Capacity asked for the pipe that carries spliced bytes; the kernel may
+// grant less
+constexpr int SPLICE_PIPE_SIZE = 1024 * 1024;
+#endif
+
+std::string SystemError(const std::string &what) {
+  return what + ": " + std::strerror(errno);
+}
+
+bool ReceiveSome(int fd, char *buffer, size_t size, size_t &received,
+                 std::string &error) {
+  ssize_t result;
+  do {
+    result = recv(fd, buffer, size, 0);
+  } while (result < 0 && errno == EINTR);
+
+  if (result < 0) {
+    error = (errno == EAGAIN || errno == EWOULDBLOCK)
+                ? "Receive timed out"
+                : SystemError("Receive failed");
+    received = 0;
+    return false;
+  }
+
+  received = static_cast<size_t>(result);
+  return true;
+}
+
+class PosixHttpConnection : public HttpConnection {
+public:
+  // A non-null pool gets the socket back once the body has been consumed
+  PosixHttpConnection(int fd, std::string pending,
+                      const HttpBodyDecoder &decoder,
+                      std::shared_ptr<ConnectionPool> pool,
+                      std::string poolKey)
+      : m_fd(fd), m_pending(std::move(pending)), m_decoder(decoder),
+        m_pool(std::move(pool)), m_poolKey(std::move(poolKey)) {}
+
+  ~PosixHttpConnection() override {
+#ifdef __linux__
+    if (m_pipe[0] >= 0) {
+      close(m_pipe[0]);
+      close(m_pipe[1]);
+    }
+#endif
+    if (m_fd < 0) {
+      return;
+    }
+    if (m_pool && Drain()) {
+      m_pool->Release(m_poolKey, m_fd);
+    } else {
+      close(m_fd);
+    }
+  }
+
+  bool Read(char *buffer, size_t size, size_t &bytesRead,
+            std::string &error) override {
+    bytesRead = 0;
+    if (size == 0) {
+      return true;
+    }
+
+    while (!m_decoder.IsComplete()) {
+      const char *body = nullptr;
+      size_t bodySize = 0;
+
+      // Decode bytes already received first
+      if (m_pendingPos < m_pending.size()) {
+        const char *data = m_pending.data() + m_pendingPos;
+        size_t available = m_pending.size() - m_pendingPos;
+        if (!m_decoder.Next(data, available, size, body, bodySize)) {
+          error = "Malformed chunked encoding";
+          return false;
+        }
+        m_pendingPos = m_pending.size() - available;
+        if (bodySize > 0) {
+          std::memcpy(buffer, body, bodySize);
+          bytesRead = bodySize;
+          return true;
+        }
+        continue;
+      }
+
+      size_t received = 0;
+      if (m_decoder.IsIdentity()) {
+        // Unframed bodies are received straight into the caller's buffer
+        int64_t remaining = m_decoder.GetRemaining();
+        size_t want = remaining >= 0
+                          ? static_cast<size_t>(
+                                std::min<int64_t>(size, remaining))
+                          : size;
+        if (!ReceiveSome(m_fd, buffer, want, received, error)) {
+          return false;
+        }
+        if (received > 0) {
+          const char *data = buffer;
+          m_decoder.Next(data, received, size, body, bodySize);
+          bytesRead = bodySize;
+          return true;
+        }
+      } else {
+        m_pending.resize(RECEIVE_CHUNK_SIZE);
+        m_pendingPos = 0;
+        if (!ReceiveSome(m_fd, &m_pending[0], m_pending.size(), received,
+                         error)) {
+          m_pending.clear();
+          return false;
+        }
+        m_pending.resize(received);
+        if (received > 0) {
+          continue;
+        }
+      }
+
+      if (!m_decoder.OnConnectionClosed()) {
+        error = "Connection closed before the end of the body";
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+#ifdef __linux__
+  bool CanReadToFile() const override { return m_decoder.IsIdentity(); }
+
+  bool ReadToFile(int fd, int64_t offset, size_t size, size_t &bytesRead,
+                  std::string &error, bool &writeFailed) override {
+    bytesRead = 0;
+    writeFailed = false;
+    if (size == 0 || m_decoder.IsComplete()) {
+      return true;
+    }
+
+    // Bytes that arrived with the headers are in user space already
+    if (m_pendingPos < m_pending.size()) {
+      char buffer[RECEIVE_CHUNK_SIZE];
+      if (!Read(buffer, std::min(size, sizeof(buffer)), bytesRead, error)) {
+        return false;
+      }
+      if (!WriteAt(fd, offset, buffer, bytesRead)) {
+        writeFailed = true;
+        error = SystemError("Write failed");
+        return false;
+      }
+      return true;
+    }
+
+    if (m_pipe[0] < 0) {
+      if (pipe2(m_pipe, O_CLOEXEC) != 0) {
+        error = SystemError("Failed to create pipe");
+        return false;
+      }
+      fcntl(m_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    }
+
+    int64_t remaining = m_decoder.GetRemaining();
+    size_t want =
+        remaining >= 0
+            ? static_cast<size_t>(std::min<int64_t>(size, remaining))
+            : size;
+    ssize_t received;
+    do {
+      received = splice(m_fd, nullptr, m_pipe[1], nullptr, want,
+                        SPLICE_F_MOVE);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+      error = (errno == EAGAIN || errno == EWOULDBLOCK)
+                  ? "Receive timed out"
+                  : SystemError("Receive failed");
+      return false;
+    }
+    if (received == 0) {
+      if (!m_decoder.OnConnectionClosed()) {
+        error = "Connection closed before the end of the body";
+        return false;
+      }
+      return true;
+    }
+    m_decoder.Skip(static_cast<size_t>(received));
+
+    loff_t position = offset;
+    while (bytesRead < static_cast<size_t>(received)) {
+      ssize_t moved =
+          splice(m_pipe[0], nullptr, fd, &position,
+                 static_cast<size_t>(received) - bytesRead, SPLICE_F_MOVE);
+      if (moved < 0 && errno == EINTR) {
+        continue;
+      }
+      if (moved <= 0) {
+        // Whatever is left in the pipe is lost, and with it the framing
+        writeFailed = true;
+        error = SystemError("Write failed");
+        m_pool.reset();
+        return false;
+      }
+      bytesRead += static_cast<size_t>(moved);
+    }
+    return true;
+  }
+#endif
+
+private:
+  int m_fd;
+  std::string m_pending; // Bytes received past what has been consumed
+  size_t m_pendingPos = 0;
+  HttpBodyDecoder m_decoder;
+  std::shared_ptr<ConnectionPool> m_pool;
+  std::string m_poolKey;
+#ifdef __linux__
+  int m_pipe[2] = {-1, -1}; // Carries spliced bytes to the file
+
+  static bool WriteAt(int fd, int64_t offset, const char *data,
+                      size_t size) {
+    while (size > 0) {
+      ssize_t written = pwrite(fd, data, size, offset);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      size -= static_cast<size_t>(written);
+      offset += written;
+    }
+    return true;
+  }
+#endif
+
+  // Skips the rest of a small body, so the socket is reusable even when the
+  // caller stopped reading early (e.g. a probe). Returns true if the
+  // connection is positioned at the end of the response.
+  bool Drain() {
+    int64_t remaining = m_decoder.GetRemaining();
+    if (!m_decoder.IsComplete() &&
+        (remaining < 0 || remaining > MAX_DRAIN_SIZE)) {
+      return false;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto deadline =
+        Clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+    char buffer[RECEIVE_CHUNK_SIZE];
+    int64_t budget = MAX_DRAIN_SIZE;
+    while (!m_decoder.IsComplete() && budget > 0) {
+      // The socket blocks for the full receive timeout, so it is only read
+      // once data is there
+      if (m_pendingPos == m_pending.size() && !WaitReadable(deadline)) {
+        return false;
+      }
+
+      size_t bytesRead = 0;
+      std::string error;
+      if (!Read(buffer, sizeof(buffer), bytesRead, error)) {
+        return false;
+      }
+      budget -= static_cast<int64_t>(bytesRead);
+    }
+    return m_decoder.IsComplete() && m_pendingPos == m_pending.size();
+  }
+
+  bool WaitReadable(std::chrono::steady_clock::time_point deadline) {
+    int ready;
+    do {
+      auto now = std::chrono::steady_clock::now();
+      long waitMs = std::max<long>(
+          0, static_cast<long>(
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                     deadline - now)
+                     .count()));
+      pollfd pfd = {m_fd, POLLIN, 0};
+      ready = poll(&pfd, 1, static_cast<int>(waitMs));
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0;
+  }
+};
+
+} // namespace
+
+PosixHttpTransport::PosixHttpTransport(const HttpTransportOptions &options)
+    : m_options(options), m_resolver(options.resolver) {
+  if (!m_resolver) {
+    m_resolver = std::make_shared<HostResolver>(HostResolver::Limits());
+  }
+}
+
+int PosixHttpTransport::Connect(const std::string &host,
+                                const std::string &port,
+                                std::string &error) const {
+  std::vector<HostResolver::Address> addresses;
+  if (!m_resolver->Resolve(host, port, addresses, error)) {
+    return -1;
+  }
+
+  // The connect timeout covers the whole race
+  using Clock = std::chrono::steady_clock;
+  ConnectRace race(addresses);
+  auto deadline =
+      Clock::now() + std::chrono::milliseconds(m_options.connectTimeoutMs);
+  auto nextAttempt = Clock::now();
+  while (true) {
+    auto now = Clock::now();
+    if (race.HasNext() && now >= nextAttempt) {
+      race.StartNext();
+      nextAttempt =
+          now + std::chrono::milliseconds(ConnectRace::ATTEMPT_DELAY_MS);
+    }
+
+    std::vector<int> pending = race.GetPending();
+    if (pending.empty()) {
+      errno = race.GetLastError();
+      break;
+    }
+    if (now >= deadline) {
+      errno = ETIMEDOUT;
+      break;
+    }
+
+    Clock::time_point until =
+        race.HasNext() ? std::min(deadline, nextAttempt) : deadline;
+    long waitMs = static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(until - now)
+            .count());
+    std::vector<pollfd> fds;
+    for (int fd : pending) {
+      fds.push_back({fd, POLLOUT, 0});
+    }
+    int ready = poll(fds.data(), fds.size(), static_cast<int>(waitMs) + 1);
+    if (ready < 0 && errno != EINTR) {
+      break;
+    }
+
+    for (const pollfd &pfd : fds) {
+      if (ready <= 0 || pfd.revents == 0) {
+        continue;
+      }
+      HostResolver::Address failed = {};
+      ConnectRace::Result result = race.Finish(pfd.fd, failed);
+      if (result == ConnectRace::Result::Connected) {
+        ConfigureSocket(pfd.fd);
+        return pfd.fd;
+      }
+      if (result == ConnectRace::Result::Failed) {
+        // A refused address makes way for the next one right away
+        m_resolver->ReportFailure(host, port, failed);
+        nextAttempt = now;
+      }
+    }
+  }
+
+  error = SystemError("Failed to connect to " + host);
+  return -1;
+}
+
+void PosixHttpTransport::ConfigureSocket(int fd) const {
+  // Pooled sockets may come back from the event loop in non-blocking mode
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+  timeval timeout = {};
+  timeout.tv_sec = m_options.receiveTimeoutMs / 1000;
+  timeout.tv_usec = (m_options.receiveTimeoutMs % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool PosixHttpTransport::SendAll(int fd, const std::string &data,
+                                 std::string &error) const {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t result =
+        send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error = SystemError("Send failed");
+      return false;
+    }
+    sent += static_cast<size_t>(result);
+  }
+  return true;
+}
+
+bool PosixHttpTransport::ReceiveHeaders(int fd, std::string &headerBlock,
+                                        std::string &pending,
+                                        std::string &error) const {
+  std::string received;
+  char buffer[RECEIVE_CHUNK_SIZE];
+
+  while (true) {
+    size_t end = received.find("\r\n\r\n");
+    if (end != std::string::npos) {
+      headerBlock = received.substr(0, end);
+      pending = received.substr(end + 4);
+      return true;
+    }
+
+    if (received.size() > MAX_HEADER_SIZE) {
+      error = "Response headers too large";
+      return false;
+    }
+
+    ssize_t result = recv(fd, buffer, sizeof(buffer), 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      error = result == 0 ? "Connection closed before response headers"
+              : (errno == EAGAIN || errno == EWOULDBLOCK)
+                  ? "Receive timed out"
+                  : SystemError("Receive failed");
+      return false;
+    }
+    received.append(buffer, static_cast<size_t>(result));
+  }
+}
+
+std::unique_ptr<HttpConnection>
+PosixHttpTransport::Open(const HttpRequest &request, HttpResponse &response,
+                         std::string &error) {
+  std::string url = request.url;
+
+  for (int redirect = 0; redirect <= MAX_REDIRECTS; ++redirect) {
+    response = HttpResponse();
+
+    HttpProtocol::Url parsed;
+    if (!HttpProtocol::ParseUrl(url, parsed)) {
+      error = "Invalid URL: " + url;
+      return nullptr;
+    }
+    if (parsed.scheme != "http") {
+      error = "Unsupported scheme for the socket transport: " + parsed.scheme;
+      return nullptr;
+    }
+
+    bool viaProxy = !m_options.proxyUrl.empty();
+    std::string connectHost = parsed.host;
+    std::string connectPort = parsed.port;
+    if (viaProxy) {
+      HttpProtocol::ParseProxy(m_options.proxyUrl, connectHost, connectPort);
+    }
+
+    const auto &pool = m_options.connectionPool;
+    std::string poolKey = connectHost + ":" + connectPort;
+    std::string message = HttpProtocol::FormatGetRequest(
+        parsed, url, request, m_options.userAgent, viaProxy, pool != nullptr);
+
+    int fd = -1;
+    std::string headerBlock;
+    std::string pending;
+    for (int attempt = 0; fd < 0; ++attempt) {
+      bool reused = false;
+      if (pool && attempt == 0) {
+        fd = pool->Acquire(poolKey);
+        reused = fd >= 0;
+      }
+      if (reused) {
+        ConfigureSocket(fd);
+      } else {
+        fd = Connect(connectHost, connectPort, error);
+        if (fd < 0) {
+          return nullptr;
+        }
+      }
+
+      if (SendAll(fd, message, error) &&
+          ReceiveHeaders(fd, headerBlock, pending, error)) {
+        break;
+      }
+      close(fd);
+      fd = -1;
+
+      // The server may have closed a pooled socket just as we reused it;
+      // only a fresh connection's failure is final
+      if (!reused) {
+        return nullptr;
+      }
+    }
+
+    std::map<std::string, std::string> headers;
+    if (!HttpProtocol::ParseResponseHead(headerBlock, response, headers)) {
+      close(fd);
+      error = "Malformed HTTP response";
+      return nullptr;
+    }
+
+    HttpBodyDecoder decoder;
+    decoder.Reset(response, headers);
+    std::shared_ptr<ConnectionPool> releaseTo =
+        pool && HttpProtocol::IsKeepAlive(headerBlock, headers) ? pool
+                                                                 : nullptr;
+    auto connection = std::make_unique<PosixHttpConnection>(
+        fd, std::move(pending), decoder, releaseTo, poolKey);
+
+    auto location = headers.find("location");
+    if (HttpProtocol::IsRedirect(response.statusCode) &&
+        location != headers.end()) {
+      // Dropping the connection returns it to the pool if the (usually
+      // empty) redirect body has already arrived
+      connection.reset();
+      url = HttpProtocol::ResolveRedirect(parsed, location->second);
+      continue;
+    }
+
+    return connection;
+  }
+
+  error = "Too many redirects";
+  return nullptr;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "HostResolver.h"
+#include "HttpTransport.h"
+#include <memory>
+
+// HTTP/1.1 client on plain POSIX sockets. Supports http:// URLs, chunked
+// transfer encoding, redirects, an HTTP proxy and keep-alive through the
+// optional connection pool; https:// needs a TLS capable transport and is
+// rejected. Hosts are resolved through a cache and connected to by racing
+// their addresses.
+class PosixHttpTransport : public HttpTransport {
+public:
+  explicit PosixHttpTransport(const HttpTransportOptions &options);
+
+  std::unique_ptr<HttpConnection> Open(const HttpRequest &request,
+                                       HttpResponse &response,
+                                       std::string &error) override;
+
+private:
+  HttpTransportOptions m_options;
+  std::shared_ptr<HostResolver> m_resolver;
+
+  int Connect(const std::string &host, const std::string &port,
+              std::string &error) const;
+  void ConfigureSocket(int fd) const;
+  bool SendAll(int fd, const std::string &data, std::string &error) const;
+  bool ReceiveHeaders(int fd, std::string &headerBlock, std::string &pending,
+                      std::string &error) const;
+};
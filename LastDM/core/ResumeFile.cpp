@@ -0,0 +1,221 @@
+#include "ResumeFile.h"
+#include <cstdio>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Layout, little-endian: magic, version, total size, URL, ETag,
+// Last-Modified (each a 32-bit length and the bytes), chunk count and
+// start/end/current of every chunk, then a checksum of all of it
+constexpr uint32_t MAGIC = 0x524D444C; // "LDMR"
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t MAX_STRING = 64 * 1024;
+constexpr uint32_t MAX_CHUNKS = 1 << 20;
+
+void PutInt(std::string &out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+void PutString(std::string &out, const std::string &value) {
+  PutInt(out, value.size(), 4);
+  out += value;
+}
+
+class Reader {
+public:
+  explicit Reader(const std::string &data) : m_data(data) {}
+
+  bool GetInt(uint64_t &value, int bytes) {
+    if (m_data.size() - m_position < static_cast<size_t>(bytes)) {
+      return false;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value |= static_cast<uint64_t>(
+                   static_cast<unsigned char>(m_data[m_position++]))
+               << (8 * i);
+    }
+    return true;
+  }
+
+  bool GetInt64(int64_t &value) {
+    uint64_t raw = 0;
+    if (!GetInt(raw, 8)) {
+      return false;
+    }
+    value = static_cast<int64_t>(raw);
+    return true;
+  }
+
+  bool GetString(std::string &value) {
+    uint64_t size = 0;
+    if (!GetInt(size, 4) || size > MAX_STRING ||
+        m_data.size() - m_position < size) {
+      return false;
+    }
+    value = m_data.substr(m_position, static_cast<size_t>(size));
+    m_position += static_cast<size_t>(size);
+    return true;
+  }
+
+  size_t GetPosition() const { return m_position; }
+
+private:
+  const std::string &m_data;
+  size_t m_position = 0;
+};
+
+// FNV-1a; enough to tell a torn or truncated write from a whole one
+uint32_t Checksum(const char *data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool WriteDurably(const std::string &path, const std::string &data) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL,
+                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  DWORD written = 0;
+  bool ok = WriteFile(file, data.data(), static_cast<DWORD>(data.size()),
+                      &written, NULL) &&
+            written == data.size() && FlushFileBuffers(file);
+  return CloseHandle(file) && ok;
+#else
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t result = write(fd, data.data() + done, data.size() - done);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    done += static_cast<size_t>(result);
+  }
+  bool ok = done == data.size() && fsync(fd) == 0;
+  return close(fd) == 0 && ok;
+#endif
+}
+
+} // namespace
+
+namespace ResumeFile {
+
+std::string PathFor(const std::string &filePath) {
+  return filePath + ".ldmresume";
+}
+
+bool Save(const std::string &filePath, const ResumeState &state) {
+  std::string data;
+  PutInt(data, MAGIC, 4);
+  PutInt(data, VERSION, 4);
+  PutInt(data, static_cast<uint64_t>(state.totalSize), 8);
+  PutString(data, state.url);
+  PutString(data, state.etag);
+  PutString(data, state.lastModified);
+  PutInt(data, state.chunks.size(), 4);
+  for (const DownloadChunk &chunk : state.chunks) {
+    PutInt(data, static_cast<uint64_t>(chunk.startByte), 8);
+    PutInt(data, static_cast<uint64_t>(chunk.endByte), 8);
+    PutInt(data, static_cast<uint64_t>(chunk.currentByte), 8);
+  }
+  PutInt(data, Checksum(data.data(), data.size()), 4);
+
+  std::string path = PathFor(filePath);
+  std::string temporary = path + ".tmp";
+  if (!WriteDurably(temporary, data)) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  return MoveFileExA(temporary.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool Load(const std::string &filePath, ResumeState &state) {
+  std::FILE *file = std::fopen(PathFor(filePath).c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  std::string data;
+  char buffer[4096];
+  size_t read;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.append(buffer, read);
+  }
+  std::fclose(file);
+
+  if (data.size() < 4) {
+    return false;
+  }
+  size_t bodySize = data.size() - 4;
+  std::string trailer = data.substr(bodySize);
+  Reader checksum(trailer);
+  uint64_t expected = 0;
+  if (!checksum.GetInt(expected, 4) ||
+      expected != Checksum(data.data(), bodySize)) {
+    return false;
+  }
+
+  Reader reader(data);
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t count = 0;
+  ResumeState loaded;
+  if (!reader.GetInt(magic, 4) || magic != MAGIC ||
+      !reader.GetInt(version, 4) || version != VERSION ||
+      !reader.GetInt64(loaded.totalSize) || !reader.GetString(loaded.url) ||
+      !reader.GetString(loaded.etag) ||
+      !reader.GetString(loaded.lastModified) || !reader.GetInt(count, 4) ||
+      count > MAX_CHUNKS) {
+    return false;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    int64_t start = 0;
+    int64_t end = 0;
+    int64_t current = 0;
+    if (!reader.GetInt64(start) || !reader.GetInt64(end) ||
+        !reader.GetInt64(current)) {
+      return false;
+    }
+    loaded.chunks.emplace_back(start, end);
+    loaded.chunks.back().currentByte = current;
+  }
+  if (reader.GetPosition() != bodySize) {
+    return false;
+  }
+
+  state = std::move(loaded);
+  return true;
+}
+
+void Remove(const std::string &filePath) {
+  std::remove(PathFor(filePath).c_str());
+}
+
+} // namespace ResumeFile
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Download.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sidecar kept next to a download in progress, holding its chunk map and
+// what identifies the remote file, so a transfer cut off by a crash or
+// power loss resumes every segment from its own offset. Callers save it
+// only once the data it describes is on disk.
+struct ResumeState {
+  std::string url;
+  int64_t totalSize = -1;
+  std::string etag;
+  std::string lastModified;
+  std::vector<DownloadChunk> chunks;
+};
+
+namespace ResumeFile {
+
+// Where the sidecar of the file at filePath lives
+std::string PathFor(const std::string &filePath);
+
+// Replaces the sidecar in one step: written to a temporary file, flushed
+// and renamed over the old one, so a crash leaves one or the other
+bool Save(const std::string &filePath, const ResumeState &state);
+
+// False if there is none or it is damaged
+bool Load(const std::string &filePath, ResumeState &state);
+
+void Remove(const std::string &filePath);
+
+} // namespace ResumeFile
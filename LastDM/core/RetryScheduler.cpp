@@ -0,0 +1,116 @@
+#include "RetryScheduler.h"
+#include <algorithm>
+
+RetryScheduler::RetryScheduler(Handler handler, int tickMs, size_t slots)
+    : m_handler(std::move(handler)),
+      m_tick(std::chrono::milliseconds(std::max(1, tickMs))),
+      m_slots(std::max<size_t>(1, slots)), m_lastTick(Clock::now()) {
+  m_thread = std::thread([this]() { Run(); });
+}
+
+RetryScheduler::~RetryScheduler() { Stop(); }
+
+void RetryScheduler::Schedule(const std::shared_ptr<Download> &download) {
+  if (!download) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopped) {
+      return;
+    }
+
+    // An idle wheel does not turn; it starts again from now
+    Clock::time_point now = Clock::now();
+    if (m_pending == 0) {
+      m_lastTick = now;
+    }
+
+    // Due times are rounded up to the next tick, and at least one away
+    Clock::duration wait = download->GetNextRetryTime() - m_lastTick;
+    size_t ticks = 1;
+    if (wait > m_tick) {
+      ticks = static_cast<size_t>((wait + m_tick - Clock::duration(1)) /
+                                  m_tick);
+    }
+
+    size_t slot = (m_cursor + ticks) % m_slots.size();
+    m_slots[slot].push_back({download, (ticks - 1) / m_slots.size()});
+    ++m_pending;
+  }
+  m_wakeup.notify_one();
+}
+
+void RetryScheduler::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopped) {
+      return;
+    }
+    m_stopped = true;
+    for (auto &slot : m_slots) {
+      slot.clear();
+    }
+    m_pending = 0;
+  }
+  m_wakeup.notify_one();
+
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+size_t RetryScheduler::GetPendingCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_pending;
+}
+
+void RetryScheduler::Run() {
+  std::vector<std::shared_ptr<Download>> due;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_stopped) {
+    if (m_pending == 0) {
+      m_wakeup.wait(lock, [this]() { return m_stopped || m_pending > 0; });
+      continue;
+    }
+
+    m_wakeup.wait_until(lock, m_lastTick + m_tick);
+    // Catches up on every tick passed, e.g. after the system slept
+    while (!m_stopped && m_pending > 0 &&
+           Clock::now() >= m_lastTick + m_tick) {
+      Advance(due);
+    }
+    if (due.empty()) {
+      continue;
+    }
+
+    lock.unlock();
+    for (const auto &download : due) {
+      m_handler(download);
+    }
+    due.clear();
+    lock.lock();
+  }
+}
+
+void RetryScheduler::Advance(std::vector<std::shared_ptr<Download>> &due) {
+  m_lastTick += m_tick;
+  m_cursor = (m_cursor + 1) % m_slots.size();
+
+  auto &slot = m_slots[m_cursor];
+  auto waiting = slot.begin();
+  for (auto &entry : slot) {
+    if (entry.rounds == 0) {
+      due.push_back(std::move(entry.download));
+      --m_pending;
+    } else {
+      --entry.rounds;
+      if (&*waiting != &entry) {
+        *waiting = std::move(entry);
+      }
+      ++waiting;
+    }
+  }
+  slot.erase(waiting, slot.end());
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Download.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Holds downloads backing off after a failure and hands each back once its
+// Download::GetNextRetryTime has come. A hashed timer wheel served by one
+// thread, so any number of waiting downloads costs no thread of their own.
+// Thread-safe.
+class RetryScheduler {
+public:
+  using Handler = std::function<void(const std::shared_ptr<Download> &)>;
+
+  // The wheel turns every tickMs and covers slots * tickMs before due
+  // times wrap around (later ones take extra turns). handler runs on the
+  // scheduler's thread.
+  RetryScheduler(Handler handler, int tickMs, size_t slots);
+  ~RetryScheduler();
+
+  // Disable copy
+  RetryScheduler(const RetryScheduler &) = delete;
+  RetryScheduler &operator=(const RetryScheduler &) = delete;
+
+  // Schedules download for its next retry time. Ignored once stopped.
+  void Schedule(const std::shared_ptr<Download> &download);
+  // Drops everything waiting and joins the thread; the handler is not
+  // called afterwards
+  void Stop();
+
+  size_t GetPendingCount() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    std::shared_ptr<Download> download;
+    size_t rounds; // Full turns left before it is due
+  };
+
+  Handler m_handler;
+  Clock::duration m_tick;
+  std::vector<std::vector<Entry>> m_slots;
+  size_t m_cursor = 0;
+  // When the slot under the cursor was reached
+  Clock::time_point m_lastTick;
+  size_t m_pending = 0;
+  bool m_stopped = false;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  std::thread m_thread;
+
+  void Run();
+  // Moves the cursor one slot on and collects the entries due there
+  void Advance(std::vector<std::shared_ptr<Download>> &due);
+};
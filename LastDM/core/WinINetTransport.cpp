@@ -0,0 +1,147 @@
+#include "WinINetTransport.h"
+#include <cstdlib>
+
+#pragma comment(lib, "wininet.lib")
+
+namespace {
+
+class WinINetConnection : public HttpConnection {
+public:
+  WinINetConnection(std::shared_ptr<const WinINetTransport> transport,
+                    HINTERNET hUrl)
+      : m_transport(std::move(transport)), m_hUrl(hUrl) {}
+
+  ~WinINetConnection() override {
+    if (m_hUrl) {
+      InternetCloseHandle(m_hUrl);
+    }
+  }
+
+  bool Read(char *buffer, size_t size, size_t &bytesRead,
+            std::string &error) override {
+    DWORD read = 0;
+    if (!InternetReadFile(m_hUrl, buffer, static_cast<DWORD>(size), &read)) {
+      error = "Read Error: " + std::to_string(GetLastError());
+      bytesRead = 0;
+      return false;
+    }
+    bytesRead = read;
+    return true;
+  }
+
+private:
+  std::shared_ptr<const WinINetTransport> m_transport; // Keeps the session
+  HINTERNET m_hUrl;
+};
+
+} // namespace
+
+WinINetTransport::WinINetTransport(const HttpTransportOptions &options)
+    : m_session(nullptr) {
+  // WinINet already keeps idle connections alive and reuses them, but queues
+  // requests beyond a few connections per server. The limit is process-wide,
+  // so set it before opening anything.
+  if (options.maxConnectionsPerHost > 0) {
+    DWORD maxConnections = static_cast<DWORD>(options.maxConnectionsPerHost);
+    InternetSetOption(NULL, INTERNET_OPTION_MAX_CONNS_PER_SERVER,
+                      &maxConnections, sizeof(DWORD));
+    InternetSetOption(NULL, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER,
+                      &maxConnections, sizeof(DWORD));
+  }
+
+  const std::string &proxyUrl = options.proxyUrl;
+  m_session = InternetOpenA(
+      options.userAgent.c_str(),
+      proxyUrl.empty() ? INTERNET_OPEN_TYPE_PRECONFIG : INTERNET_OPEN_TYPE_PROXY,
+      proxyUrl.empty() ? NULL : proxyUrl.c_str(), NULL, 0);
+
+  if (m_session) {
+    DWORD timeout = static_cast<DWORD>(options.connectTimeoutMs);
+    InternetSetOption(m_session, INTERNET_OPTION_CONNECT_TIMEOUT, &timeout,
+                      sizeof(DWORD));
+    timeout = static_cast<DWORD>(options.receiveTimeoutMs);
+    InternetSetOption(m_session, INTERNET_OPTION_RECEIVE_TIMEOUT, &timeout,
+                      sizeof(DWORD));
+  }
+}
+
+WinINetTransport::~WinINetTransport() {
+  if (m_session) {
+    InternetCloseHandle(m_session);
+    m_session = nullptr;
+  }
+}
+
+std::string WinINetTransport::QueryHeader(HINTERNET hUrl, DWORD infoLevel) {
+  char buffer[256] = {0};
+  DWORD bufferSize = sizeof(buffer);
+  if (!HttpQueryInfoA(hUrl, infoLevel, buffer, &bufferSize, NULL)) {
+    return "";
+  }
+  return std::string(buffer, bufferSize);
+}
+
+std::unique_ptr<HttpConnection>
+WinINetTransport::Open(const HttpRequest &request, HttpResponse &response,
+                       std::string &error) {
+  response = HttpResponse();
+  if (!m_session) {
+    error = "WinINet session is not open";
+    return nullptr;
+  }
+
+  DWORD flags = INTERNET_FLAG_NO_UI | INTERNET_FLAG_RELOAD |
+                INTERNET_FLAG_KEEP_CONNECTION;
+  if (!request.verifySSL)
+    flags |= (INTERNET_FLAG_IGNORE_CERT_CN_INVALID |
+              INTERNET_FLAG_IGNORE_CERT_DATE_INVALID);
+
+  std::string headers;
+  if (request.rangeStart >= 0) {
+    headers = "Range: " +
+              FormatRangeHeader(request.rangeStart, request.rangeEnd) + "\r\n";
+    if (!request.ifRange.empty()) {
+      headers += "If-Range: " + request.ifRange + "\r\n";
+    }
+  }
+
+  HINTERNET hUrl = InternetOpenUrlA(
+      m_session, request.url.c_str(), headers.empty() ? NULL : headers.c_str(),
+      headers.empty() ? -1 : static_cast<DWORD>(headers.length()), flags, 0);
+  if (!hUrl) {
+    error = "Error: " + std::to_string(GetLastError());
+    return nullptr;
+  }
+
+  DWORD statusCode = 0;
+  DWORD statusSize = sizeof(statusCode);
+  if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER,
+                     &statusCode, &statusSize, NULL)) {
+    response.statusCode = static_cast<int>(statusCode);
+  }
+
+  std::string contentLength = QueryHeader(hUrl, HTTP_QUERY_CONTENT_LENGTH);
+  if (!contentLength.empty()) {
+    response.contentLength = std::strtoll(contentLength.c_str(), nullptr, 10);
+  }
+
+  std::string ranges = QueryHeader(hUrl, HTTP_QUERY_ACCEPT_RANGES);
+  response.acceptRanges = ranges.find("bytes") != std::string::npos;
+
+  response.etag = QueryHeader(hUrl, HTTP_QUERY_ETAG);
+  response.lastModified = QueryHeader(hUrl, HTTP_QUERY_LAST_MODIFIED);
+
+  std::string retryAfter = QueryHeader(hUrl, HTTP_QUERY_RETRY_AFTER);
+  if (!retryAfter.empty()) {
+    response.retryAfterSeconds = ParseRetryAfter(retryAfter);
+  }
+
+  std::string contentRange = QueryHeader(hUrl, HTTP_QUERY_CONTENT_RANGE);
+  if (!contentRange.empty()) {
+    response.hasContentRange =
+        ParseContentRange(contentRange, response.rangeStart,
+                          response.rangeEnd, response.instanceLength);
+  }
+
+  return std::make_unique<WinINetConnection>(shared_from_this(), hUrl);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "HttpTransport.h"
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <wininet.h>
+
+// HttpTransport backed by a WinINet session. Connections keep the transport
+// alive, so a replaced transport is closed once its last request finishes.
+class WinINetTransport
+    : public HttpTransport,
+      public std::enable_shared_from_this<WinINetTransport> {
+public:
+  explicit WinINetTransport(const HttpTransportOptions &options);
+  ~WinINetTransport() override;
+
+  // Disable copy
+  WinINetTransport(const WinINetTransport &) = delete;
+  WinINetTransport &operator=(const WinINetTransport &) = delete;
+
+  bool IsOpen() const { return m_session != nullptr; }
+
+  std::unique_ptr<HttpConnection> Open(const HttpRequest &request,
+                                       HttpResponse &response,
+                                       std::string &error) override;
+
+private:
+  HINTERNET m_session;
+
+  static std::string QueryHeader(HINTERNET hUrl, DWORD infoLevel);
+};
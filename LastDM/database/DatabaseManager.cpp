@@ -50,6 +50,7 @@ bool DatabaseManager::LoadDatabase() {
   m_data.downloads.clear();
   m_data.categories.clear();
   m_data.settings.clear();
+  m_data.speedLimits.clear();
 
   wxXmlNode *root = doc.GetRoot();
   if (!root || root->GetName() != "LastDM")
@@ -75,10 +76,14 @@ bool DatabaseManager::LoadDatabase() {
           download->SetDownloadedSize(
               std::stoll(downloadNode->GetAttribute("downloaded_size", "0")
                              .ToStdString()));
+          download->SetResumable(
+              downloadNode->GetAttribute("resumable", "0") == "1");
           download->SetCategory(
               downloadNode->GetAttribute("category", "").ToStdString());
           download->SetDescription(
               downloadNode->GetAttribute("description", "").ToStdString());
+          download->SetSpeedLimit(std::stoll(
+              downloadNode->GetAttribute("speed_limit", "0").ToStdString()));
 
           std::string statusStr =
               downloadNode->GetAttribute("status", "Queued").ToStdString();
@@ -96,6 +101,17 @@ bool DatabaseManager::LoadDatabase() {
           download->SetErrorMessage(
               downloadNode->GetAttribute("error_message", "").ToStdString());
 
+          std::vector<std::string> mirrors;
+          wxXmlNode *mirrorNode = downloadNode->GetChildren();
+          while (mirrorNode) {
+            if (mirrorNode->GetName() == "Mirror") {
+              mirrors.push_back(
+                  mirrorNode->GetAttribute("url", "").ToStdString());
+            }
+            mirrorNode = mirrorNode->GetNext();
+          }
+          download->SetMirrors(mirrors);
+
           m_data.downloads.push_back(download);
         }
         downloadNode = downloadNode->GetNext();
@@ -119,6 +135,18 @@ bool DatabaseManager::LoadDatabase() {
         }
         setNode = setNode->GetNext();
       }
+    } else if (child->GetName() == "SpeedLimits") {
+      wxXmlNode *limitNode = child->GetChildren();
+      while (limitNode) {
+        if (limitNode->GetName() == "SpeedLimit") {
+          std::string scope =
+              limitNode->GetAttribute("scope", "").ToStdString();
+          std::string name = limitNode->GetAttribute("name", "").ToStdString();
+          m_data.speedLimits[scope][name] = std::stoll(
+              limitNode->GetAttribute("bytes_per_second", "0").ToStdString());
+        }
+        limitNode = limitNode->GetNext();
+      }
     }
     child = child->GetNext();
   }
@@ -143,10 +171,17 @@ bool DatabaseManager::SaveDatabase() {
     node->AddAttribute("total_size", std::to_string(download->GetTotalSize()));
     node->AddAttribute("downloaded_size",
                        std::to_string(download->GetDownloadedSize()));
+    node->AddAttribute("resumable", download->IsResumable() ? "1" : "0");
     node->AddAttribute("status", download->GetStatusString());
     node->AddAttribute("category", download->GetCategory());
     node->AddAttribute("description", download->GetDescription());
     node->AddAttribute("error_message", download->GetErrorMessage());
+    node->AddAttribute("speed_limit",
+                       std::to_string(download->GetSpeedLimit()));
+    for (const auto &mirror : download->GetMirrors()) {
+      wxXmlNode *mirrorNode = new wxXmlNode(node, wxXML_ELEMENT_NODE, "Mirror");
+      mirrorNode->AddAttribute("url", mirror);
+    }
   }
 
   // Categories
@@ -167,11 +202,42 @@ bool DatabaseManager::SaveDatabase() {
     node->AddAttribute("value", set.second);
   }
 
+  // Speed limits
+  wxXmlNode *limitsNode =
+      new wxXmlNode(root, wxXML_ELEMENT_NODE, "SpeedLimits");
+  for (const auto &scope : m_data.speedLimits) {
+    for (const auto &limit : scope.second) {
+      wxXmlNode *node =
+          new wxXmlNode(limitsNode, wxXML_ELEMENT_NODE, "SpeedLimit");
+      node->AddAttribute("scope", scope.first);
+      node->AddAttribute("name", limit.first);
+      node->AddAttribute("bytes_per_second", std::to_string(limit.second));
+    }
+  }
+
   return doc.Save(m_dbPath);
 }
 
 bool DatabaseManager::SaveDownload(const Download &download) {
   std::lock_guard<std::mutex> lock(m_mutex);
+  StoreDownload(download);
+  return SaveDatabase();
+}
+
+bool DatabaseManager::UpdateDownload(const Download &download) {
+  return SaveDownload(download);
+}
+
+bool DatabaseManager::UpdateDownloads(
+    const std::vector<std::shared_ptr<Download>> &downloads) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (const auto &download : downloads) {
+    StoreDownload(*download);
+  }
+  return SaveDatabase();
+}
+
+void DatabaseManager::StoreDownload(const Download &download) {
   auto it = std::find_if(m_data.downloads.begin(), m_data.downloads.end(),
                          [&](const std::shared_ptr<Download> &d) {
                            return d->GetId() == download.GetId();
@@ -183,8 +249,11 @@ bool DatabaseManager::SaveDownload(const Download &download) {
     // we might not need to strictly copy if the UI is holding the same pointer.
     // But to be safe and match behavior:
     (*it)->SetStatus(download.GetStatus());
+    (*it)->SetTotalSize(download.GetTotalSize());
+    (*it)->SetResumable(download.IsResumable());
     (*it)->SetDownloadedSize(download.GetDownloadedSize());
     (*it)->SetErrorMessage(download.GetErrorMessage());
+    (*it)->SetSpeedLimit(download.GetSpeedLimit());
     // Copy other fields if needed, but usually only status/progress changes
     // frequently.
   } else {
@@ -196,15 +265,13 @@ bool DatabaseManager::SaveDownload(const Download &download) {
     newDownload->SetCategory(download.GetCategory());
     newDownload->SetDescription(download.GetDescription());
     newDownload->SetTotalSize(download.GetTotalSize());
+    newDownload->SetResumable(download.IsResumable());
     newDownload->SetDownloadedSize(download.GetDownloadedSize());
     newDownload->SetStatus(download.GetStatus());
+    newDownload->SetSpeedLimit(download.GetSpeedLimit());
+    newDownload->SetMirrors(download.GetMirrors());
     m_data.downloads.push_back(newDownload);
   }
-  return SaveDatabase();
-}
-
-bool DatabaseManager::UpdateDownload(const Download &download) {
-  return SaveDownload(download);
 }
 
 bool DatabaseManager::DeleteDownload(int downloadId) {
@@ -237,9 +304,12 @@ std::unique_ptr<Download> DatabaseManager::LoadDownload(int downloadId) {
     copy->SetCategory(d->GetCategory());
     copy->SetDescription(d->GetDescription());
     copy->SetTotalSize(d->GetTotalSize());
+    copy->SetResumable(d->IsResumable());
     copy->SetDownloadedSize(d->GetDownloadedSize());
     copy->SetStatus(d->GetStatus());
     copy->SetErrorMessage(d->GetErrorMessage());
+    copy->SetSpeedLimit(d->GetSpeedLimit());
+    copy->SetMirrors(d->GetMirrors());
     return copy;
   }
   return nullptr;
@@ -255,9 +325,12 @@ std::vector<std::unique_ptr<Download>> DatabaseManager::LoadAllDownloads() {
     copy->SetCategory(d->GetCategory());
     copy->SetDescription(d->GetDescription());
     copy->SetTotalSize(d->GetTotalSize());
+    copy->SetResumable(d->IsResumable());
     copy->SetDownloadedSize(d->GetDownloadedSize());
     copy->SetStatus(d->GetStatus());
     copy->SetErrorMessage(d->GetErrorMessage());
+    copy->SetSpeedLimit(d->GetSpeedLimit());
+    copy->SetMirrors(d->GetMirrors());
     result.push_back(std::move(copy));
   }
   return result;
@@ -319,6 +392,34 @@ bool DatabaseManager::SetSetting(const std::string &key,
   return SaveDatabase();
 }
 
+std::map<std::string, int64_t>
+DatabaseManager::GetSpeedLimits(const std::string &scope) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_data.speedLimits.find(scope);
+  if (it != m_data.speedLimits.end()) {
+    return it->second;
+  }
+  return {};
+}
+
+bool DatabaseManager::SetSpeedLimit(const std::string &scope,
+                                    const std::string &name,
+                                    int64_t bytesPerSecond) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (bytesPerSecond > 0) {
+    m_data.speedLimits[scope][name] = bytesPerSecond;
+  } else {
+    auto it = m_data.speedLimits.find(scope);
+    if (it != m_data.speedLimits.end()) {
+      it->second.erase(name);
+      if (it->second.empty()) {
+        m_data.speedLimits.erase(it);
+      }
+    }
+  }
+  return SaveDatabase();
+}
+
 bool DatabaseManager::ClearHistory() {
   std::lock_guard<std::mutex> lock(m_mutex);
   m_data.downloads.clear();
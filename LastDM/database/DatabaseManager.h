@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../core/Download.h"
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -23,6 +24,8 @@ public:
   // Download CRUD operations
   bool SaveDownload(const Download &download);
   bool UpdateDownload(const Download &download);
+  // Updates them all, then writes the database once
+  bool UpdateDownloads(const std::vector<std::shared_ptr<Download>> &downloads);
   bool DeleteDownload(int downloadId);
   std::unique_ptr<Download> LoadDownload(int downloadId);
   std::vector<std::unique_ptr<Download>> LoadAllDownloads();
@@ -32,6 +35,12 @@ public:
   bool AddCategory(const std::string &name);
   bool DeleteCategory(const std::string &name);
 
+  // Speed limit operations (bytes per second, keyed by host or category
+  // name within a scope such as "host" or "category")
+  std::map<std::string, int64_t> GetSpeedLimits(const std::string &scope);
+  bool SetSpeedLimit(const std::string &scope, const std::string &name,
+                     int64_t bytesPerSecond);
+
   // Settings operations
   std::string GetSetting(const std::string &key,
                          const std::string &defaultValue = "");
@@ -58,10 +67,13 @@ private:
     std::vector<std::shared_ptr<Download>> downloads;
     std::vector<std::string> categories;
     std::vector<std::pair<std::string, std::string>> settings;
+    std::map<std::string, std::map<std::string, int64_t>> speedLimits;
   } m_data;
 
   bool LoadDatabase();
   bool SaveDatabase();
+  // Adds or updates the in-memory copy; the caller holds m_mutex
+  void StoreDownload(const Download &download);
 
   // Helpers
   void CreateDefaultCategories();
@@ -1,8 +1,11 @@
 #include "DownloadsTable.h"
 #include "../core/DownloadManager.h"
 #include "../utils/ThemeManager.h"
+#include <Windows.h>
+#include <chrono>
 #include <shellapi.h>
 #include <wx/artprov.h>
+#include <wx/numdlg.h>
 
 
 wxBEGIN_EVENT_TABLE(DownloadsTable, wxPanel) EVT_LIST_ITEM_SELECTED(
@@ -21,6 +24,9 @@ wxBEGIN_EVENT_TABLE(DownloadsTable, wxPanel) EVT_LIST_ITEM_SELECTED(
                                     EVT_MENU(
                                         ID_CTX_DELETE_WITH_FILE,
                                         DownloadsTable::OnContextDeleteWithFile)
+                                        EVT_MENU(
+                                            ID_CTX_SPEED_LIMIT,
+                                            DownloadsTable::OnContextSpeedLimit)
                                         wxEND_EVENT_TABLE()
 
                                             DownloadsTable::DownloadsTable(
@@ -143,8 +149,20 @@ void DownloadsTable::UpdateRow(long row, std::shared_ptr<Download> download) {
   }
   m_listCtrl->SetItem(row, 2, progressStr);
 
-  m_listCtrl->SetItem(row, 3, download->GetStatusString());
-  m_listCtrl->SetItem(row, 4, FormatTime(download->GetTimeRemaining()));
+  // A failed download waiting out its backoff counts down to the retry
+  wxString statusStr = download->GetStatusString();
+  int timeLeft = download->GetTimeRemaining();
+  if (download->GetStatus() == DownloadStatus::Error) {
+    auto wait =
+        download->GetNextRetryTime() - std::chrono::steady_clock::now();
+    if (wait.count() > 0) {
+      statusStr = "Retrying";
+      timeLeft = static_cast<int>(
+          std::chrono::duration_cast<std::chrono::seconds>(wait).count() + 1);
+    }
+  }
+  m_listCtrl->SetItem(row, 3, statusStr);
+  m_listCtrl->SetItem(row, 4, FormatTime(timeLeft));
   m_listCtrl->SetItem(row, 5, FormatSpeed(download->GetSpeed()));
   m_listCtrl->SetItem(row, 6, download->GetLastTryTime());
 
@@ -277,6 +295,7 @@ void DownloadsTable::OnItemRightClick(wxListEvent &event) {
   contextMenu.AppendSeparator();
   contextMenu.Append(ID_CTX_RESUME, "Resume");
   contextMenu.Append(ID_CTX_PAUSE, "Pause");
+  contextMenu.Append(ID_CTX_SPEED_LIMIT, "Speed Limit...");
   contextMenu.AppendSeparator();
   contextMenu.Append(ID_CTX_DELETE, "Delete");
   contextMenu.Append(ID_CTX_DELETE_WITH_FILE, "Delete with File");
@@ -326,6 +345,24 @@ void DownloadsTable::OnContextPause(wxCommandEvent &event) {
   }
 }
 
+void DownloadsTable::OnContextSpeedLimit(wxCommandEvent &event) {
+  if (m_contextMenuIndex >= 0 &&
+      m_contextMenuIndex < static_cast<long>(m_filteredDownloads.size())) {
+    auto download = m_filteredDownloads[m_contextMenuIndex];
+
+    // KB/s like the global limit in Options; still capped by it
+    long current = static_cast<long>(download->GetSpeedLimit() / 1024);
+    long limitKb = wxGetNumberFromUser(
+        wxString::Format("Maximum speed for '%s' in KB/s (0 = unlimited).",
+                         download->GetFilename()),
+        "KB/s:", "Speed Limit", current, 0, 1000000, this);
+    if (limitKb >= 0) {
+      DownloadManager::GetInstance().SetDownloadSpeedLimit(
+          download->GetId(), static_cast<int64_t>(limitKb) * 1024);
+    }
+  }
+}
+
 void DownloadsTable::OnContextDelete(wxCommandEvent &event) {
   if (m_contextMenuIndex >= 0 &&
       m_contextMenuIndex < static_cast<long>(m_filteredDownloads.size())) {
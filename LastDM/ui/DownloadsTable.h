@@ -15,7 +15,8 @@ enum {
   ID_CTX_STOP,
   ID_CTX_DELETE,
   ID_CTX_DELETE_WITH_FILE,
-  ID_CTX_PROPERTIES
+  ID_CTX_PROPERTIES,
+  ID_CTX_SPEED_LIMIT
 };
 
 class DownloadsTable : public wxPanel {
@@ -66,6 +67,7 @@ private:
   void OnContextOpenFolder(wxCommandEvent &event);
   void OnContextResume(wxCommandEvent &event);
   void OnContextPause(wxCommandEvent &event);
+  void OnContextSpeedLimit(wxCommandEvent &event);
   void OnContextDelete(wxCommandEvent &event);
   void OnContextDeleteWithFile(wxCommandEvent &event);
 
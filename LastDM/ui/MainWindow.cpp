@@ -7,6 +7,7 @@
 #include <wx/filename.h>
 #include <wx/msgdlg.h>
 #include <wx/stdpaths.h>
+#include <wx/tokenzr.h>
 
 // Drop target for URLs
 class URLDropTarget : public wxTextDropTarget {
@@ -15,7 +16,14 @@ public:
 
   bool OnDropText(wxCoord x, wxCoord y, const wxString &text) override {
     if (m_parent) {
-      m_parent->ProcessUrl(text);
+      // Each dropped line is a download of its own
+      wxStringTokenizer lines(text, "\r\n");
+      while (lines.HasMoreTokens()) {
+        wxString line = lines.GetNextToken().Trim().Trim(false);
+        if (!line.IsEmpty()) {
+          m_parent->ProcessUrl(line);
+        }
+      }
       return true;
     }
     return false;
@@ -331,20 +339,37 @@ void MainWindow::OnAbout(wxCommandEvent &event) {
 
 void MainWindow::OnAddUrl(wxCommandEvent &event) {
   wxTextEntryDialog dialog(this,
-                           "Enter the URL to download:", "Add New Download", "",
-                           wxOK | wxCANCEL | wxCENTRE);
+                           "Enter the URL to download, and optionally mirrors "
+                           "of the same file on the lines below it:",
+                           "Add New Download", "",
+                           wxOK | wxCANCEL | wxCENTRE | wxTE_MULTILINE);
 
   if (dialog.ShowModal() == wxID_OK) {
-    wxString url = dialog.GetValue();
-    ProcessUrl(url);
+    // The first line is the URL, any others are mirrors of it
+    wxString url;
+    std::vector<std::string> mirrors;
+    wxStringTokenizer lines(dialog.GetValue(), "\r\n");
+    while (lines.HasMoreTokens()) {
+      wxString line = lines.GetNextToken().Trim().Trim(false);
+      if (line.IsEmpty()) {
+        continue;
+      }
+      if (url.IsEmpty()) {
+        url = line;
+      } else {
+        mirrors.push_back(line.ToStdString());
+      }
+    }
+    ProcessUrl(url, mirrors);
   }
 }
 
-void MainWindow::ProcessUrl(const wxString &url) {
+void MainWindow::ProcessUrl(const wxString &url,
+                            const std::vector<std::string> &mirrors) {
   if (!url.IsEmpty()) {
     // Add download to the manager
     DownloadManager &manager = DownloadManager::GetInstance();
-    int downloadId = manager.AddDownload(url.ToStdString());
+    int downloadId = manager.AddDownload(url.ToStdString(), "", mirrors);
 
     // Check for validation error
     if (downloadId < 0) {
@@ -3,6 +3,8 @@
 #include "CategoriesPanel.h"
 #include "DownloadsTable.h"
 #include "SpeedGraphPanel.h"
+#include <string>
+#include <vector>
 #include <wx/artprov.h>
 #include <wx/splitter.h>
 #include <wx/taskbar.h>
@@ -19,8 +21,9 @@ public:
   MainWindow();
   ~MainWindow();
 
-  // Helper to process URL (used by DnD)
-  void ProcessUrl(const wxString &url);
+  // Helper to process URL (used by DnD), with optional mirrors of it
+  void ProcessUrl(const wxString &url,
+                  const std::vector<std::string> &mirrors = {});
 
 private:
   // UI Components
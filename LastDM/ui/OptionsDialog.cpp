@@ -86,13 +86,12 @@ void OptionsDialog::CreateConnectionTab(wxNotebook *notebook) {
 
   wxFlexGridSizer *gridSizer = new wxFlexGridSizer(2, 2, 5, 10);
 
-  gridSizer->Add(new wxStaticText(panel, wxID_ANY,
-                                  "Max connections per download (WinINet: 1):"),
-                0, wxALIGN_CENTER_VERTICAL);
+  gridSizer->Add(
+      new wxStaticText(panel, wxID_ANY, "Max connections per download:"), 0,
+      wxALIGN_CENTER_VERTICAL);
   m_maxConnectionsSpin =
-      new wxSpinCtrl(panel, wxID_ANY, "1", wxDefaultPosition, wxSize(80, -1),
-                     wxSP_ARROW_KEYS, 1, 1, 1);
-  m_maxConnectionsSpin->Enable(false);
+      new wxSpinCtrl(panel, wxID_ANY, "8", wxDefaultPosition, wxSize(80, -1),
+                     wxSP_ARROW_KEYS, 1, 32, 8);
   gridSizer->Add(m_maxConnectionsSpin, 0);
 
   gridSizer->Add(
@@ -104,6 +103,10 @@ void OptionsDialog::CreateConnectionTab(wxNotebook *notebook) {
   gridSizer->Add(m_maxDownloadsSpin, 0);
 
   limitsBox->Add(gridSizer, 0, wxALL, 5);
+
+  m_adaptiveConnectionsCheck = new wxCheckBox(
+      panel, wxID_ANY, "Tune the connections per download (up to the max)");
+  limitsBox->Add(m_adaptiveConnectionsCheck, 0, wxALL, 5);
   sizer->Add(limitsBox, 0, wxEXPAND | wxALL, 10);
 
   // Speed limit
@@ -121,6 +124,43 @@ void OptionsDialog::CreateConnectionTab(wxNotebook *notebook) {
   speedBox->Add(speedSizer, 0, wxALL, 5);
   sizer->Add(speedBox, 0, wxEXPAND | wxALL, 10);
 
+  // Memory budget
+  wxStaticBoxSizer *memoryBox =
+      new wxStaticBoxSizer(wxVERTICAL, panel, "Memory");
+  wxBoxSizer *memorySizer = new wxBoxSizer(wxHORIZONTAL);
+  memorySizer->Add(new wxStaticText(
+                       panel, wxID_ANY,
+                       "Max buffered data, all downloads (MB, 0=unlimited):"),
+                   0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 10);
+  m_memoryBudgetSpin =
+      new wxSpinCtrl(panel, wxID_ANY, "0", wxDefaultPosition, wxSize(100, -1),
+                     wxSP_ARROW_KEYS, 0, 65536, 0);
+  memorySizer->Add(m_memoryBudgetSpin, 0);
+  memoryBox->Add(memorySizer, 0, wxALL, 5);
+  sizer->Add(memoryBox, 0, wxEXPAND | wxALL, 10);
+
+  // Slow connections
+  wxStaticBoxSizer *slowBox =
+      new wxStaticBoxSizer(wxVERTICAL, panel, "Slow Connections");
+  wxFlexGridSizer *slowSizer = new wxFlexGridSizer(2, 2, 5, 10);
+  slowSizer->Add(new wxStaticText(panel, wxID_ANY,
+                                  "Replace connections slower than (% of the "
+                                  "others, 0=never):"),
+                 0, wxALIGN_CENTER_VERTICAL);
+  m_slowPercentSpin =
+      new wxSpinCtrl(panel, wxID_ANY, "10", wxDefaultPosition, wxSize(80, -1),
+                     wxSP_ARROW_KEYS, 0, 90, 10);
+  slowSizer->Add(m_slowPercentSpin, 0);
+  slowSizer->Add(
+      new wxStaticText(panel, wxID_ANY, "Measured over (seconds):"), 0,
+      wxALIGN_CENTER_VERTICAL);
+  m_slowWindowSpin =
+      new wxSpinCtrl(panel, wxID_ANY, "10", wxDefaultPosition, wxSize(80, -1),
+                     wxSP_ARROW_KEYS, 1, 300, 10);
+  slowSizer->Add(m_slowWindowSpin, 0);
+  slowBox->Add(slowSizer, 0, wxALL, 5);
+  sizer->Add(slowBox, 0, wxEXPAND | wxALL, 10);
+
   // Proxy settings
   wxStaticBoxSizer *proxyBox =
       new wxStaticBoxSizer(wxVERTICAL, panel, "Proxy Settings");
@@ -240,8 +280,12 @@ void OptionsDialog::LoadSettings() {
   m_minimizeToTrayCheck->SetValue(settings.GetMinimizeToTray());
   m_showNotificationsCheck->SetValue(settings.GetShowNotifications());
   m_maxConnectionsSpin->SetValue(settings.GetMaxConnections());
+  m_adaptiveConnectionsCheck->SetValue(settings.GetAdaptiveConnections());
   m_maxDownloadsSpin->SetValue(settings.GetMaxSimultaneousDownloads());
   m_speedLimitSpin->SetValue(settings.GetSpeedLimit());
+  m_memoryBudgetSpin->SetValue(settings.GetMemoryBudget());
+  m_slowPercentSpin->SetValue(settings.GetSlowConnectionPercent());
+  m_slowWindowSpin->SetValue(settings.GetSlowConnectionWindow());
   m_useProxyCheck->SetValue(settings.GetUseProxy());
   m_proxyHostText->SetValue(settings.GetProxyHost());
   m_proxyPortSpin->SetValue(settings.GetProxyPort());
@@ -255,8 +299,12 @@ void OptionsDialog::SaveSettings() {
   settings.SetMinimizeToTray(m_minimizeToTrayCheck->GetValue());
   settings.SetShowNotifications(m_showNotificationsCheck->GetValue());
   settings.SetMaxConnections(m_maxConnectionsSpin->GetValue());
+  settings.SetAdaptiveConnections(m_adaptiveConnectionsCheck->GetValue());
   settings.SetMaxSimultaneousDownloads(m_maxDownloadsSpin->GetValue());
   settings.SetSpeedLimit(m_speedLimitSpin->GetValue());
+  settings.SetMemoryBudget(m_memoryBudgetSpin->GetValue());
+  settings.SetSlowConnectionPercent(m_slowPercentSpin->GetValue());
+  settings.SetSlowConnectionWindow(m_slowWindowSpin->GetValue());
   settings.SetUseProxy(m_useProxyCheck->GetValue());
   settings.SetProxyHost(m_proxyHostText->GetValue().ToStdString());
   settings.SetProxyPort(m_proxyPortSpin->GetValue());
@@ -22,8 +22,12 @@ private:
 
   // Connection tab controls
   wxSpinCtrl *m_maxConnectionsSpin;
+  wxCheckBox *m_adaptiveConnectionsCheck;
   wxSpinCtrl *m_maxDownloadsSpin;
   wxSpinCtrl *m_speedLimitSpin;
+  wxSpinCtrl *m_memoryBudgetSpin;
+  wxSpinCtrl *m_slowPercentSpin;
+  wxSpinCtrl *m_slowWindowSpin;
   wxCheckBox *m_useProxyCheck;
   wxTextCtrl *m_proxyHostText;
   wxSpinCtrl *m_proxyPortSpin;
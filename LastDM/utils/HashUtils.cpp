@@ -1,4 +1,5 @@
 #include "HashUtils.h"
+#include "../core/BufferPool.h"
 #include <Windows.h>
 #include <algorithm>
 #include <bcrypt.h>
@@ -68,9 +69,14 @@ std::string HashUtils::CalculateHash(const std::string &filePath,
     return "";
   }
 
-  std::vector<char> buffer(HASH_BUFFER_SIZE);
-  while (file.read(buffer.data(), HASH_BUFFER_SIZE) || file.gcount() > 0) {
-    status = BCryptHashData(hHash, (PBYTE)buffer.data(),
+  BufferPool::Buffer buffer = BufferPool::Shared().Acquire(HASH_BUFFER_SIZE);
+  if (!buffer.Data()) {
+    BCryptDestroyHash(hHash);
+    BCryptCloseAlgorithmProvider(hAlg, 0);
+    return "";
+  }
+  while (file.read(buffer.Data(), HASH_BUFFER_SIZE) || file.gcount() > 0) {
+    status = BCryptHashData(hHash, (PBYTE)buffer.Data(),
                             static_cast<ULONG>(file.gcount()), 0);
     if (!BCRYPT_SUCCESS(status)) {
       file.close();
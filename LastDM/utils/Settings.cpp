@@ -9,8 +9,10 @@ Settings &Settings::GetInstance() {
 
 Settings::Settings()
     : m_autoStart(true), m_minimizeToTray(true), m_showNotifications(true),
-      m_maxConnections(8), m_maxSimultaneousDownloads(3), m_speedLimit(0),
-      m_useProxy(false), m_proxyPort(8080) {
+      m_maxConnections(8), m_adaptiveConnections(false),
+      m_maxSimultaneousDownloads(3), m_speedLimit(0),
+      m_memoryBudget(0), m_slowConnectionPercent(10),
+      m_slowConnectionWindow(10), m_useProxy(false), m_proxyPort(8080) {
   // Set default download folder
   m_downloadFolder = wxStandardPaths::Get().GetDocumentsDir() +
                      wxFileName::GetPathSeparator() + "Downloads";
@@ -32,11 +34,17 @@ void Settings::Load() {
   m_showNotifications = db.GetSetting("show_notifications", "1") == "1";
 
   // Load connection settings
+  m_adaptiveConnections = db.GetSetting("adaptive_connections", "0") == "1";
   try {
     m_maxConnections = std::stoi(db.GetSetting("max_connections", "8"));
     m_maxSimultaneousDownloads =
         std::stoi(db.GetSetting("max_simultaneous_downloads", "3"));
     m_speedLimit = std::stoi(db.GetSetting("speed_limit", "0"));
+    m_memoryBudget = std::stoi(db.GetSetting("memory_budget", "0"));
+    m_slowConnectionPercent =
+        std::stoi(db.GetSetting("slow_connection_percent", "10"));
+    m_slowConnectionWindow =
+        std::stoi(db.GetSetting("slow_connection_window", "10"));
   } catch (...) {
     // Use defaults on parse error
   }
@@ -62,9 +70,15 @@ void Settings::Save() {
 
   // Save connection settings
   db.SetSetting("max_connections", std::to_string(m_maxConnections));
+  db.SetSetting("adaptive_connections", m_adaptiveConnections ? "1" : "0");
   db.SetSetting("max_simultaneous_downloads",
                 std::to_string(m_maxSimultaneousDownloads));
   db.SetSetting("speed_limit", std::to_string(m_speedLimit));
+  db.SetSetting("memory_budget", std::to_string(m_memoryBudget));
+  db.SetSetting("slow_connection_percent",
+                std::to_string(m_slowConnectionPercent));
+  db.SetSetting("slow_connection_window",
+                std::to_string(m_slowConnectionWindow));
 
   // Save proxy settings
   db.SetSetting("use_proxy", m_useProxy ? "1" : "0");
@@ -32,6 +32,10 @@ public:
   int GetMaxConnections() const { return m_maxConnections; }
   void SetMaxConnections(int value) { m_maxConnections = value; }
 
+  // Tune the connections per download up to the maximum
+  bool GetAdaptiveConnections() const { return m_adaptiveConnections; }
+  void SetAdaptiveConnections(bool value) { m_adaptiveConnections = value; }
+
   int GetMaxSimultaneousDownloads() const { return m_maxSimultaneousDownloads; }
   void SetMaxSimultaneousDownloads(int value) {
     m_maxSimultaneousDownloads = value;
@@ -40,6 +44,18 @@ public:
   int GetSpeedLimit() const { return m_speedLimit; }
   void SetSpeedLimit(int value) { m_speedLimit = value; }
 
+  // MB all downloads may hold in memory buffers, 0 = unlimited
+  int GetMemoryBudget() const { return m_memoryBudget; }
+  void SetMemoryBudget(int value) { m_memoryBudget = value; }
+
+  // A connection slower than this percentage of the download's others over
+  // the window (seconds) is replaced, 0 = never
+  int GetSlowConnectionPercent() const { return m_slowConnectionPercent; }
+  void SetSlowConnectionPercent(int value) { m_slowConnectionPercent = value; }
+
+  int GetSlowConnectionWindow() const { return m_slowConnectionWindow; }
+  void SetSlowConnectionWindow(int value) { m_slowConnectionWindow = value; }
+
   // Proxy settings
   bool GetUseProxy() const { return m_useProxy; }
   void SetUseProxy(bool value) { m_useProxy = value; }
@@ -62,8 +78,12 @@ private:
 
   // Connection
   int m_maxConnections;
+  bool m_adaptiveConnections;
   int m_maxSimultaneousDownloads;
   int m_speedLimit;
+  int m_memoryBudget;
+  int m_slowConnectionPercent;
+  int m_slowConnectionWindow;
 
   // Proxy
   bool m_useProxy;
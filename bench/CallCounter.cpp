@@ -0,0 +1,95 @@
+#include "CallCounter.h"
+#include <atomic>
+#include <dlfcn.h>
+#include <sys/types.h>
+
+// The system headers are left out on purpose: the wrappers below replace
+// their declarations
+
+struct iovec;
+
+namespace {
+
+std::atomic<int64_t> g_recv{0};
+std::atomic<int64_t> g_read{0};
+std::atomic<int64_t> g_splice{0};
+std::atomic<int64_t> g_write{0};
+std::atomic<int64_t> g_pwrite{0};
+
+// The C library's version of a wrapped function
+template <typename Function> Function Next(const char *name) {
+  return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+} // namespace
+
+extern "C" {
+
+ssize_t recv(int fd, void *buffer, size_t size, int flags) {
+  static auto next = Next<ssize_t (*)(int, void *, size_t, int)>("recv");
+  g_recv++;
+  return next(fd, buffer, size, flags);
+}
+
+ssize_t read(int fd, void *buffer, size_t size) {
+  static auto next = Next<ssize_t (*)(int, void *, size_t)>("read");
+  g_read++;
+  return next(fd, buffer, size);
+}
+
+ssize_t splice(int fdIn, loff_t *offIn, int fdOut, loff_t *offOut,
+               size_t size, unsigned int flags) {
+  static auto next =
+      Next<ssize_t (*)(int, loff_t *, int, loff_t *, size_t, unsigned int)>(
+          "splice");
+  g_splice++;
+  return next(fdIn, offIn, fdOut, offOut, size, flags);
+}
+
+ssize_t write(int fd, const void *data, size_t size) {
+  static auto next = Next<ssize_t (*)(int, const void *, size_t)>("write");
+  g_write++;
+  return next(fd, data, size);
+}
+
+ssize_t writev(int fd, const struct iovec *vectors, int count) {
+  static auto next =
+      Next<ssize_t (*)(int, const struct iovec *, int)>("writev");
+  g_write++;
+  return next(fd, vectors, count);
+}
+
+ssize_t pwrite(int fd, const void *data, size_t size, off_t offset) {
+  static auto next =
+      Next<ssize_t (*)(int, const void *, size_t, off_t)>("pwrite");
+  g_pwrite++;
+  return next(fd, data, size, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *vectors, int count,
+                off_t offset) {
+  static auto next =
+      Next<ssize_t (*)(int, const struct iovec *, int, off_t)>("pwritev");
+  g_pwrite++;
+  return next(fd, vectors, count, offset);
+}
+
+} // extern "C"
+
+CallCounts GetCallCounts() {
+  CallCounts counts;
+  counts.recv = g_recv.load();
+  counts.read = g_read.load();
+  counts.splice = g_splice.load();
+  counts.write = g_write.load();
+  counts.pwrite = g_pwrite.load();
+  return counts;
+}
+
+void ResetCallCounts() {
+  g_recv = 0;
+  g_read = 0;
+  g_splice = 0;
+  g_write = 0;
+  g_pwrite = 0;
+}
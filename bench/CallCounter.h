@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts the calls the download core makes to move data: receives from
+// sockets and writes to files. The calls are wrapped in this executable,
+// ahead of the C library, so they are counted wherever they come from in
+// this process (Linux only).
+struct CallCounts {
+  int64_t recv = 0;
+  int64_t read = 0;
+  int64_t splice = 0;
+  int64_t write = 0; // write, writev
+  int64_t pwrite = 0; // pwrite, pwritev
+};
+
+CallCounts GetCallCounts();
+void ResetCallCounts();
@@ -0,0 +1,183 @@
+#include "LoopbackServer.h"
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// The files repeat a block of noise. Its size is not a power of two, so
+// data written at the wrong offset of a segment does not match by chance.
+constexpr size_t PATTERN_SIZE = 1024 * 1024 + 7;
+
+const std::string &Pattern() {
+  static const std::string pattern = [] {
+    std::string block(PATTERN_SIZE, '\0');
+    uint32_t state = 2463534242u;
+    for (char &c : block) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      c = static_cast<char>(state);
+    }
+    return block;
+  }();
+  return pattern;
+}
+
+bool SendAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+} // namespace
+
+LoopbackServer::~LoopbackServer() { Stop(); }
+
+bool LoopbackServer::Start() {
+  int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0) {
+    return false;
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(listenFd, 128) != 0 ||
+      getsockname(listenFd, reinterpret_cast<sockaddr *>(&address),
+                  &length) != 0) {
+    close(listenFd);
+    return false;
+  }
+  m_port = ntohs(address.sin_port);
+
+  m_child = fork();
+  if (m_child == 0) {
+    Serve(listenFd);
+    _exit(0);
+  }
+  close(listenFd);
+  return m_child > 0;
+}
+
+void LoopbackServer::Stop() {
+  if (m_child > 0) {
+    kill(m_child, SIGTERM);
+    waitpid(m_child, nullptr, 0);
+    m_child = -1;
+  }
+}
+
+std::string LoopbackServer::GetUrl(int64_t bytes, Mode mode) const {
+  const char *prefix = mode == Mode::NoRanges ? "/norange/"
+                       : mode == Mode::Drop   ? "/drop/"
+                                              : "/";
+  return "http://127.0.0.1:" + std::to_string(m_port) + prefix +
+         std::to_string(bytes);
+}
+
+char LoopbackServer::ByteAt(int64_t offset) {
+  return Pattern()[static_cast<size_t>(offset % PATTERN_SIZE)];
+}
+
+void LoopbackServer::Serve(int listenFd) {
+  Pattern();
+  while (true) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd >= 0) {
+      std::thread(ServeConnection, fd).detach();
+    }
+  }
+}
+
+void LoopbackServer::ServeConnection(int fd) {
+  const std::string &pattern = Pattern();
+  std::string input;
+  char buffer[4096];
+
+  while (true) {
+    size_t headEnd;
+    while ((headEnd = input.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+      if (received <= 0) {
+        close(fd);
+        return;
+      }
+      input.append(buffer, static_cast<size_t>(received));
+    }
+    std::string head = input.substr(0, headEnd);
+    input.erase(0, headEnd + 4);
+
+    // "GET /<bytes> HTTP/1.1", "GET /norange/<bytes> HTTP/1.1" or
+    // "GET /drop/<bytes> HTTP/1.1"
+    size_t path = head.find('/');
+    if (path == std::string::npos) {
+      close(fd);
+      return;
+    }
+    bool ranges = head.compare(path, 9, "/norange/") != 0;
+    bool drop = head.compare(path, 6, "/drop/") == 0;
+    size_t digits = path + (!ranges ? 9 : drop ? 6 : 1);
+    int64_t size = std::strtoll(head.c_str() + digits, nullptr, 10);
+
+    std::string lower = head;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    int64_t start = 0;
+    int64_t end = size - 1;
+    size_t range = lower.find("\r\nrange: bytes=");
+    bool ranged = ranges && range != std::string::npos && size > 0;
+    if (ranged) {
+      char *rest = nullptr;
+      start = std::strtoll(head.c_str() + range + 15, &rest, 10);
+      if (*rest == '-' && std::isdigit(static_cast<unsigned char>(rest[1]))) {
+        end = std::min<int64_t>(end, std::strtoll(rest + 1, nullptr, 10));
+      }
+    }
+
+    std::string response =
+        ranged ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    response += ranges ? "Accept-Ranges: bytes\r\n" : "Accept-Ranges: none\r\n";
+    response += "Content-Length: " + std::to_string(end - start + 1) + "\r\n";
+    if (ranged) {
+      response += "Content-Range: bytes " + std::to_string(start) + "-" +
+                  std::to_string(end) + "/" + std::to_string(size) + "\r\n";
+    }
+    response += "\r\n";
+    if (!SendAll(fd, response.data(), response.size())) {
+      close(fd);
+      return;
+    }
+
+    int64_t last = drop ? std::min(end, start + DROP_SIZE - 1) : end;
+    for (int64_t offset = start; offset <= last;) {
+      size_t position = static_cast<size_t>(offset % PATTERN_SIZE);
+      size_t piece = static_cast<size_t>(std::min<int64_t>(
+          last - offset + 1, static_cast<int64_t>(PATTERN_SIZE - position)));
+      if (!SendAll(fd, pattern.data() + position, piece)) {
+        close(fd);
+        return;
+      }
+      offset += static_cast<int64_t>(piece);
+    }
+    if (last < end) {
+      close(fd);
+      return;
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// Serves generated files over HTTP/1.1 on 127.0.0.1 from a child process,
+// so its own socket calls are not counted with the client's. GET /<bytes>
+// returns that many bytes; a Range request gets that part of them as a
+// 206. GET /norange/<bytes> ignores Range and answers Accept-Ranges: none;
+// GET /drop/<bytes> closes the connection DROP_SIZE bytes into any longer
+// body. Connections are kept alive otherwise.
+class LoopbackServer {
+public:
+  enum class Mode { Ranges, NoRanges, Drop };
+  static constexpr int64_t DROP_SIZE = 1024 * 1024;
+
+  LoopbackServer() = default;
+  ~LoopbackServer();
+
+  // Disable copy
+  LoopbackServer(const LoopbackServer &) = delete;
+  LoopbackServer &operator=(const LoopbackServer &) = delete;
+
+  // Forks the server; call it before the process starts any threads
+  bool Start();
+  void Stop();
+
+  std::string GetUrl(int64_t bytes, Mode mode = Mode::Ranges) const;
+  // The byte at offset of every file served
+  static char ByteAt(int64_t offset);
+
+private:
+  static void Serve(int listenFd);
+  static void ServeConnection(int fd);
+
+  pid_t m_child = -1;
+  int m_port = 0;
+};
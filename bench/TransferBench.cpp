@@ -0,0 +1,158 @@
+// Downloads a file from a loopback server and reports the receive and
+// write calls it took per GiB, along with the time and the most memory
+// the buffer pool had out at once.
+//
+// transfer_bench [--size MiB] [--connections N] [--event-loop]
+//                [--zero-copy] [--async-io] [--mapped]
+//
+// Zero-copy and io_uring writes are off unless asked for, so the default
+// run measures the plain receive and write path.
+
+#include "CallCounter.h"
+#include "LoopbackServer.h"
+#include "core/BufferPool.h"
+#include "core/DownloadEngine.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+constexpr int64_t MIB = 1024 * 1024;
+constexpr double GIB = 1024.0 * 1024.0 * 1024.0;
+
+struct Options {
+  int64_t sizeMiB = 1024;
+  int connections = 1;
+  bool eventLoop = false;
+  bool zeroCopy = false;
+  bool asyncIo = false;
+  bool mapped = false;
+};
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--size" && i + 1 < argc) {
+      options.sizeMiB = std::atoll(argv[++i]);
+    } else if (arg == "--connections" && i + 1 < argc) {
+      options.connections = std::atoi(argv[++i]);
+    } else if (arg == "--event-loop") {
+      options.eventLoop = true;
+    } else if (arg == "--zero-copy") {
+      options.zeroCopy = true;
+    } else if (arg == "--async-io") {
+      options.asyncIo = true;
+    } else if (arg == "--mapped") {
+      options.mapped = true;
+    } else {
+      return false;
+    }
+  }
+  return options.sizeMiB > 0 && options.connections > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "usage: %s [--size MiB] [--connections N] [--event-loop]\n"
+                 "          [--zero-copy] [--async-io] [--mapped]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  // The server forks, so it has to start before the engine's threads do
+  LoopbackServer server;
+  if (!server.Start()) {
+    std::perror("loopback server");
+    return 1;
+  }
+
+  char directory[] = "/tmp/transfer_bench.XXXXXX";
+  if (!mkdtemp(directory)) {
+    std::perror("mkdtemp");
+    return 1;
+  }
+  int64_t size = options.sizeMiB * MIB;
+  // The engine names the file after the URL's path
+  std::string filePath = std::string(directory) + "/" + std::to_string(size);
+
+  bool finished = false;
+  bool succeeded = false;
+  std::string error;
+  std::mutex mutex;
+  std::condition_variable done;
+
+  CallCounts counts;
+  BufferPool::Stats pool;
+  double seconds = 0;
+  {
+    DownloadEngine engine;
+    engine.SetMaxConnections(options.connections);
+    engine.SetZeroCopy(options.zeroCopy);
+    engine.SetAsyncFileIo(options.asyncIo);
+    if (options.mapped) {
+      engine.SetWriteMode(DownloadEngine::WriteMode::Mapped);
+    }
+    if (options.eventLoop &&
+        !engine.SetEngineMode(DownloadEngine::EngineMode::EventLoop)) {
+      std::fprintf(stderr, "event loop mode is not available\n");
+      return 1;
+    }
+    engine.SetCompletionCallback(
+        [&](int, bool success, const std::string &message) {
+          std::lock_guard<std::mutex> lock(mutex);
+          finished = true;
+          succeeded = success;
+          error = message;
+          done.notify_all();
+        });
+
+    ResetCallCounts();
+    auto start = std::chrono::steady_clock::now();
+    engine.StartDownload(
+        std::make_shared<Download>(1, server.GetUrl(size), directory));
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [&] { return finished; });
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+    counts = GetCallCounts();
+    pool = BufferPool::Shared().GetStats();
+  }
+
+  server.Stop();
+  unlink(filePath.c_str());
+  unlink((filePath + ".ldmresume").c_str());
+  rmdir(directory);
+
+  if (!succeeded) {
+    std::fprintf(stderr, "download failed: %s\n", error.c_str());
+    return 1;
+  }
+
+  double perGiB = GIB / static_cast<double>(size);
+  std::printf("%lld MiB, %d connection(s), %s: %.2f s, %.0f MiB/s\n",
+              static_cast<long long>(options.sizeMiB), options.connections,
+              options.eventLoop ? "event loop" : "threaded", seconds,
+              static_cast<double>(options.sizeMiB) / seconds);
+  std::printf("calls per GiB: recv %.0f  read %.0f  splice %.0f  "
+              "write %.0f  pwrite %.0f\n",
+              counts.recv * perGiB, counts.read * perGiB,
+              counts.splice * perGiB, counts.write * perGiB,
+              counts.pwrite * perGiB);
+  std::printf("buffer pool: peak %.0f MiB, %llu allocated, %llu deferred\n",
+              static_cast<double>(pool.highWater) / MIB,
+              static_cast<unsigned long long>(pool.allocations),
+              static_cast<unsigned long long>(pool.deferred));
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "Check.h"
+#include "core/BandwidthLimiter.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void TestUnlimited() {
+  BandwidthLimiter limiter;
+  CHECK(!limiter.IsLimited());
+  CHECK(limiter.Consume(100 * 1024 * 1024) == 0);
+
+  limiter.SetRate(-5);
+  CHECK(!limiter.IsLimited() && limiter.GetRate() == 0);
+}
+
+// At 1 MB/s a fresh bucket holds one 100 ms burst; everything after it is
+// paid for by waiting, and each delay includes what was reserved before
+void TestDelays() {
+  BandwidthLimiter limiter;
+  limiter.SetRate(1000000);
+  CHECK(limiter.IsLimited());
+
+  CHECK(limiter.Consume(100000) == 0);
+  int first = limiter.Consume(500000);
+  CHECK(first >= 450 && first <= 500);
+  int second = limiter.Consume(250000);
+  CHECK(second >= 700 && second <= 750);
+
+  // A new rate drops the debt
+  limiter.SetRate(1000000);
+  CHECK(limiter.Consume(100000) == 0);
+}
+
+// Receivers that wait as told stay within the rate together
+void TestPacing() {
+  constexpr int64_t RATE = 4000000;
+  constexpr int THREADS = 4;
+  constexpr int READS = 25;
+  constexpr size_t READ_SIZE = 16000;
+
+  BandwidthLimiter limiter;
+  limiter.SetRate(RATE);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; ++t) {
+    threads.emplace_back([&limiter] {
+      for (int i = 0; i < READS; ++i) {
+        int delay = limiter.Consume(READ_SIZE);
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  // 1.6 MB at 4 MB/s, less the 100 ms burst: 0.3 s
+  CHECK(seconds >= 0.27);
+  CHECK(seconds < 0.6);
+}
+
+} // namespace
+
+int main() {
+  TestUnlimited();
+  TestDelays();
+  TestPacing();
+  return CheckResult();
+}
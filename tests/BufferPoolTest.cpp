@@ -0,0 +1,145 @@
+#include "Check.h"
+#include "core/BufferPool.h"
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+void TestSizeClasses() {
+  CHECK(BufferPool::RoundUp(1) == 1);
+  CHECK(BufferPool::RoundUp(4096) == 4096);
+  CHECK(BufferPool::RoundUp(4097) == 8192);
+
+  BufferPool pool;
+  BufferPool::Buffer small = pool.Acquire(1);
+  CHECK(small.Data() && small.Size() == BufferPool::MIN_SIZE);
+  BufferPool::Buffer odd = pool.Acquire(5000);
+  CHECK(odd.Data() && odd.Size() == 8192);
+  CHECK(reinterpret_cast<uintptr_t>(odd.Data()) % BufferPool::ALIGNMENT ==
+        0);
+}
+
+// A released buffer serves the next request of its size class, and only
+// so many are kept per class
+void TestReuse() {
+  BufferPool pool(2);
+  BufferPool::Buffer buffer = pool.Acquire(8192);
+  char *data = buffer.Data();
+  buffer = BufferPool::Buffer();
+  BufferPool::Stats stats = pool.GetStats();
+  CHECK(stats.allocations == 1 && stats.inUse == 0 && stats.cached == 8192);
+
+  buffer = pool.Acquire(6000);
+  CHECK(buffer.Data() == data);
+  stats = pool.GetStats();
+  CHECK(stats.allocations == 1 && stats.inUse == 8192 && stats.cached == 0);
+
+  BufferPool::Buffer other = pool.Acquire(16384);
+  CHECK(pool.GetStats().allocations == 2);
+  other = BufferPool::Buffer();
+  buffer = BufferPool::Buffer();
+
+  std::vector<BufferPool::Buffer> buffers;
+  for (int i = 0; i < 3; ++i) {
+    buffers.push_back(pool.Acquire(8192));
+  }
+  buffers.clear();
+  stats = pool.GetStats();
+  CHECK(stats.cached == 2 * 8192 + 16384);
+  CHECK(stats.highWater == 3 * 8192);
+}
+
+// Readers are turned down past the limit; writers never are
+void TestLimit() {
+  BufferPool pool;
+  pool.SetLimit(16384);
+  BufferPool::Buffer first = pool.Acquire(8192, true);
+  BufferPool::Buffer second = pool.Acquire(8192, true);
+  CHECK(first.Data() && second.Data());
+
+  BufferPool::Buffer refused = pool.Acquire(4096, true);
+  CHECK(!refused.Data() && refused.Size() == 0);
+  CHECK(pool.GetStats().deferred == 1);
+
+  BufferPool::Buffer writer = pool.Acquire(4096);
+  CHECK(writer.Data());
+  CHECK(pool.GetStats().inUse == 20480);
+
+  writer = BufferPool::Buffer();
+  second = BufferPool::Buffer();
+  BufferPool::Buffer retried = pool.Acquire(8192, true);
+  CHECK(retried.Data());
+
+  pool.SetLimit(0);
+  BufferPool::Buffer unlimited = pool.Acquire(1024 * 1024, true);
+  CHECK(unlimited.Data());
+  CHECK(pool.GetStats().deferred == 1);
+}
+
+// A read larger than the whole limit still gets a small buffer, and so
+// does one larger than what is left of it
+void TestAcquireWithin() {
+  constexpr size_t LARGE = 4 * 1024 * 1024;
+  constexpr size_t SMALL = 16 * 1024;
+
+  BufferPool pool;
+  pool.SetLimit(1024 * 1024);
+  CHECK(!pool.Acquire(LARGE, true).Data());
+
+  BufferPool::Buffer shrunk = pool.AcquireWithin(LARGE, SMALL);
+  CHECK(shrunk.Data() && shrunk.Size() == SMALL);
+
+  BufferPool::Buffer held = pool.Acquire(512 * 1024, true);
+  BufferPool::Buffer fits = pool.AcquireWithin(256 * 1024, SMALL);
+  CHECK(held.Data() && fits.Data() && fits.Size() == 256 * 1024);
+  BufferPool::Buffer rest = pool.AcquireWithin(256 * 1024, SMALL);
+  CHECK(rest.Data() && rest.Size() == SMALL);
+
+  // Nothing at all left
+  std::vector<BufferPool::Buffer> more;
+  while (true) {
+    BufferPool::Buffer buffer = pool.Acquire(SMALL, true);
+    if (!buffer.Data()) {
+      break;
+    }
+    more.push_back(std::move(buffer));
+  }
+  CHECK(pool.GetStats().inUse == 1024 * 1024);
+  CHECK(!pool.AcquireWithin(LARGE, SMALL).Data());
+}
+
+// Free buffers past a new limit are dropped, and so are buffers released
+// while the pool is over it
+void TestSetLimit() {
+  BufferPool pool(4);
+  std::vector<BufferPool::Buffer> buffers;
+  for (int i = 0; i < 4; ++i) {
+    buffers.push_back(pool.Acquire(8192));
+  }
+  buffers.clear();
+  CHECK(pool.GetStats().cached == 4 * 8192);
+
+  pool.SetLimit(16384);
+  CHECK(pool.GetStats().cached == 16384);
+
+  buffers.push_back(pool.Acquire(8192));
+  buffers.push_back(pool.Acquire(8192));
+  CHECK(pool.GetStats().allocations == 4);
+  CHECK(pool.GetStats().cached == 0);
+
+  pool.SetLimit(8192);
+  buffers.clear();
+  BufferPool::Stats stats = pool.GetStats();
+  CHECK(stats.inUse == 0 && stats.cached == 8192);
+}
+
+} // namespace
+
+int main() {
+  TestSizeClasses();
+  TestReuse();
+  TestLimit();
+  TestAcquireWithin();
+  TestSetLimit();
+  return CheckResult();
+}
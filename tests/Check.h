@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal checks for the core tests. A failed CHECK reports where it was
+// and the test carries on; main returns CheckResult() so the test fails
+// if any did.
+
+inline int &CheckFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                                     \
+  do {                                                                       \
+    if (!(condition)) {                                                      \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+                   #condition);                                              \
+      ++CheckFailures();                                                     \
+    }                                                                        \
+  } while (0)
+
+inline int CheckResult() {
+  if (CheckFailures() > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", CheckFailures());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include "Check.h"
+#include "core/ConnectionTuner.h"
+
+namespace {
+
+void TestLimits() {
+  CHECK(ConnectionTuner(10, 4).GetTarget() == 4);
+  CHECK(ConnectionTuner(0, 4).GetTarget() == 1);
+  CHECK(ConnectionTuner(3, 0).GetTarget() == 1);
+}
+
+// Grows while a step gains more than 10%, then goes back to the best count
+void TestGrowsUntilNoGain() {
+  ConnectionTuner tuner(2, 8);
+  CHECK(tuner.GetTarget() == 2 && !tuner.IsSettled());
+
+  CHECK(tuner.Update(100.0) == 3);
+  CHECK(tuner.Update(150.0) == 4);
+  CHECK(!tuner.IsSettled());
+  CHECK(tuner.Update(160.0) == 3);
+  CHECK(tuner.IsSettled());
+
+  // Settled counts stay put
+  CHECK(tuner.Update(1000.0) == 3);
+  CHECK(tuner.GetTarget() == 3);
+}
+
+void TestSettlesAtMaximum() {
+  ConnectionTuner tuner(1, 2);
+  CHECK(tuner.Update(100.0) == 2);
+  CHECK(!tuner.IsSettled());
+  CHECK(tuner.Update(200.0) == 2);
+  CHECK(tuner.IsSettled());
+}
+
+// Halves at most once between updates, even once settled
+void TestThrottle() {
+  ConnectionTuner tuner(8, 8);
+  tuner.Throttle();
+  CHECK(tuner.GetTarget() == 4);
+  CHECK(tuner.IsSettled());
+  tuner.Throttle();
+  CHECK(tuner.GetTarget() == 4);
+
+  CHECK(tuner.Update(100.0) == 4);
+  tuner.Throttle();
+  CHECK(tuner.GetTarget() == 2);
+  CHECK(tuner.Update(100.0) == 2);
+  tuner.Throttle();
+  CHECK(tuner.Update(100.0) == 1);
+  tuner.Throttle();
+  CHECK(tuner.GetTarget() == 1);
+}
+
+} // namespace
+
+int main() {
+  TestLimits();
+  TestGrowsUntilNoGain();
+  TestSettlesAtMaximum();
+  TestThrottle();
+  return CheckResult();
+}
@@ -0,0 +1,124 @@
+#include "Check.h"
+#include "core/Download.h"
+#include "core/EngineConfig.h"
+#include <vector>
+
+namespace {
+
+constexpr int64_t MIB = 1024 * 1024;
+
+void TestAcquireUnassigned() {
+  Download download(1, "http://example.com/file", "/tmp");
+  download.SetTotalSize(4 * MIB);
+  download.InitializeChunks(2);
+
+  CHECK(download.AcquireChunk() == 0);
+  CHECK(download.AcquireChunk() == 1);
+  CHECK(download.AcquireChunk() == -1);
+
+  // A released chunk is handed out again
+  download.ReleaseChunk(1);
+  CHECK(download.AcquireChunk() == 1);
+}
+
+// The idle connection takes the upper half of what is left of the chunk
+// expected to finish last; the two ranges meet without overlapping
+void TestSteal() {
+  Download download(1, "http://example.com/file", "/tmp");
+  download.SetTotalSize(4 * MIB);
+  download.InitializeChunks(2);
+  CHECK(download.AcquireChunk() == 0);
+  CHECK(download.AcquireChunk() == 1);
+
+  // Chunk 0 is half done but slow, chunk 1 untouched but fast
+  download.UpdateChunkProgress(0, MIB);
+  download.SetChunkSpeed(0, 1000.0);
+  download.SetChunkSpeed(1, 1000000.0);
+
+  int stolen = download.AcquireChunk(Config::MIN_STEAL_SIZE);
+  CHECK(stolen == 2);
+  std::vector<DownloadChunk> chunks = download.GetChunks();
+  CHECK(chunks.size() == 3);
+  if (chunks.size() != 3) {
+    return;
+  }
+
+  const DownloadChunk &victim = chunks[0];
+  const DownloadChunk &thief = chunks[2];
+  CHECK(victim.startByte == 0 && victim.currentByte == MIB);
+  CHECK(victim.endByte == MIB + MIB / 2 - 1);
+  CHECK(thief.startByte == victim.endByte + 1);
+  CHECK(thief.endByte == 2 * MIB - 1);
+  CHECK(thief.currentByte == thief.startByte);
+  CHECK(thief.active && !thief.completed);
+  CHECK(chunks[1].startByte == 2 * MIB && chunks[1].endByte == 4 * MIB - 1);
+  CHECK(Download::IsValidChunkMap(chunks, 4 * MIB));
+}
+
+// A read in flight when its chunk is stolen from may report bytes past the
+// new end; they count once, for the thief
+void TestStealDuringRead() {
+  Download download(1, "http://example.com/file", "/tmp");
+  download.SetTotalSize(4 * MIB);
+  download.InitializeChunks(1);
+  CHECK(download.AcquireChunk() == 0);
+  download.UpdateChunkProgress(0, MIB);
+
+  CHECK(download.AcquireChunk(Config::MIN_STEAL_SIZE) == 1);
+  int64_t end = download.GetChunkEnd(0);
+  CHECK(end == MIB + 3 * MIB / 2 - 1);
+
+  // The read was sized against the old end
+  download.UpdateChunkProgress(0, end + 1 + MIB);
+  DownloadChunk victim(0, 0);
+  CHECK(download.GetChunk(0, victim));
+  CHECK(victim.currentByte == end + 1 && victim.completed);
+  CHECK(download.GetDownloadedSize() == end + 1);
+
+  download.UpdateChunkProgress(1, end + 1 + MIB);
+  CHECK(download.GetDownloadedSize() == end + 1 + MIB);
+  CHECK(download.HasValidChunkMap());
+}
+
+// Both halves must keep at least the minimum
+void TestMinimumSplit() {
+  constexpr int64_t MIN = Config::MIN_STEAL_SIZE;
+
+  Download download(1, "http://example.com/file", "/tmp");
+  download.SetTotalSize(2 * MIN);
+  download.InitializeChunks(1);
+  CHECK(download.AcquireChunk() == 0);
+  CHECK(download.AcquireChunk() == -1);
+
+  CHECK(download.AcquireChunk(MIN) == 1);
+  std::vector<DownloadChunk> chunks = download.GetChunks();
+  CHECK(chunks.size() == 2);
+  if (chunks.size() == 2) {
+    CHECK(chunks[0].GetRemaining() == MIN && chunks[1].GetRemaining() == MIN);
+    CHECK(Download::IsValidChunkMap(chunks, 2 * MIN));
+  }
+  CHECK(download.AcquireChunk(MIN) == -1);
+
+  Download small(2, "http://example.com/file", "/tmp");
+  small.SetTotalSize(2 * MIN - 1);
+  small.InitializeChunks(1);
+  CHECK(small.AcquireChunk() == 0);
+  CHECK(small.AcquireChunk(MIN) == -1);
+  CHECK(small.GetChunks().size() == 1);
+
+  // A chunk of unknown length has no upper half to give away
+  Download unknown(3, "http://example.com/file", "/tmp");
+  unknown.InitializeChunks(1);
+  CHECK(unknown.AcquireChunk() == 0);
+  CHECK(unknown.AcquireChunk(MIN) == -1);
+}
+
+} // namespace
+
+int main() {
+  TestAcquireUnassigned();
+  TestSteal();
+  TestStealDuringRead();
+  TestMinimumSplit();
+  return CheckResult();
+}
@@ -0,0 +1,177 @@
+#include "Check.h"
+#include "core/HostResolver.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <thread>
+
+namespace {
+
+HostResolver::Address MakeAddress(const char *ip) {
+  HostResolver::Address address;
+  std::memset(&address.storage, 0, sizeof(address.storage));
+  auto *ipv4 = reinterpret_cast<sockaddr_in *>(&address.storage);
+  ipv4->sin_family = AF_INET;
+  inet_pton(AF_INET, ip, &ipv4->sin_addr);
+  address.length = sizeof(sockaddr_in);
+  return address;
+}
+
+bool SameAddress(const HostResolver::Address &a,
+                 const HostResolver::Address &b) {
+  return a.length == b.length &&
+         std::memcmp(&a.storage, &b.storage, a.length) == 0;
+}
+
+// Stands in for DNS: "missing.test" does not exist, every other host has
+// 10.0.0.1 and 10.0.0.2. Counts the lookups and can take its time.
+struct StubLookup {
+  std::atomic<int> lookups{0};
+  int delayMs = 0;
+
+  HostResolver::LookupFunction Function() {
+    return [this](const std::string &host, const std::string &,
+                  std::vector<HostResolver::Address> &addresses) {
+      lookups++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+      if (host == "missing.test") {
+        return EAI_NONAME;
+      }
+      addresses = {MakeAddress("10.0.0.1"), MakeAddress("10.0.0.2")};
+      return 0;
+    };
+  }
+};
+
+void TestCaches() {
+  StubLookup stub;
+  auto resolver =
+      std::make_shared<HostResolver>(HostResolver::Limits(), stub.Function());
+  std::vector<HostResolver::Address> addresses;
+  std::string error;
+
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  CHECK(error.empty() && addresses.size() == 2);
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  CHECK(stub.lookups == 1);
+  CHECK(resolver->GetStats().queries == 1 && resolver->GetStats().hits == 1);
+
+  // Keyed by port as well
+  CHECK(resolver->Resolve("a.test", "443", addresses, error));
+  CHECK(stub.lookups == 2);
+
+  addresses.clear();
+  CHECK(resolver->GetCached("a.test", "80", addresses));
+  CHECK(addresses.size() == 2);
+  CHECK(!resolver->GetCached("b.test", "80", addresses));
+
+  resolver->Clear();
+  CHECK(!resolver->GetCached("a.test", "80", addresses));
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  CHECK(stub.lookups == 3);
+}
+
+void TestFailures() {
+  StubLookup stub;
+  HostResolver::Limits limits;
+  limits.failureTtlMs = 50;
+  auto resolver = std::make_shared<HostResolver>(limits, stub.Function());
+  std::vector<HostResolver::Address> addresses;
+  std::string error;
+
+  CHECK(!resolver->Resolve("missing.test", "80", addresses, error));
+  CHECK(addresses.empty());
+  CHECK(error.find("missing.test") != std::string::npos);
+
+  // Remembered for a while, then asked again
+  error.clear();
+  CHECK(!resolver->Resolve("missing.test", "80", addresses, error));
+  CHECK(!error.empty());
+  CHECK(!resolver->GetCached("missing.test", "80", addresses));
+  CHECK(stub.lookups == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  CHECK(!resolver->Resolve("missing.test", "80", addresses, error));
+  CHECK(stub.lookups == 2);
+}
+
+void TestReportFailure() {
+  StubLookup stub;
+  auto resolver =
+      std::make_shared<HostResolver>(HostResolver::Limits(), stub.Function());
+  std::vector<HostResolver::Address> addresses;
+  std::string error;
+
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  CHECK(addresses.size() == 2);
+  resolver->ReportFailure("a.test", "80", MakeAddress("10.0.0.1"));
+  CHECK(resolver->GetCached("a.test", "80", addresses));
+  CHECK(addresses.size() == 2);
+  if (addresses.size() == 2) {
+    CHECK(SameAddress(addresses[0], MakeAddress("10.0.0.2")));
+    CHECK(SameAddress(addresses[1], MakeAddress("10.0.0.1")));
+  }
+}
+
+// Lookups of one host asked for together share one query
+void TestSharesQuery() {
+  StubLookup stub;
+  stub.delayMs = 50;
+  auto resolver =
+      std::make_shared<HostResolver>(HostResolver::Limits(), stub.Function());
+
+  std::promise<size_t> first;
+  std::promise<size_t> second;
+  resolver->ResolveAsync(
+      "a.test", "80",
+      [&first](const std::vector<HostResolver::Address> &addresses,
+               const std::string &) { first.set_value(addresses.size()); });
+  resolver->ResolveAsync(
+      "a.test", "80",
+      [&second](const std::vector<HostResolver::Address> &addresses,
+                const std::string &) { second.set_value(addresses.size()); });
+
+  std::vector<HostResolver::Address> addresses;
+  std::string error;
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  CHECK(addresses.size() == 2);
+  CHECK(first.get_future().get() == 2);
+  CHECK(second.get_future().get() == 2);
+  CHECK(stub.lookups == 1);
+  CHECK(resolver->GetStats().queries == 1);
+}
+
+// A full cache makes room by dropping the entry closest to expiring
+void TestEviction() {
+  StubLookup stub;
+  HostResolver::Limits limits;
+  limits.maxEntries = 2;
+  auto resolver = std::make_shared<HostResolver>(limits, stub.Function());
+  std::vector<HostResolver::Address> addresses;
+  std::string error;
+
+  CHECK(resolver->Resolve("a.test", "80", addresses, error));
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  CHECK(resolver->Resolve("b.test", "80", addresses, error));
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  CHECK(resolver->Resolve("c.test", "80", addresses, error));
+  CHECK(stub.lookups == 3);
+
+  CHECK(!resolver->GetCached("a.test", "80", addresses));
+  CHECK(resolver->GetCached("b.test", "80", addresses));
+  CHECK(resolver->GetCached("c.test", "80", addresses));
+}
+
+} // namespace
+
+int main() {
+  TestCaches();
+  TestFailures();
+  TestReportFailure();
+  TestSharesQuery();
+  TestEviction();
+  return CheckResult();
+}
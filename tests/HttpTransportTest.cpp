@@ -0,0 +1,66 @@
+#include "Check.h"
+#include "core/HttpTransport.h"
+
+namespace {
+
+void TestParseContentRange() {
+  int64_t start = 0;
+  int64_t end = 0;
+  int64_t length = 0;
+
+  CHECK(HttpTransport::ParseContentRange("bytes 0-499/1234", start, end,
+                                         length));
+  CHECK(start == 0 && end == 499 && length == 1234);
+
+  CHECK(HttpTransport::ParseContentRange("bytes  500-999/*", start, end,
+                                         length));
+  CHECK(start == 500 && end == 999 && length == -1);
+
+  CHECK(HttpTransport::ParseContentRange("bytes 100-199", start, end,
+                                         length));
+  CHECK(start == 100 && end == 199 && length == -1);
+
+  // Larger than 32 bits
+  CHECK(HttpTransport::ParseContentRange(
+      "bytes 4294967296-8589934591/8589934592", start, end, length));
+  CHECK(start == 4294967296LL && end == 8589934591LL &&
+        length == 8589934592LL);
+
+  // Rejected values leave the outputs alone
+  start = end = length = 7;
+  CHECK(!HttpTransport::ParseContentRange("bytes", start, end, length));
+  CHECK(!HttpTransport::ParseContentRange("bytes -5/10", start, end, length));
+  CHECK(!HttpTransport::ParseContentRange("bytes x-5/10", start, end,
+                                          length));
+  CHECK(!HttpTransport::ParseContentRange("bytes 5-/10", start, end, length));
+  CHECK(!HttpTransport::ParseContentRange("bytes 1x-5/10", start, end,
+                                          length));
+  CHECK(start == 7 && end == 7 && length == 7);
+}
+
+void TestFormatRangeHeader() {
+  CHECK(HttpTransport::FormatRangeHeader(0, 99) == "bytes=0-99");
+  CHECK(HttpTransport::FormatRangeHeader(100, -1) == "bytes=100-");
+  CHECK(HttpTransport::FormatRangeHeader(4294967296LL, 4294967395LL) ==
+        "bytes=4294967296-4294967395");
+}
+
+void TestParseRetryAfter() {
+  CHECK(HttpTransport::ParseRetryAfter("120") == 120);
+  CHECK(HttpTransport::ParseRetryAfter(" 5 ") == 5);
+  CHECK(HttpTransport::ParseRetryAfter("0") == 0);
+  CHECK(HttpTransport::ParseRetryAfter("") == -1);
+  CHECK(HttpTransport::ParseRetryAfter("5s") == -1);
+  CHECK(HttpTransport::ParseRetryAfter("-5") == -1);
+  CHECK(HttpTransport::ParseRetryAfter("Wed, 21 Oct 2015 07:28:00 GMT") ==
+        -1);
+}
+
+} // namespace
+
+int main() {
+  TestParseContentRange();
+  TestFormatRangeHeader();
+  TestParseRetryAfter();
+  return CheckResult();
+}
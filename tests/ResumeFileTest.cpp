@@ -0,0 +1,109 @@
+#include "Check.h"
+#include "core/ResumeFile.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+std::string FilePath() {
+  auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+  return (std::filesystem::temp_directory_path() /
+          ("ResumeFileTest." + std::to_string(stamp)))
+      .string();
+}
+
+ResumeState MakeState() {
+  ResumeState state;
+  state.url = "http://example.com/file.iso";
+  state.totalSize = 3000;
+  state.etag = "\"abc123\"";
+  state.lastModified = "Wed, 21 Oct 2015 07:28:00 GMT";
+  state.chunks.emplace_back(0, 999);
+  state.chunks.emplace_back(1000, 1999);
+  state.chunks.emplace_back(2000, 2999);
+  state.chunks[0].currentByte = 1000;
+  state.chunks[1].currentByte = 1500;
+  return state;
+}
+
+std::string ReadAll(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+void WriteAll(const std::string &path, const std::string &data) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+void TestRoundTrip(const std::string &filePath) {
+  ResumeState saved = MakeState();
+  CHECK(ResumeFile::Save(filePath, saved));
+
+  ResumeState loaded;
+  CHECK(ResumeFile::Load(filePath, loaded));
+  CHECK(loaded.url == saved.url);
+  CHECK(loaded.totalSize == saved.totalSize);
+  CHECK(loaded.etag == saved.etag);
+  CHECK(loaded.lastModified == saved.lastModified);
+  CHECK(loaded.chunks.size() == saved.chunks.size());
+  for (size_t i = 0; i < loaded.chunks.size() && i < saved.chunks.size();
+       ++i) {
+    CHECK(loaded.chunks[i].startByte == saved.chunks[i].startByte);
+    CHECK(loaded.chunks[i].endByte == saved.chunks[i].endByte);
+    CHECK(loaded.chunks[i].currentByte == saved.chunks[i].currentByte);
+  }
+
+  // Saving again replaces it
+  saved.chunks[2].currentByte = 2500;
+  CHECK(ResumeFile::Save(filePath, saved));
+  CHECK(ResumeFile::Load(filePath, loaded));
+  CHECK(loaded.chunks.size() == 3 && loaded.chunks[2].currentByte == 2500);
+}
+
+void TestRejectsDamage(const std::string &filePath) {
+  std::string path = ResumeFile::PathFor(filePath);
+  CHECK(ResumeFile::Save(filePath, MakeState()));
+  std::string data = ReadAll(path);
+  CHECK(data.size() > 16);
+
+  ResumeState untouched;
+  untouched.url = "unchanged";
+
+  // A flipped byte fails the checksum
+  std::string damaged = data;
+  damaged[damaged.size() / 2] ^= 0x01;
+  WriteAll(path, damaged);
+  ResumeState state = untouched;
+  CHECK(!ResumeFile::Load(filePath, state));
+  CHECK(state.url == "unchanged" && state.chunks.empty());
+
+  // So does a torn write
+  WriteAll(path, data.substr(0, data.size() - 5));
+  CHECK(!ResumeFile::Load(filePath, state));
+  WriteAll(path, data.substr(0, 3));
+  CHECK(!ResumeFile::Load(filePath, state));
+  WriteAll(path, "");
+  CHECK(!ResumeFile::Load(filePath, state));
+  CHECK(state.url == "unchanged");
+
+  WriteAll(path, data);
+  CHECK(ResumeFile::Load(filePath, state));
+
+  ResumeFile::Remove(filePath);
+  CHECK(!std::filesystem::exists(path));
+  CHECK(!ResumeFile::Load(filePath, state));
+}
+
+} // namespace
+
+int main() {
+  std::string filePath = FilePath();
+  TestRoundTrip(filePath);
+  TestRejectsDamage(filePath);
+  ResumeFile::Remove(filePath);
+  return CheckResult();
+}
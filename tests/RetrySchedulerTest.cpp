@@ -0,0 +1,121 @@
+#include "Check.h"
+#include "core/RetryScheduler.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<Download> MakeDownload(int id, int64_t delayMs) {
+  auto download =
+      std::make_shared<Download>(id, "http://example.com/file", "");
+  download->PostponeRetry(delayMs);
+  return download;
+}
+
+class Recorder {
+public:
+  void Add(const std::shared_ptr<Download> &download) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ids.push_back(download->GetId());
+    m_added.notify_all();
+  }
+
+  // The ids handed back so far, once there are count of them or timeoutMs
+  // has passed
+  std::vector<int> Wait(size_t count, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_added.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                     [&] { return m_ids.size() >= count; });
+    return m_ids;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_added;
+  std::vector<int> m_ids;
+};
+
+// Due times span several turns of the wheel and are scheduled out of order
+void TestFiringOrder() {
+  Recorder recorder;
+  RetryScheduler scheduler(
+      [&recorder](const std::shared_ptr<Download> &download) {
+        recorder.Add(download);
+      },
+      5, 4);
+
+  scheduler.Schedule(MakeDownload(1, 160));
+  scheduler.Schedule(MakeDownload(2, 40));
+  scheduler.Schedule(MakeDownload(3, 120));
+  scheduler.Schedule(MakeDownload(4, 80));
+  // Already due
+  scheduler.Schedule(MakeDownload(5, 0));
+  CHECK(scheduler.GetPendingCount() == 5);
+
+  std::vector<int> ids = recorder.Wait(5, 5000);
+  CHECK((ids == std::vector<int>{5, 2, 4, 3, 1}));
+  CHECK(scheduler.GetPendingCount() == 0);
+}
+
+// Nothing fires before its time
+void TestNotEarly() {
+  Recorder recorder;
+  RetryScheduler scheduler(
+      [&recorder](const std::shared_ptr<Download> &download) {
+        recorder.Add(download);
+      },
+      5, 8);
+
+  auto start = std::chrono::steady_clock::now();
+  scheduler.Schedule(MakeDownload(1, 100));
+  CHECK(recorder.Wait(1, 5000).size() == 1);
+  CHECK(std::chrono::steady_clock::now() - start >=
+        std::chrono::milliseconds(100));
+}
+
+void TestStop() {
+  Recorder recorder;
+  RetryScheduler scheduler(
+      [&recorder](const std::shared_ptr<Download> &download) {
+        recorder.Add(download);
+      },
+      5, 8);
+
+  scheduler.Schedule(MakeDownload(1, 50));
+  CHECK(scheduler.GetPendingCount() == 1);
+  scheduler.Stop();
+  CHECK(scheduler.GetPendingCount() == 0);
+
+  // Ignored once stopped
+  scheduler.Schedule(MakeDownload(2, 0));
+  CHECK(scheduler.GetPendingCount() == 0);
+  CHECK(recorder.Wait(1, 150).empty());
+}
+
+// Retry-After only ever moves the next retry later
+void TestPostpone() {
+  auto download = MakeDownload(1, 1000);
+  auto due = download->GetNextRetryTime();
+  CHECK(due > std::chrono::steady_clock::now());
+
+  download->PostponeRetry(10);
+  CHECK(download->GetNextRetryTime() == due);
+  download->PostponeRetry(2000);
+  CHECK(download->GetNextRetryTime() > due);
+
+  download->ResetRetry();
+  CHECK(download->GetNextRetryTime() <= std::chrono::steady_clock::now());
+}
+
+} // namespace
+
+int main() {
+  TestPostpone();
+  TestFiringOrder();
+  TestNotEarly();
+  TestStop();
+  return CheckResult();
+}
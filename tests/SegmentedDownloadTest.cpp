@@ -0,0 +1,175 @@
+#include "Check.h"
+#include "LoopbackServer.h"
+#include "core/DownloadEngine.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr int64_t FILE_SIZE = 8 * 1024 * 1024 + 12345;
+constexpr int CONNECTIONS = 4;
+
+struct Result {
+  bool success = false;
+  std::string error;
+  std::vector<DownloadChunk> chunks;
+  bool resumable = false;
+};
+
+Result Fetch(const std::shared_ptr<Download> &download,
+             DownloadEngine::EngineMode mode) {
+  bool finished = false;
+  Result result;
+  std::mutex mutex;
+  std::condition_variable done;
+
+  DownloadEngine engine;
+  engine.SetMaxConnections(CONNECTIONS);
+  engine.SetEngineMode(mode);
+  engine.SetCompletionCallback(
+      [&](int, bool success, const std::string &error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        result.success = success;
+        result.error = error;
+        done.notify_all();
+      });
+
+  engine.StartDownload(download);
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!done.wait_for(lock, std::chrono::seconds(60),
+                     [&] { return finished; })) {
+    result.error = "timed out";
+  }
+  result.chunks = download->GetChunks();
+  result.resumable = download->IsResumable();
+  return result;
+}
+
+// The file has every byte the server sent, each at its offset
+bool MatchesServer(const std::filesystem::path &path) {
+  std::error_code error;
+  if (std::filesystem::file_size(path, error) !=
+      static_cast<uintmax_t>(FILE_SIZE)) {
+    return false;
+  }
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> buffer(1024 * 1024);
+  int64_t offset = 0;
+  while (offset < FILE_SIZE) {
+    in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    std::streamsize read = in.gcount();
+    if (read <= 0) {
+      return false;
+    }
+    for (std::streamsize i = 0; i < read; ++i) {
+      if (buffer[static_cast<size_t>(i)] !=
+          LoopbackServer::ByteAt(offset + i)) {
+        std::fprintf(stderr, "byte %lld differs\n",
+                     static_cast<long long>(offset + i));
+        return false;
+      }
+    }
+    offset += read;
+  }
+  return true;
+}
+
+void TestDownload(const LoopbackServer &server, bool ranges,
+                  DownloadEngine::EngineMode mode,
+                  const std::filesystem::path &directory) {
+  std::filesystem::path path = directory / std::to_string(FILE_SIZE);
+  std::filesystem::remove(path);
+
+  auto download = std::make_shared<Download>(
+      1,
+      server.GetUrl(FILE_SIZE, ranges ? LoopbackServer::Mode::Ranges
+                                      : LoopbackServer::Mode::NoRanges),
+      directory.string());
+  Result result = Fetch(download, mode);
+  if (!result.success) {
+    std::fprintf(stderr, "download failed: %s\n", result.error.c_str());
+  }
+  CHECK(result.success);
+  CHECK(MatchesServer(path));
+  CHECK(!std::filesystem::exists(path.string() + ".ldmresume"));
+
+  if (ranges) {
+    // Fetched as separate ranges that fit together
+    CHECK(result.resumable);
+    CHECK(result.chunks.size() >= 2);
+    CHECK(Download::IsValidChunkMap(result.chunks, FILE_SIZE));
+  } else {
+    // Fell back to one stream
+    CHECK(!result.resumable);
+    CHECK(result.chunks.size() <= 1);
+  }
+  std::filesystem::remove(path);
+}
+
+// Reads that break off pick up where they stopped, and each break costs
+// one of the download's retries, whichever segment it hit
+void TestBrokenReads(const LoopbackServer &server,
+                     DownloadEngine::EngineMode mode,
+                     const std::filesystem::path &directory) {
+  std::filesystem::path path = directory / std::to_string(FILE_SIZE);
+  std::string url = server.GetUrl(FILE_SIZE, LoopbackServer::Mode::Drop);
+  int64_t breaks = FILE_SIZE / LoopbackServer::DROP_SIZE;
+
+  auto download = std::make_shared<Download>(1, url, directory.string());
+  download->SetMaxRetries(static_cast<int>(breaks) + 2 * CONNECTIONS);
+  Result result = Fetch(download, mode);
+  if (!result.success) {
+    std::fprintf(stderr, "download failed: %s\n", result.error.c_str());
+  }
+  CHECK(result.success);
+  CHECK(MatchesServer(path));
+  std::filesystem::remove(path);
+
+  // Fewer retries than breaks, though no segment breaks that often
+  download = std::make_shared<Download>(2, url, directory.string());
+  download->SetMaxRetries(static_cast<int>(breaks / CONNECTIONS));
+  result = Fetch(download, mode);
+  CHECK(!result.success);
+  CHECK(download->GetRetryCount() == download->GetMaxRetries());
+  std::filesystem::remove(path);
+  std::filesystem::remove(path.string() + ".ldmresume");
+}
+
+} // namespace
+
+int main() {
+  // The server forks, so it has to start before the engine's threads do
+  LoopbackServer server;
+  if (!server.Start()) {
+    std::perror("loopback server");
+    return 1;
+  }
+
+  auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() /
+      ("SegmentedDownloadTest." + std::to_string(stamp));
+  std::filesystem::create_directories(directory);
+
+  std::vector<DownloadEngine::EngineMode> modes = {
+      DownloadEngine::EngineMode::Threaded};
+  if (DownloadEngine().SetEngineMode(DownloadEngine::EngineMode::EventLoop)) {
+    modes.push_back(DownloadEngine::EngineMode::EventLoop);
+  }
+  for (DownloadEngine::EngineMode mode : modes) {
+    TestDownload(server, true, mode, directory);
+    TestDownload(server, false, mode, directory);
+    TestBrokenReads(server, mode, directory);
+  }
+
+  server.Stop();
+  std::filesystem::remove_all(directory);
+  return CheckResult();
+}